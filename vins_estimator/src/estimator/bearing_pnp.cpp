@@ -0,0 +1,348 @@
+/*******************************************************
+ * Copyright (C) 2019, Aerial Robotics Group, Hong Kong University of Science and Technology
+ *
+ * This file is part of VINS.
+ *
+ * Licensed under the GNU General Public License v3.0;
+ * you may not use this file except in compliance with the License.
+ *******************************************************/
+
+#include "bearing_pnp.h"
+#include "../utility/utility.h"
+
+using namespace Eigen;
+
+// Largest real root of m^3 + a m^2 + b m + c = 0
+static double solveCubicMaxRoot(double a, double b, double c)
+{
+    double p = b - a * a / 3;
+    double q = 2 * a * a * a / 27 - a * b / 3 + c;
+    double disc = q * q / 4 + p * p * p / 27;
+    double z;
+    if (disc > 0)
+    {
+        double s = sqrt(disc);
+        z = cbrt(-q / 2 + s) + cbrt(-q / 2 - s);
+    }
+    else
+    {
+        // Three real roots, k = 0 of the trigonometric form is the largest
+        double r = sqrt(-p / 3);
+        if (r < 1e-100)
+            z = 0;
+        else
+            z = 2 * r * cos(acos(std::max(-1.0, std::min(1.0, -q / (2 * r * r * r)))) / 3);
+    }
+    double m = z - a / 3;
+    for (int i = 0; i < 2; i++)
+    {
+        double f = ((m + a) * m + b) * m + c;
+        double df = (3 * m + 2 * a) * m + b;
+        if (fabs(df) > 1e-14)
+            m -= f / df;
+    }
+    return m;
+}
+
+// Real roots of c[0] x^4 + c[1] x^3 + c[2] x^2 + c[3] x + c[4] = 0 by Ferrari's method
+static int solveQuartic(const double c[5], double roots[4])
+{
+    if (fabs(c[0]) < 1e-12 * (fabs(c[1]) + fabs(c[2]) + fabs(c[3]) + fabs(c[4])))
+        return 0;
+    double a = c[1] / c[0], b = c[2] / c[0], cc = c[3] / c[0], d = c[4] / c[0];
+
+    // Depressed quartic y^4 + p y^2 + q y + r with x = y - a / 4
+    double a2 = a * a;
+    double p = b - 3 * a2 / 8;
+    double q = cc - a * b / 2 + a2 * a / 8;
+    double r = d - a * cc / 4 + a2 * b / 16 - 3 * a2 * a2 / 256;
+
+    double ys[4];
+    int num = 0;
+    if (fabs(q) < 1e-14)
+    {
+        double disc = p * p - 4 * r;
+        if (disc < 0)
+            return 0;
+        for (int sign = -1; sign <= 1; sign += 2)
+        {
+            double z = (-p + sign * sqrt(disc)) / 2;
+            if (z < 0)
+                continue;
+            ys[num++] = sqrt(z);
+            ys[num++] = -sqrt(z);
+        }
+    }
+    else
+    {
+        // (y^2 + p/2 + m)^2 = (s y - q / 2s)^2 with s = sqrt(2m), m a positive root of the resolvent cubic
+        double m = solveCubicMaxRoot(p, p * p / 4 - r, -q * q / 8);
+        if (m <= 0)
+            return 0;
+        double s = sqrt(2 * m);
+        for (int sign = -1; sign <= 1; sign += 2)
+        {
+            // y^2 + B y + C = 0
+            double B = sign * s;
+            double C = p / 2 + m - sign * q / (2 * s);
+            double disc = B * B - 4 * C;
+            if (disc < 0)
+            {
+                // Keep nearly double roots
+                if (disc < -1e-10 * (B * B + fabs(C) + 1))
+                    continue;
+                disc = 0;
+            }
+            ys[num++] = (-B + sqrt(disc)) / 2;
+            ys[num++] = (-B - sqrt(disc)) / 2;
+        }
+    }
+
+    for (int i = 0; i < num; i++)
+    {
+        double x = ys[i] - a / 4;
+        for (int k = 0; k < 2; k++)
+        {
+            double f = (((x + a) * x + b) * x + cc) * x + d;
+            double df = ((4 * x + 3 * a) * x + 2 * b) * x + cc;
+            if (fabs(df) > 1e-14)
+                x -= f / df;
+        }
+        roots[i] = x;
+    }
+    return num;
+}
+
+// Orthonormal frame of a triangle, false if it is degenerate
+static bool triangleFrame(const Vector3d &A, const Vector3d &B, const Vector3d &C, Matrix3d &F)
+{
+    Vector3d e1 = B - A;
+    Vector3d e3 = e1.cross(C - A);
+    double n1 = e1.norm(), n3 = e3.norm();
+    if (n1 < 1e-9 || n3 < 1e-9 * n1 * (C - A).norm())
+        return false;
+    e1 /= n1;
+    e3 /= n3;
+    F.col(0) = e1;
+    F.col(1) = e3.cross(e1);
+    F.col(2) = e3;
+    return true;
+}
+
+BearingPnP::BearingPnP():
+    thres(BEARING_PNP_RANSAC_THRES / FOCAL_LENGTH), rng(0)
+{
+}
+
+void BearingPnP::clear()
+{
+    pts_w.clear();
+    bearings.clear();
+}
+
+void BearingPnP::add(const Vector3d &pt_w, const Vector3d &bearing)
+{
+    pts_w.push_back(pt_w);
+    bearings.push_back(bearing.normalized());
+}
+
+// Grunert's solution, see Haralick et al., Review and analysis of solutions of the three point
+// perspective pose estimation problem, IJCV 1994
+int BearingPnP::p3p(int i0, int i1, int i2, Matrix3d R[4], Vector3d t[4]) const
+{
+    const Vector3d &P1 = pts_w[i0], &P2 = pts_w[i1], &P3 = pts_w[i2];
+    const Vector3d &j1 = bearings[i0], &j2 = bearings[i1], &j3 = bearings[i2];
+
+    Matrix3d F_w;
+    if (!triangleFrame(P1, P2, P3, F_w))
+        return 0;
+
+    double a2 = (P2 - P3).squaredNorm(), b2 = (P1 - P3).squaredNorm(), c2 = (P1 - P2).squaredNorm();
+    double cos_a = j2.dot(j3), cos_b = j1.dot(j3), cos_g = j1.dot(j2);
+    double ac = (a2 - c2) / b2, apc = (a2 + c2) / b2;
+    double bc = (b2 - c2) / b2, ba = (b2 - a2) / b2;
+    double cos_a2 = cos_a * cos_a, cos_b2 = cos_b * cos_b, cos_g2 = cos_g * cos_g;
+
+    double coeffs[5];
+    coeffs[0] = (ac - 1) * (ac - 1) - 4 * c2 / b2 * cos_a2;
+    coeffs[1] = 4 * (ac * (1 - ac) * cos_b - (1 - apc) * cos_a * cos_g + 2 * c2 / b2 * cos_a2 * cos_b);
+    coeffs[2] = 2 * (ac * ac - 1 + 2 * ac * ac * cos_b2 + 2 * bc * cos_a2 - 4 * apc * cos_a * cos_b * cos_g + 2 * ba * cos_g2);
+    coeffs[3] = 4 * (-ac * (1 + ac) * cos_b + 2 * a2 / b2 * cos_g2 * cos_b - (1 - apc) * cos_a * cos_g);
+    coeffs[4] = (1 + ac) * (1 + ac) - 4 * a2 / b2 * cos_g2;
+
+    double vs[4];
+    int root_num = solveQuartic(coeffs, vs);
+    int num = 0;
+    for (int i = 0; i < root_num; i++)
+    {
+        // Depths s2 = u s1, s3 = v s1
+        double v = vs[i];
+        double den = 2 * (cos_g - v * cos_a);
+        if (v <= 0 || fabs(den) < 1e-12)
+            continue;
+        double u = ((ac - 1) * v * v - 2 * ac * cos_b * v + 1 + ac) / den;
+        double s1_2 = c2 / (1 + u * u - 2 * u * cos_g);
+        if (u <= 0 || !(s1_2 > 0))
+            continue;
+        double s1 = sqrt(s1_2);
+
+        Matrix3d F_c;
+        Vector3d X1 = s1 * j1;
+        if (!triangleFrame(X1, u * s1 * j2, v * s1 * j3, F_c))
+            continue;
+        R[num] = F_c * F_w.transpose();
+        t[num] = X1 - R[num] * P1;
+        num++;
+    }
+    return num;
+}
+
+// MSAC cost of the chordal bearing error
+double BearingPnP::score(const Matrix3d &R, const Vector3d &t, int &inlier_num) const
+{
+    double thres2 = thres * thres;
+    double cost = 0;
+    inlier_num = 0;
+    for (int i = 0; i < size(); i++)
+    {
+        Vector3d pt_c = R * pts_w[i] + t;
+        double dep = pt_c.norm();
+        double err2 = dep > 1e-9 ? (pt_c / dep - bearings[i]).squaredNorm() : 4.0;
+        if (err2 < thres2)
+        {
+            cost += err2;
+            inlier_num++;
+        }
+        else
+            cost += thres2;
+    }
+    return cost;
+}
+
+int BearingPnP::markInliers(const Matrix3d &R, const Vector3d &t)
+{
+    double thres2 = thres * thres;
+    int inlier_num = 0;
+    inlier.resize(size());
+    for (int i = 0; i < size(); i++)
+    {
+        Vector3d pt_c = R * pts_w[i] + t;
+        double dep = pt_c.norm();
+        inlier[i] = dep > 1e-9 && (pt_c / dep - bearings[i]).squaredNorm() < thres2;
+        inlier_num += inlier[i];
+    }
+    return inlier_num;
+}
+
+// Gauss-Newton on the inliers. The residual is the normalized camera point projected on the tangent
+// plane of its bearing, the pose is updated as R <- exp(dtheta) R, t <- t + dt
+void BearingPnP::refine(Matrix3d &R, Vector3d &t) const
+{
+    for (int iter = 0; iter < BEARING_PNP_GN_ITER; iter++)
+    {
+        Matrix<double, 6, 6> H = Matrix<double, 6, 6>::Zero();
+        Matrix<double, 6, 1> g = Matrix<double, 6, 1>::Zero();
+        for (int i = 0; i < size(); i++)
+        {
+            if (!inlier[i])
+                continue;
+            const Vector3d &b = bearings[i];
+            Vector3d e1 = b.cross(fabs(b.x()) < 0.9 ? Vector3d::UnitX() : Vector3d::UnitY()).normalized();
+            Vector3d e2 = b.cross(e1);
+            Matrix<double, 2, 3> T;
+            T.row(0) = e1.transpose();
+            T.row(1) = e2.transpose();
+
+            Vector3d pt_r = R * pts_w[i];
+            Vector3d pt_c = pt_r + t;
+            double dep = pt_c.norm();
+            Vector3d n = pt_c / dep;
+            Vector2d r = T * n;
+            Matrix<double, 2, 3> J_n = T * (Matrix3d::Identity() - n * n.transpose()) / dep;
+            Matrix<double, 2, 6> J;
+            J.leftCols<3>() = -J_n * Utility::skewSymmetric(pt_r);
+            J.rightCols<3>() = J_n;
+            H += J.transpose() * J;
+            g += J.transpose() * r;
+        }
+
+        Matrix<double, 6, 1> delta = H.ldlt().solve(-g);
+        if (!delta.allFinite())
+            break;
+        Vector3d dtheta = delta.head<3>();
+        double angle = dtheta.norm();
+        if (angle > 1e-12)
+            R = AngleAxisd(angle, dtheta / angle).toRotationMatrix() * R;
+        t += delta.tail<3>();
+        if (delta.norm() < 1e-10)
+            break;
+    }
+}
+
+bool BearingPnP::solve(Matrix3d &R, Vector3d &t, int &inlier_num)
+{
+    inlier_num = 0;
+    int num = size();
+    if (num < 4)
+    {
+        printf("feature tracking not enough, please slowly move you device! \n");
+        return false;
+    }
+
+    // The initial guess competes with the P3P hypotheses
+    Matrix3d best_R = R;
+    Vector3d best_t = t;
+    int best_inliers;
+    double best_cost = score(R, t, best_inliers);
+
+    std::uniform_int_distribution<int> pick(0, num - 1);
+    Matrix3d R_hyp[4];
+    Vector3d t_hyp[4];
+    int max_iter = BEARING_PNP_MAX_ITER;
+    for (int iter = 0; iter < max_iter; iter++)
+    {
+        int i0 = pick(rng), i1 = pick(rng), i2 = pick(rng);
+        if (i0 == i1 || i0 == i2 || i1 == i2)
+            continue;
+        int hyp_num = p3p(i0, i1, i2, R_hyp, t_hyp);
+        for (int k = 0; k < hyp_num; k++)
+        {
+            int inliers;
+            double cost = score(R_hyp[k], t_hyp[k], inliers);
+            if (cost < best_cost)
+            {
+                best_cost = cost;
+                best_R = R_hyp[k];
+                best_t = t_hyp[k];
+                best_inliers = inliers;
+            }
+        }
+
+        // Samples needed for 99% confidence of one all inlier sample
+        double w3 = pow((double)best_inliers / num, 3);
+        if (w3 >= 1)
+            break;
+        if (w3 > 0)
+            max_iter = std::min(max_iter, (int)ceil(log(0.01) / log(1 - w3)));
+    }
+
+    for (int round = 0; round < 2; round++)
+    {
+        if (markInliers(best_R, best_t) < BEARING_PNP_MIN_INLIERS)
+        {
+            printf("pnp failed ! \n");
+            return false;
+        }
+        refine(best_R, best_t);
+    }
+
+    inlier_num = markInliers(best_R, best_t);
+    if (inlier_num < BEARING_PNP_MIN_INLIERS)
+    {
+        printf("pnp failed ! \n");
+        return false;
+    }
+    R = best_R;
+    t = best_t;
+    return true;
+}
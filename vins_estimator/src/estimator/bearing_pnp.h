@@ -0,0 +1,52 @@
+/*******************************************************
+ * Copyright (C) 2019, Aerial Robotics Group, Hong Kong University of Science and Technology
+ *
+ * This file is part of VINS.
+ *
+ * Licensed under the GNU General Public License v3.0;
+ * you may not use this file except in compliance with the License.
+ *******************************************************/
+
+#pragma once
+
+#include <vector>
+#include <random>
+#include <eigen3/Eigen/Dense>
+
+#include "parameters.h"
+
+// Inlier threshold of the bearing error, in pixels at FOCAL_LENGTH
+#define BEARING_PNP_RANSAC_THRES 2.0
+#define BEARING_PNP_MAX_ITER 100
+#define BEARING_PNP_MIN_INLIERS 6
+#define BEARING_PNP_GN_ITER 10
+
+// Absolute camera pose from unit bearing vectors, so fisheye observations all around the
+// sphere can be used as they are.
+// Hypotheses come from Grunert's P3P and the initial guess, are scored with the truncated chordal
+// bearing error (MSAC), and the best one is refined with Gauss-Newton on its inliers.
+// Correspondence buffers are kept between calls.
+class BearingPnP
+{
+  public:
+    BearingPnP();
+
+    void clear();
+    void add(const Eigen::Vector3d &pt_w, const Eigen::Vector3d &bearing);
+    int size() const { return pts_w.size(); }
+
+    // R, t map world points into the camera frame; they hold the initial guess on input
+    bool solve(Eigen::Matrix3d &R, Eigen::Vector3d &t, int &inlier_num);
+
+  private:
+    int p3p(int i0, int i1, int i2, Eigen::Matrix3d R[4], Eigen::Vector3d t[4]) const;
+    double score(const Eigen::Matrix3d &R, const Eigen::Vector3d &t, int &inlier_num) const;
+    int markInliers(const Eigen::Matrix3d &R, const Eigen::Vector3d &t);
+    void refine(Eigen::Matrix3d &R, Eigen::Vector3d &t) const;
+
+    std::vector<Eigen::Vector3d> pts_w;
+    std::vector<Eigen::Vector3d> bearings;
+    std::vector<char> inlier;
+    double thres;
+    std::mt19937 rng;
+};
@@ -26,6 +26,7 @@ Estimator::Estimator(): f_manager{Rs}
     // begin_time_count = 10;
     initFirstPoseFlag = false;
     f_manager.ft = &featureTracker;
+    featureTracker.track_drawer.setSink(pubTrackImage, [] { return pub_image_track.getNumSubscribers() > 0; });
 }
 
 void Estimator::setParameter()
@@ -37,6 +38,7 @@ void Estimator::setParameter()
         cout << " exitrinsic cam " << i << endl  << ric[i] << endl << tic[i].transpose() << endl;
     }
     f_manager.setRic(ric);
+    featureTracker.gyro_predictor.setExtrinsic(ric);
     ProjectionTwoFrameOneCamFactor::sqrt_info = FOCAL_LENGTH / 1.5 * Matrix2d::Identity();
     ProjectionTwoFrameTwoCamFactor::sqrt_info = FOCAL_LENGTH / 1.5 * Matrix2d::Identity();
     ProjectionOneFrameTwoCamFactor::sqrt_info = FOCAL_LENGTH / 1.5 * Matrix2d::Identity();
@@ -45,6 +47,7 @@ void Estimator::setParameter()
     cout << "set g " << g.transpose() << endl;
     featureTracker.readIntrinsicParameter(CAM_NAMES);
 
+    imu_propagator.start(pubLatestOdometry);
     processThread   = std::thread(&Estimator::processMeasurements, this);
     if (FISHEYE && ENABLE_DEPTH) {
         depthThread   = std::thread(&Estimator::processDepthGeneration, this);
@@ -58,7 +61,7 @@ void Estimator::inputImage(double t, const cv::Mat &_img, const cv::Mat &_img1,
     static int img_track_count = 0;
     static double sum_time = 0;
     inputImageCnt++;
-    FeatureFrame featureFrame;
+    FeatureFramePtr featureFrame;
     TicToc featureTrackerTime;
 
     if (FISHEYE) {
@@ -101,7 +104,7 @@ void Estimator::inputFisheyeImage(double t, const CvCudaImages & fisheye_imgs_up
         inputImageCnt++;
     }
     
-    FeatureFrame featureFrame;
+    FeatureFramePtr featureFrame;
     TicToc featureTrackerTime;
 
     featureFrame = featureTracker.trackImage_fisheye(t, fisheye_imgs_up_cuda, fisheye_imgs_down_cuda, is_blank_init);
@@ -137,25 +140,31 @@ double base = 0;
 
 void Estimator::inputIMU(double t, const Vector3d &linearAcceleration, const Vector3d &angularVelocity)
 {
+    IMUSample sample{t, linearAcceleration, angularVelocity};
+    inputIMUBatch(&sample, 1);
+}
+
+// Append a burst of IMU samples with one lock, the IMU-rate propagation of the burst
+// is done by imu_propagator.
+void Estimator::inputIMUBatch(const IMUSample * samples, int num)
+{
+    if (num <= 0)
+        return;
+
     mBuf.lock();
-    accBuf.push(make_pair(t, linearAcceleration));
-    gyrBuf.push(make_pair(t, angularVelocity));
-
-    fastPredictIMU(t, linearAcceleration, angularVelocity);
-    // if (solver_flag == NON_LINEAR && fast_prop_inited) {
-    if (fast_prop_inited) {
-    //if (fast_prop_inited) {
-        if (solver_flag !=  NON_LINEAR) {
-            ROS_ERROR("Is not non linear!!!!");
-            exit(-1);
-        }
-        pubLatestOdometry(latest_P, latest_Q, latest_V, t);
+    for (int i = 0; i < num; i++)
+    {
+        accBuf.push(make_pair(samples[i].t, samples[i].acc));
+        gyrBuf.push(make_pair(samples[i].t, samples[i].gyr));
     }
     mBuf.unlock();
 
+    imu_propagator.inputIMU(samples, num);
+    if (FISHEYE)
+        featureTracker.gyro_predictor.input(samples, num);
 }
 
-void Estimator::inputFeature(double t, const FeatureFrame &featureFrame)
+void Estimator::inputFeature(double t, const FeatureFramePtr &featureFrame)
 {
     mBuf.lock();
     featureBuf.push(make_pair(t, featureFrame));
@@ -329,11 +338,11 @@ void Estimator::processMeasurements()
     {
         //printf("process measurments\n");
         TicToc t_process;
-        pair<double, FeatureFrame > feature;
+        pair<double, FeatureFramePtr> feature;
         vector<pair<double, Eigen::Vector3d>> accVector, gyrVector;
         if(!featureBuf.empty())
         {
-            feature = featureBuf.front();
+            feature = std::move(featureBuf.front());
 
             curTime = feature.first + td;
             while(1)
@@ -440,6 +449,7 @@ void Estimator::initFirstPose(Eigen::Vector3d p, Eigen::Matrix3d r)
 
 void Estimator::clearState()
 {
+    syncRepropagation();
     for (int i = 0; i < WINDOW_SIZE + 1; i++)
     {
         Rs[i].setIdentity();
@@ -469,10 +479,9 @@ void Estimator::clearState()
     sum_of_front = 0;
     frame_count = 0;
     solver_flag = INITIAL;
-    latest_P = Eigen::Vector3d::Zero();
-    latest_V = Eigen::Vector3d::Zero();
-    latest_Q = Eigen::Quaterniond::Identity();
-    fast_prop_inited = false;
+    imu_propagator.reset();
+    featureTracker.gyro_predictor.resetState();
+    featureTracker.feature_budget.reset();
     initial_timestamp = 0;
     all_image_frame.clear();
 
@@ -526,11 +535,11 @@ void Estimator::processIMU(double t, double dt, const Vector3d &linear_accelerat
     gyr_0 = angular_velocity; 
 }
 
-void Estimator::processImage(const FeatureFrame &image, const double header)
+void Estimator::processImage(const FeatureFramePtr &image, const double header)
 {
     ROS_DEBUG("new image coming ------------------------------------------");
-    ROS_DEBUG("Adding feature points %lu", image.size());
-    if (f_manager.addFeatureCheckParallax(frame_count, image, td))
+    ROS_DEBUG("Adding feature points %d", image->size());
+    if (f_manager.addFeatureCheckParallax(frame_count, *image, td))
     {
         marginalization_flag = MARGIN_OLD;
         //printf("keyframe\n");
@@ -616,10 +625,7 @@ void Estimator::processImage(const FeatureFrame &image, const double header)
                     i++;
                 }
                 solveGyroscopeBias(all_image_frame, Bgs);
-                for (int i = 0; i <= WINDOW_SIZE; i++)
-                {
-                    pre_integrations[i]->repropagate(Vector3d::Zero(), Bgs[i]);
-                }
+                repropagateWindow(Vector3d::Zero(), Bgs);
                 
                 solver_flag = NON_LINEAR;
                 optimization();
@@ -680,9 +686,20 @@ void Estimator::processImage(const FeatureFrame &image, const double header)
         }
         
         set<int> removeIndex;
-        outliersRejection(removeIndex);
+        ResidualHistogram residual_hist;
+        outliersRejection(removeIndex, residual_hist);
         ROS_INFO("Remove %ld outlier", removeIndex.size());
         f_manager.removeOutlier(removeIndex);
+        int solved_num = f_manager.getSolvedCount();
+
+        if(ENABLE_PERF_OUTPUT) {
+            for (int c = 0; c < NUM_OF_CAM; c++) {
+                std::string hist_str;
+                for (int i = 0; i < RESIDUAL_HIST_BINS; i++)
+                    hist_str += " " + std::to_string(residual_hist.count[c][i]);
+                ROS_INFO("Cam %d residual histogram (%.1fpx bins):%s", c, RESIDUAL_HIST_BIN_SIZE, hist_str.c_str());
+            }
+        }
 
         if(ENABLE_PERF_OUTPUT) {
             ROS_INFO("after removeOutlier cost %fms..", t_ic.toc());
@@ -725,6 +742,7 @@ void Estimator::processImage(const FeatureFrame &image, const double header)
         odometry_buf.push(make_pair( header, make_pair(last_R, last_P)));
         odomBuf.unlock();
 
+        featureTracker.feature_budget.reportSolve(t_solve.toc(), solved_num);
         updateLatestStates();
         if(ENABLE_PERF_OUTPUT) {
             ROS_INFO("after updateLatestStates costs: %fms", t_solve.toc());
@@ -768,17 +786,14 @@ bool Estimator::initialStructure()
     Vector3d T[frame_count + 1];
     map<int, Vector3d> sfm_tracked_points;
     vector<SFMFeature> sfm_f;
-    for (auto &_it : f_manager.feature)
+    for (auto &it_per_id : f_manager.feature)
     {
-        auto & it_per_id = _it.second;
-        int imu_j = it_per_id.start_frame - 1;
         SFMFeature tmp_feature;
         tmp_feature.state = false;
         tmp_feature.id = it_per_id.feature_id;
-        for (auto &it_per_frame : it_per_id.feature_per_frame)
+        for (int imu_j = it_per_id.start_frame; imu_j <= it_per_id.endFrame(); imu_j++)
         {
-            imu_j++;
-            Vector3d pts_j = it_per_frame.point;
+            Vector3d pts_j = it_per_id.point(imu_j);
             tmp_feature.observation.push_back(make_pair(imu_j, Eigen::Vector2d{pts_j.x(), pts_j.y()}));
         }
         sfm_f.push_back(tmp_feature);
@@ -830,21 +845,19 @@ bool Estimator::initialStructure()
         frame_it->second.is_key_frame = false;
         vector<cv::Point3f> pts_3_vector;
         vector<cv::Point2f> pts_2_vector;
-        for (auto &id_pts : frame_it->second.points)
+        const FeatureFrame &points = *frame_it->second.points;
+        for (int i = 0; i < points.size(); i++)
         {
-            int feature_id = id_pts.first;
-            for (auto &i_p : id_pts.second)
+            int feature_id = points.ids[i];
+            it = sfm_tracked_points.find(feature_id);
+            if(it != sfm_tracked_points.end())
             {
-                it = sfm_tracked_points.find(feature_id);
-                if(it != sfm_tracked_points.end())
-                {
-                    Vector3d world_pts = it->second;
-                    cv::Point3f pts_3(world_pts(0), world_pts(1), world_pts(2));
-                    pts_3_vector.push_back(pts_3);
-                    Vector2d img_pts = i_p.second.head<2>();
-                    cv::Point2f pts_2(img_pts(0), img_pts(1));
-                    pts_2_vector.push_back(pts_2);
-                }
+                Vector3d world_pts = it->second;
+                cv::Point3f pts_3(world_pts(0), world_pts(1), world_pts(2));
+                pts_3_vector.push_back(pts_3);
+                Vector2d img_pts = points.points[i].head<2>();
+                cv::Point2f pts_2(img_pts(0), img_pts(1));
+                pts_2_vector.push_back(pts_2);
             }
         }
         cv::Mat K = (cv::Mat_<double>(3, 3) << 1, 0, 0, 0, 1, 0, 0, 0, 1);     
@@ -902,10 +915,7 @@ bool Estimator::visualInitialAlign()
     }
 
     double s = (x.tail<1>())(0);
-    for (int i = 0; i <= WINDOW_SIZE; i++)
-    {
-        pre_integrations[i]->repropagate(Vector3d::Zero(), Bgs[i]);
-    }
+    repropagateWindow(Vector3d::Zero(), Bgs);
     for (int i = frame_count; i >= 0; i--)
         Ps[i] = s * Ps[i] - Rs[i] * TIC[0] - (s * Ps[0] - Rs[0] * TIC[0]);
     int kv = -1;
@@ -1013,16 +1023,8 @@ void Estimator::vector2double()
     }
 
 
-    auto deps = f_manager.getDepthVector();
-    param_feature_id.clear();
-    ROS_INFO("Feature to solve num: %ld", deps.size());
-    for (auto & it : deps) {
-        // ROS_INFO("Feature %d invdepth %f feature index %d", it.first, it.second, param_feature_id.size());
-        para_Feature[param_feature_id.size()][0] = it.second;
-        param_feature_id_to_index[it.first] = param_feature_id.size();
-        param_feature_id.push_back(it.first);
-        
-    }
+    int solve_num = f_manager.getDepthVector();
+    ROS_INFO("Feature to solve num: %d", solve_num);
 
 
     para_Td[0][0] = td;
@@ -1106,14 +1108,7 @@ void Estimator::double2vector()
         }
     }
 
-    std::map<int, double> deps;
-    for (unsigned int i = 0; i < param_feature_id.size(); i++) {
-        int _id = param_feature_id[i];
-        // ROS_INFO("Id %d depth %f", i, 1/para_Feature[i][0]);
-        deps[_id] = para_Feature[i][0];
-    }
-
-    f_manager.setDepth(deps);
+    f_manager.setDepth();
 
     if(USE_IMU)
         td = para_Td[0][0];
@@ -1232,76 +1227,76 @@ void Estimator::optimization()
     int f_m_cnt = 0;
 
     // for (auto &_it : f_manager.feature)
-    for (int _id : param_feature_id){
-        auto & it_per_id = f_manager.feature[_id];
-        it_per_id.used_num = it_per_id.feature_per_frame.size();
+    for (auto &it_per_id : f_manager.feature){
+        if (it_per_id.param_index < 0)
+            continue;
+        it_per_id.used_num = it_per_id.obs_num;
  
-        int feature_index = param_feature_id_to_index[it_per_id.feature_id];
+        double *para_Feature = f_manager.feature.param(it_per_id);
 
-        int imu_i = it_per_id.start_frame, imu_j = imu_i - 1;
+        int imu_i = it_per_id.start_frame;
         
-        Vector3d pts_i = it_per_id.feature_per_frame[0].point;
+        Vector3d pts_i = it_per_id.point(imu_i);
 
         // ROS_INFO("Adding feature id %d initial depth", it_per_id.feature_id, it_);
-        for (auto &it_per_frame : it_per_id.feature_per_frame)
+        for (int imu_j = imu_i; imu_j <= it_per_id.endFrame(); imu_j++)
         {
-            imu_j++;
             if (imu_i != imu_j)
             {
-                Vector3d pts_j = it_per_frame.point;
-                ProjectionTwoFrameOneCamFactor *f_td = new ProjectionTwoFrameOneCamFactor(pts_i, pts_j, it_per_id.feature_per_frame[0].velocity, it_per_frame.velocity,
-                                                                it_per_id.feature_per_frame[0].cur_td, it_per_frame.cur_td);
+                Vector3d pts_j = it_per_id.point(imu_j);
+                ProjectionTwoFrameOneCamFactor *f_td = new ProjectionTwoFrameOneCamFactor(pts_i, pts_j, it_per_id.velocity(imu_i), it_per_id.velocity(imu_j),
+                                                                it_per_id.cur_td(imu_i), it_per_id.cur_td(imu_j));
                 // std::vector<double*> param_blocks;
                 // param_blocks.push_back(para_Pose[imu_i]);
                 // param_blocks.push_back(para_Pose[imu_j]);
                 // param_blocks.push_back(para_Ex_Pose[0]);
-                // param_blocks.push_back(para_Feature[feature_index]);
+                // param_blocks.push_back(para_Feature);
                 // param_blocks.push_back(para_Td[0]);
                 // ROS_INFO("Check ProjectionTwoFrameOneCamFactor");
                 // f_td->check(param_blocks.data());
                 // exit(-1);
-                problem.AddResidualBlock(f_td, loss_function, para_Pose[imu_i], para_Pose[imu_j], para_Ex_Pose[it_per_id.main_cam], para_Feature[feature_index], para_Td[0]);
+                problem.AddResidualBlock(f_td, loss_function, para_Pose[imu_i], para_Pose[imu_j], para_Ex_Pose[it_per_id.main_cam], para_Feature, para_Td[0]);
             }
 
-            if(STEREO && it_per_frame.is_stereo)
+            if(STEREO && it_per_id.is_stereo(imu_j))
             {    
                 //For stereo point; main cam must be 0 now
-                Vector3d pts_j_right = it_per_frame.pointRight;
+                Vector3d pts_j_right = it_per_id.pointRight(imu_j);
                 if(imu_i != imu_j)
                 {
-                    ProjectionTwoFrameTwoCamFactor *f = new ProjectionTwoFrameTwoCamFactor(pts_i, pts_j_right, it_per_id.feature_per_frame[0].velocity, it_per_frame.velocityRight,
-                                                                it_per_id.feature_per_frame[0].cur_td, it_per_frame.cur_td);
+                    ProjectionTwoFrameTwoCamFactor *f = new ProjectionTwoFrameTwoCamFactor(pts_i, pts_j_right, it_per_id.velocity(imu_i), it_per_id.velocityRight(imu_j),
+                                                                it_per_id.cur_td(imu_i), it_per_id.cur_td(imu_j));
 
                     // std::vector<double*> param_blocks;
                     // param_blocks.push_back(para_Pose[imu_i]);
                     // param_blocks.push_back(para_Pose[imu_j]);
                     // param_blocks.push_back(para_Ex_Pose[0]);
                     // param_blocks.push_back(para_Ex_Pose[1]);
-                    // param_blocks.push_back(para_Feature[feature_index]);             
+                    // param_blocks.push_back(para_Feature);             
                     // param_blocks.push_back(para_Td[0]);
                     // ROS_INFO("Check ProjectionTwoFrameTwoCamFactor");
                     // f->check(param_blocks.data());
-                    problem.AddResidualBlock(f, loss_function, para_Pose[imu_i], para_Pose[imu_j], para_Ex_Pose[0], para_Ex_Pose[1], para_Feature[feature_index], para_Td[0]);
+                    problem.AddResidualBlock(f, loss_function, para_Pose[imu_i], para_Pose[imu_j], para_Ex_Pose[0], para_Ex_Pose[1], para_Feature, para_Td[0]);
                 }
                 else
                 {
-                    ProjectionOneFrameTwoCamFactor *f = new ProjectionOneFrameTwoCamFactor(pts_i, pts_j_right, it_per_id.feature_per_frame[0].velocity, it_per_frame.velocityRight,
-                                                                it_per_id.feature_per_frame[0].cur_td, it_per_frame.cur_td);
+                    ProjectionOneFrameTwoCamFactor *f = new ProjectionOneFrameTwoCamFactor(pts_i, pts_j_right, it_per_id.velocity(imu_i), it_per_id.velocityRight(imu_j),
+                                                                it_per_id.cur_td(imu_i), it_per_id.cur_td(imu_j));
                     
                     std::vector<double*> param_blocks;
                     param_blocks.push_back(para_Ex_Pose[0]);
                     param_blocks.push_back(para_Ex_Pose[1]);
-                    param_blocks.push_back(para_Feature[feature_index]);
+                    param_blocks.push_back(para_Feature);
                     param_blocks.push_back(para_Td[0]);
-                    // ROS_INFO("Check ProjectionOneFrameTwoCamFactor ID: %d, index %d depth init %f Velocity L %f %f %f R %f %f %f", it_per_id.feature_id, feature_index, 
-                    //     para_Feature[feature_index][0],
-                    //     it_per_id.feature_per_frame[0].velocity.x(), it_per_id.feature_per_frame[0].velocity.y(), it_per_id.feature_per_frame[0].velocity.z(),
-                    //     it_per_frame.velocityRight.x(), it_per_frame.velocityRight.y(), it_per_frame.velocityRight.z()
+                    // ROS_INFO("Check ProjectionOneFrameTwoCamFactor ID: %d, index %d depth init %f Velocity L %f %f %f R %f %f %f", it_per_id.feature_id, it_per_id.param_index, 
+                    //     para_Feature[0],
+                    //     it_per_id.velocity(imu_i).x(), it_per_id.velocity(imu_i).y(), it_per_id.velocity(imu_i).z(),
+                    //     it_per_id.velocityRight(imu_j).x(), it_per_id.velocityRight(imu_j).y(), it_per_id.velocityRight(imu_j).z()
                     //     );
                     // f->check(param_blocks.data());
                     // exit(-1);
 
-                    problem.AddResidualBlock(f, loss_function, para_Ex_Pose[0], para_Ex_Pose[1], para_Feature[feature_index], para_Td[0]);
+                    problem.AddResidualBlock(f, loss_function, para_Ex_Pose[0], para_Ex_Pose[1], para_Feature, para_Td[0]);
                 }
             
             }
@@ -1383,48 +1378,48 @@ void Estimator::optimization()
             }
         }
 
-        for (int _id : param_feature_id) {
-            auto & it_per_id = f_manager.feature[_id];
+        for (auto &it_per_id : f_manager.feature) {
+            if (it_per_id.param_index < 0)
+                continue;
 
-            int feature_index = param_feature_id_to_index[it_per_id.feature_id];
+            double *para_Feature = f_manager.feature.param(it_per_id);
 
-            int imu_i = it_per_id.start_frame, imu_j = imu_i - 1;
+            int imu_i = it_per_id.start_frame;
             if (imu_i != 0)
                 continue;
 
-            Vector3d pts_i = it_per_id.feature_per_frame[0].point;
+            Vector3d pts_i = it_per_id.point(imu_i);
 
-            for (auto &it_per_frame : it_per_id.feature_per_frame)
+            for (int imu_j = imu_i; imu_j <= it_per_id.endFrame(); imu_j++)
             {
-                imu_j++;
                 if(imu_i != imu_j)
                 {
-                    Vector3d pts_j = it_per_frame.point;
-                    ProjectionTwoFrameOneCamFactor *f_td = new ProjectionTwoFrameOneCamFactor(pts_i, pts_j, it_per_id.feature_per_frame[0].velocity, it_per_frame.velocity,
-                                                                        it_per_id.feature_per_frame[0].cur_td, it_per_frame.cur_td);
+                    Vector3d pts_j = it_per_id.point(imu_j);
+                    ProjectionTwoFrameOneCamFactor *f_td = new ProjectionTwoFrameOneCamFactor(pts_i, pts_j, it_per_id.velocity(imu_i), it_per_id.velocity(imu_j),
+                                                                        it_per_id.cur_td(imu_i), it_per_id.cur_td(imu_j));
                     ResidualBlockInfo *residual_block_info = new ResidualBlockInfo(f_td, loss_function,
-                                                                                    vector<double *>{para_Pose[imu_i], para_Pose[imu_j], para_Ex_Pose[it_per_id.main_cam], para_Feature[feature_index], para_Td[0]},
+                                                                                    vector<double *>{para_Pose[imu_i], para_Pose[imu_j], para_Ex_Pose[it_per_id.main_cam], para_Feature, para_Td[0]},
                                                                                     vector<int>{0, 3});
                     marginalization_info->addResidualBlockInfo(residual_block_info);
                 }
-                if(STEREO && it_per_frame.is_stereo)
+                if(STEREO && it_per_id.is_stereo(imu_j))
                 {
-                    Vector3d pts_j_right = it_per_frame.pointRight;
+                    Vector3d pts_j_right = it_per_id.pointRight(imu_j);
                     if(imu_i != imu_j)
                     {
-                        ProjectionTwoFrameTwoCamFactor *f = new ProjectionTwoFrameTwoCamFactor(pts_i, pts_j_right, it_per_id.feature_per_frame[0].velocity, it_per_frame.velocityRight,
-                                                                        it_per_id.feature_per_frame[0].cur_td, it_per_frame.cur_td);
+                        ProjectionTwoFrameTwoCamFactor *f = new ProjectionTwoFrameTwoCamFactor(pts_i, pts_j_right, it_per_id.velocity(imu_i), it_per_id.velocityRight(imu_j),
+                                                                        it_per_id.cur_td(imu_i), it_per_id.cur_td(imu_j));
                         ResidualBlockInfo *residual_block_info = new ResidualBlockInfo(f, loss_function,
-                                                                                        vector<double *>{para_Pose[imu_i], para_Pose[imu_j], para_Ex_Pose[it_per_id.main_cam], para_Ex_Pose[1], para_Feature[feature_index], para_Td[0]},
+                                                                                        vector<double *>{para_Pose[imu_i], para_Pose[imu_j], para_Ex_Pose[it_per_id.main_cam], para_Ex_Pose[1], para_Feature, para_Td[0]},
                                                                                         vector<int>{0, 4});
                         marginalization_info->addResidualBlockInfo(residual_block_info);
                     }
                     else
                     {
-                        ProjectionOneFrameTwoCamFactor *f = new ProjectionOneFrameTwoCamFactor(pts_i, pts_j_right, it_per_id.feature_per_frame[0].velocity, it_per_frame.velocityRight,
-                                                                        it_per_id.feature_per_frame[0].cur_td, it_per_frame.cur_td);
+                        ProjectionOneFrameTwoCamFactor *f = new ProjectionOneFrameTwoCamFactor(pts_i, pts_j_right, it_per_id.velocity(imu_i), it_per_id.velocityRight(imu_j),
+                                                                        it_per_id.cur_td(imu_i), it_per_id.cur_td(imu_j));
                         ResidualBlockInfo *residual_block_info = new ResidualBlockInfo(f, loss_function,
-                                                                                        vector<double *>{para_Ex_Pose[0], para_Ex_Pose[1], para_Feature[feature_index], para_Td[0]},
+                                                                                        vector<double *>{para_Ex_Pose[0], para_Ex_Pose[1], para_Feature, para_Td[0]},
                                                                                         vector<int>{2});
                         marginalization_info->addResidualBlockInfo(residual_block_info);
                     }
@@ -1462,70 +1457,40 @@ void Estimator::optimization()
     }
     else
     {
-        if (last_marginalization_info &&
-            std::count(std::begin(last_marginalization_parameter_blocks), std::end(last_marginalization_parameter_blocks), para_Pose[WINDOW_SIZE - 1]))
+        auto it_second_new = std::find(last_marginalization_parameter_blocks.begin(), last_marginalization_parameter_blocks.end(), para_Pose[WINDOW_SIZE - 1]);
+        if (last_marginalization_info && it_second_new != last_marginalization_parameter_blocks.end())
         {
-
-            MarginalizationInfo *marginalization_info = new MarginalizationInfo();
+            // The second new frame only lives in the prior, no factors need to be re-evaluated:
+            // drop its pose from the linearized prior directly instead of building a new MarginalizationInfo.
             vector2double();
-            if (last_marginalization_info && last_marginalization_info->valid)
+            // Reference cost of the rebuild this replaces, only measured for the perf output
+            double rebuild_dt = ENABLE_PERF_OUTPUT && last_marginalization_info->valid ? timeSecondNewRebuild() : 0;
+            TicToc t_margin;
+            if (last_marginalization_info->valid)
             {
-                vector<int> drop_set;
-                for (int i = 0; i < static_cast<int>(last_marginalization_parameter_blocks.size()); i++)
-                {
-                    ROS_ASSERT(last_marginalization_parameter_blocks[i] != para_SpeedBias[WINDOW_SIZE - 1]);
-                    if (last_marginalization_parameter_blocks[i] == para_Pose[WINDOW_SIZE - 1])
-                        drop_set.push_back(i);
-                }
-                // construct new marginlization_factor
-                MarginalizationFactor *marginalization_factor = new MarginalizationFactor(last_marginalization_info);
-                ResidualBlockInfo *residual_block_info = new ResidualBlockInfo(marginalization_factor, NULL,
-                                                                               last_marginalization_parameter_blocks,
-                                                                               drop_set);
-
-                marginalization_info->addResidualBlockInfo(residual_block_info);
+                ROS_ASSERT(std::count(std::begin(last_marginalization_parameter_blocks), std::end(last_marginalization_parameter_blocks), para_SpeedBias[WINDOW_SIZE - 1]) == 0);
+                int drop_i = it_second_new - last_marginalization_parameter_blocks.begin();
+                last_marginalization_info->marginalizeKeepBlock(last_marginalization_parameter_blocks.data(), drop_i);
+                last_marginalization_parameter_blocks.erase(last_marginalization_parameter_blocks.begin() + drop_i);
             }
 
-            TicToc t_pre_margin;
-            // ROS_INFO("begin marginalization");
-            marginalization_info->preMarginalize();
-            ROS_INFO("end pre marginalization, %f ms", t_pre_margin.toc());
-
-            TicToc t_margin;
-            // ROS_INFO("begin marginalization");
-            marginalization_info->marginalize();
-            ROS_INFO("end marginalization, %f ms", t_margin.toc());
-            
-            std::unordered_map<long, double *> addr_shift;
-            for (int i = 0; i <= WINDOW_SIZE; i++)
+            for (auto & addr : last_marginalization_parameter_blocks)
             {
-                if (i == WINDOW_SIZE - 1)
-                    continue;
-                else if (i == WINDOW_SIZE)
-                {
-                    addr_shift[reinterpret_cast<long>(para_Pose[i])] = para_Pose[i - 1];
-                    if(USE_IMU)
-                        addr_shift[reinterpret_cast<long>(para_SpeedBias[i])] = para_SpeedBias[i - 1];
-                }
-                else
-                {
-                    addr_shift[reinterpret_cast<long>(para_Pose[i])] = para_Pose[i];
-                    if(USE_IMU)
-                        addr_shift[reinterpret_cast<long>(para_SpeedBias[i])] = para_SpeedBias[i];
-                }
+                if (addr == para_Pose[WINDOW_SIZE])
+                    addr = para_Pose[WINDOW_SIZE - 1];
+                else if (USE_IMU && addr == para_SpeedBias[WINDOW_SIZE])
+                    addr = para_SpeedBias[WINDOW_SIZE - 1];
             }
-            for (int i = 0; i < NUM_OF_CAM; i++)
-                addr_shift[reinterpret_cast<long>(para_Ex_Pose[i])] = para_Ex_Pose[i];
-
-            addr_shift[reinterpret_cast<long>(para_Td[0])] = para_Td[0];
 
-            
-            vector<double *> parameter_blocks = marginalization_info->getParameterBlocks(addr_shift);
-            if (last_marginalization_info)
-                delete last_marginalization_info;
-            last_marginalization_info = marginalization_info;
-            last_marginalization_parameter_blocks = parameter_blocks;
-            
+            static double sum_margin_new_saved = 0;
+            static int margin_new_count = 0;
+            double dt = t_margin.toc();
+            if(ENABLE_PERF_OUTPUT && rebuild_dt > 0) {
+                sum_margin_new_saved += rebuild_dt - dt;
+                margin_new_count ++;
+                ROS_INFO("second new marginalization %fms, rebuild %fms, saved %fms per non-keyframe AVG %fms",
+                    dt, rebuild_dt, rebuild_dt - dt, sum_margin_new_saved/margin_new_count);
+            }
         }
     }
     if(ENABLE_PERF_OUTPUT) {
@@ -1534,9 +1499,34 @@ void Estimator::optimization()
     //printf("whole time for ceres: %f \n", t_whole.toc());
 }
 
+// Builds the second new marginalization the way it was done before marginalizeKeepBlock, a new
+// MarginalizationInfo around the old prior, and returns its cost in ms. The result is thrown away.
+double Estimator::timeSecondNewRebuild()
+{
+    TicToc t_rebuild;
+    MarginalizationInfo *marginalization_info = new MarginalizationInfo();
+    vector<int> drop_set;
+    for (int i = 0; i < static_cast<int>(last_marginalization_parameter_blocks.size()); i++)
+    {
+        if (last_marginalization_parameter_blocks[i] == para_Pose[WINDOW_SIZE - 1])
+            drop_set.push_back(i);
+    }
+    MarginalizationFactor *marginalization_factor = new MarginalizationFactor(last_marginalization_info);
+    ResidualBlockInfo *residual_block_info = new ResidualBlockInfo(marginalization_factor, NULL,
+                                                                   last_marginalization_parameter_blocks,
+                                                                   drop_set);
+    marginalization_info->addResidualBlockInfo(residual_block_info);
+    marginalization_info->preMarginalize();
+    marginalization_info->marginalize();
+    double dt = t_rebuild.toc();
+    delete marginalization_info;
+    return dt;
+}
+
 void Estimator::slideWindow()
 {
     TicToc t_margin;
+    syncRepropagation();
     if (marginalization_flag == MARGIN_OLD)
     {
         double t_0 = Headers[0];
@@ -1629,6 +1619,52 @@ void Estimator::slideWindow()
     }
 }
 
+// Move the window preintegrations to new biases. Small bias changes are handled by a first order
+// correction; frames whose bias jump exceeds the thresholds are corrected the same way for now and
+// fully repropagated in background, in parallel. The results are swapped in by syncRepropagation().
+void Estimator::repropagateWindow(const Vector3d &ba, const Vector3d _Bgs[])
+{
+    syncRepropagation();
+    for (int i = 0; i <= WINDOW_SIZE; i++)
+    {
+        if (!pre_integrations[i])
+            continue;
+        if (!pre_integrations[i]->correctBias(ba, _Bgs[i]))
+            repropagate_jobs.push_back(make_pair(i, new IntegrationBase(*pre_integrations[i])));
+    }
+
+    if(ENABLE_PERF_OUTPUT) {
+        ROS_INFO("Bias updated, %ld of %d preintegrations to repropagate", repropagate_jobs.size(), WINDOW_SIZE + 1);
+    }
+
+    if (repropagate_jobs.empty())
+        return;
+
+    repropagateThread = std::thread([this]() {
+        #pragma omp parallel for
+        for (int k = 0; k < static_cast<int>(repropagate_jobs.size()); k++)
+        {
+            IntegrationBase * pre_integration = repropagate_jobs[k].second;
+            Vector3d ba = pre_integration->linearized_ba;
+            Vector3d bg = pre_integration->linearized_bg;
+            pre_integration->repropagate(ba, bg);
+        }
+    });
+}
+
+void Estimator::syncRepropagation()
+{
+    if (repropagateThread.joinable())
+        repropagateThread.join();
+
+    for (auto & job : repropagate_jobs)
+    {
+        delete pre_integrations[job.first];
+        pre_integrations[job.first] = job.second;
+    }
+    repropagate_jobs.clear();
+}
+
 void Estimator::slideWindowNew()
 {
     sum_of_front++;
@@ -1681,18 +1717,17 @@ void Estimator::predictPtsInNextFrame()
     nextT = curT * (prevT.inverse() * curT);
     map<int, Eigen::Vector3d> predictPts;
 
-    for (auto &_it : f_manager.feature)
+    for (auto &it_per_id : f_manager.feature)
     {
-        auto & it_per_id = _it.second;
         if(it_per_id.estimated_depth > 0)
         {
             int firstIndex = it_per_id.start_frame;
-            int lastIndex = it_per_id.start_frame + it_per_id.feature_per_frame.size() - 1;
+            int lastIndex = it_per_id.endFrame();
             //printf("cur frame index  %d last frame index %d\n", frame_count, lastIndex);
-            if((int)it_per_id.feature_per_frame.size() >= 2 && lastIndex == frame_count)
+            if(it_per_id.obs_num >= 2 && lastIndex == frame_count)
             {
                 double depth = it_per_id.estimated_depth;
-                Vector3d pts_j = ric[0] * (depth * it_per_id.feature_per_frame[0].point) + tic[0];
+                Vector3d pts_j = ric[0] * (depth * it_per_id.point(firstIndex)) + tic[0];
                 Vector3d pts_w = Rs[firstIndex] * pts_j + Ps[firstIndex];
                 Vector3d pts_local = nextT.block<3, 3>(0, 0).transpose() * (pts_w - nextT.block<3, 1>(0, 3));
                 Vector3d pts_cam = ric[0].transpose() * (pts_local - tic[0]);
@@ -1705,156 +1740,162 @@ void Estimator::predictPtsInNextFrame()
     //printf("estimator output %d predict pts\n",(int)predictPts.size());
 }
 
-double Estimator::reprojectionError(Matrix3d &Ri, Vector3d &Pi, Matrix3d &rici, Vector3d &tici,
-                                 Matrix3d &Rj, Vector3d &Pj, Matrix3d &ricj, Vector3d &ticj, 
-                                 double depth, Vector3d &uvi, Vector3d &uvj)
+// Reprojection residual of every observation of the solved landmarks: the landmark is placed at its
+// depth along the first observation, moved into the observing camera and compared with the observation,
+// on the unit sphere for fisheye and on the normalized image plane otherwise.
+// Window camera poses are computed once and kept as structure-of-arrays over frames, so the
+// residuals of one landmark are evaluated in a single loop the compiler vectorizes.
+void Estimator::outliersRejection(set<int> &removeIndex, ResidualHistogram &residual_hist)
 {
-    Vector3d pts_w = Ri * (rici * (depth * uvi) + tici) + Pi;
-    Vector3d pts_cj = ricj.transpose() * (Rj.transpose() * (pts_w - Pj) - ticj);
-
-    if (FISHEYE) {
-        //In Fisheye we use 3d unit sphere to represent point position
-        return (pts_cj.normalized() - uvj).norm();
-    } else {
-        Vector2d residual = (pts_cj / pts_cj.z()).head<2>() - uvj.head<2>();
-        double rx = residual.x();
-        double ry = residual.y();
-        return sqrt(rx * rx + ry * ry);
+    // cam_R[c][k][i]: element k (row major) of the camera c to world rotation of frame i, cam_t the camera center
+    double cam_R[2][9][WINDOW_SIZE + 1];
+    double cam_t[2][3][WINDOW_SIZE + 1];
+    for (int i = 0; i <= frame_count; i++)
+    {
+        for (int c = 0; c < NUM_OF_CAM; c++)
+        {
+            Matrix3d R = Rs[i] * ric[c];
+            Vector3d t = Rs[i] * tic[c] + Ps[i];
+            for (int k = 0; k < 9; k++)
+                cam_R[c][k][i] = R(k / 3, k % 3);
+            for (int k = 0; k < 3; k++)
+                cam_t[c][k][i] = t(k);
+        }
     }
 
-    return 100000;
-}
+    int num = f_manager.feature.size();
+    vector<char> is_outlier(num, 0);
+    residual_hist.clear();
 
-void Estimator::outliersRejection(set<int> &removeIndex)
-{
-    for (int _id : param_feature_id) {
-        auto & it_per_id = f_manager.feature[_id];
-        double err = 0;
-        int errCnt = 0;
-        it_per_id.used_num = it_per_id.feature_per_frame.size();
-
-        int imu_i = it_per_id.start_frame, imu_j = imu_i - 1;
-        Vector3d pts_i = it_per_id.feature_per_frame[0].point;
-        double depth = it_per_id.estimated_depth;
-
-        // Vector3d pts_w = Rs[imu_i] * (ric[it_per_id.main_cam] * (depth * pts_i) + tic[it_per_id.main_cam]) + Ps[imu_i];
-        // ROS_INFO("PT %d, STEREO %d w %f %f %f drone %f %f %f ptun %f %f %f, depth %f", 
-        //     it_per_id.feature_id,
-        //     it_per_id.feature_per_frame.front().is_stereo, 
-        //     pts_w.x(), pts_w.y(), pts_w.z(),
-        //     Ps[imu_i].x(), Ps[imu_i].y(), Ps[imu_i].z(),
-        //     pts_i.x(), pts_i.y(), pts_i.z(),
-        //     depth
-        // );
-
-        for (auto &it_per_frame : it_per_id.feature_per_frame)
+#pragma omp parallel
+    {
+        ResidualHistogram hist;
+        hist.clear();
+
+#pragma omp for schedule(dynamic, 32)
+        for (int n = 0; n < num; n++)
         {
-            imu_j++;
-                
-            if (imu_i != imu_j)
+            auto & it_per_id = f_manager.feature[n];
+            if (it_per_id.param_index < 0)
+                continue;
+            it_per_id.used_num = it_per_id.obs_num;
+            int imu_i = it_per_id.start_frame;
+            int frame_num = it_per_id.obs_num;
+            int main_cam = it_per_id.main_cam;
+
+            // World point anchored in main_cam for the left residuals and in cam 0 for the right ones
+            Vector3d pts_i = it_per_id.point(imu_i) * it_per_id.estimated_depth;
+            double pw[2][3];
+            for (int side = 0; side < 2; side++)
             {
-                Vector3d pts_j = it_per_frame.point;     
-                double tmp_error = reprojectionError(Rs[imu_i], Ps[imu_i], ric[it_per_id.main_cam], tic[it_per_id.main_cam], 
-                                                    Rs[imu_j], Ps[imu_j], ric[it_per_id.main_cam], tic[it_per_id.main_cam],
-                                                    depth, pts_i, pts_j);
-                err += tmp_error;
-                errCnt++;
-                //printf("tmp_error %f\n", FOCAL_LENGTH / 1.5 * tmp_error);
+                int a = side == 0 ? main_cam : 0;
+                for (int k = 0; k < 3; k++)
+                    pw[side][k] = cam_R[a][3 * k][imu_i] * pts_i.x() + cam_R[a][3 * k + 1][imu_i] * pts_i.y()
+                                  + cam_R[a][3 * k + 2][imu_i] * pts_i.z() + cam_t[a][k][imu_i];
             }
-            // need to rewrite projecton factor.........
-            if(STEREO && it_per_frame.is_stereo)
+
+            // Observations in frame order; right camera observations are masked by is_stereo
+            double ux[2][FEATURE_OBS_CAP], uy[2][FEATURE_OBS_CAP], uz[2][FEATURE_OBS_CAP];
+            double mask[2][FEATURE_OBS_CAP];
+            double err[2][FEATURE_OBS_CAP];
+            for (int j = 0; j < frame_num; j++)
             {
-                
-                Vector3d pts_j_right = it_per_frame.pointRight;
-                if(imu_i != imu_j)
-                {            
-                    double tmp_error = reprojectionError(Rs[imu_i], Ps[imu_i], ric[0], tic[0], 
-                                                        Rs[imu_j], Ps[imu_j], ric[1], tic[1],
-                                                        depth, pts_i, pts_j_right);
-                    err += tmp_error;
-                    errCnt++;
-                    //printf("tmp_error %f\n", FOCAL_LENGTH / 1.5 * tmp_error);
+                int imu_j = imu_i + j;
+                const Vector3d &pt = it_per_id.point(imu_j);
+                ux[0][j] = pt.x(); uy[0][j] = pt.y(); uz[0][j] = pt.z();
+                mask[0][j] = j > 0;
+                bool stereo = STEREO && it_per_id.is_stereo(imu_j);
+                const Vector3d &pt_r = it_per_id.pointRight(imu_j);
+                ux[1][j] = stereo ? pt_r.x() : 0; uy[1][j] = stereo ? pt_r.y() : 0; uz[1][j] = stereo ? pt_r.z() : 1;
+                mask[1][j] = stereo;
+            }
+
+            double err_sum = 0, err_cnt = 0;
+            for (int side = 0; side < 2; side++)
+            {
+                // For stereo point; main cam must be 0 now
+                int c = side == 0 ? main_cam : 1;
+                if (c >= NUM_OF_CAM)
+                    continue;
+                const double *R0 = cam_R[c][0] + imu_i, *R1 = cam_R[c][1] + imu_i, *R2 = cam_R[c][2] + imu_i;
+                const double *R3 = cam_R[c][3] + imu_i, *R4 = cam_R[c][4] + imu_i, *R5 = cam_R[c][5] + imu_i;
+                const double *R6 = cam_R[c][6] + imu_i, *R7 = cam_R[c][7] + imu_i, *R8 = cam_R[c][8] + imu_i;
+                const double *tx = cam_t[c][0] + imu_i, *ty = cam_t[c][1] + imu_i, *tz = cam_t[c][2] + imu_i;
+                const double px0 = pw[side][0], py0 = pw[side][1], pz0 = pw[side][2];
+                const double *ox = ux[side], *oy = uy[side], *oz = uz[side], *m = mask[side];
+                double *e = err[side];
+                if (FISHEYE)
+                {
+                    //In Fisheye we use 3d unit sphere to represent point position
+#pragma omp simd reduction(+:err_sum, err_cnt)
+                    for (int j = 0; j < frame_num; j++)
+                    {
+                        double dx = px0 - tx[j], dy = py0 - ty[j], dz = pz0 - tz[j];
+                        double px = R0[j] * dx + R3[j] * dy + R6[j] * dz;
+                        double py = R1[j] * dx + R4[j] * dy + R7[j] * dz;
+                        double pz = R2[j] * dx + R5[j] * dy + R8[j] * dz;
+                        double inv_n = 1.0 / sqrt(px * px + py * py + pz * pz);
+                        double rx = px * inv_n - ox[j], ry = py * inv_n - oy[j], rz = pz * inv_n - oz[j];
+                        e[j] = m[j] > 0 ? sqrt(rx * rx + ry * ry + rz * rz) : 0;
+                        err_sum += e[j];
+                        err_cnt += m[j];
+                    }
                 }
                 else
                 {
-                    double tmp_error = reprojectionError(Rs[imu_i], Ps[imu_i], ric[0], tic[0], 
-                                                        Rs[imu_j], Ps[imu_j], ric[1], tic[1],
-                                                        depth, pts_i, pts_j_right);
-                    err += tmp_error;
-                    errCnt++;
-                    //printf("tmp_error %f\n", FOCAL_LENGTH / 1.5 * tmp_error);
-                }       
+#pragma omp simd reduction(+:err_sum, err_cnt)
+                    for (int j = 0; j < frame_num; j++)
+                    {
+                        double dx = px0 - tx[j], dy = py0 - ty[j], dz = pz0 - tz[j];
+                        double px = R0[j] * dx + R3[j] * dy + R6[j] * dz;
+                        double py = R1[j] * dx + R4[j] * dy + R7[j] * dz;
+                        double pz = R2[j] * dx + R5[j] * dy + R8[j] * dz;
+                        double rx = px / pz - ox[j], ry = py / pz - oy[j];
+                        e[j] = m[j] > 0 ? sqrt(rx * rx + ry * ry) : 0;
+                        err_sum += e[j];
+                        err_cnt += m[j];
+                    }
+                }
+                for (int j = 0; j < frame_num; j++)
+                {
+                    if (m[j] > 0)
+                        hist.add(c, e[j] * FOCAL_LENGTH);
+                }
             }
-        }
-        double ave_err = err / errCnt;
-        if(ave_err * FOCAL_LENGTH > THRES_OUTLIER) {
-            // ROS_INFO("Removing feature %d on cam %d...  error %f", it_per_id.feature_id, it_per_id.main_cam, ave_err * FOCAL_LENGTH);
-            removeIndex.insert(it_per_id.feature_id);
-        }
-
 
-    }
-}
+            double ave_err = err_sum / err_cnt;
+            if(ave_err * FOCAL_LENGTH > THRES_OUTLIER) {
+                // ROS_INFO("Removing feature %d on cam %d...  error %f", it_per_id.feature_id, it_per_id.main_cam, ave_err * FOCAL_LENGTH);
+                is_outlier[n] = 1;
+            }
+        }
 
-void Estimator::fastPredictIMU(double t, Eigen::Vector3d linear_acceleration, Eigen::Vector3d angular_velocity)
-{
-    // ROS_INFO
-    if (latest_time < 10) {
-        return;
+#pragma omp critical
+        residual_hist.merge(hist);
     }
 
-    double dt = t - latest_time;
-    if (dt > 0.03) {
-        ROS_ERROR("DT %4.2fms t %f lt %f", dt*1000, (t-base)*1000, (latest_time-base)*1000);
-        // exit(-1);
+    for (int n = 0; n < num; n++)
+    {
+        if (is_outlier[n])
+            removeIndex.insert(f_manager.feature[n].feature_id);
     }
-
-    latest_time = t;
-    
-    // ROS_INFO("fastpredic t %f %d", (t-base)*1000, flg);
-
-    Eigen::Vector3d un_acc_0 = latest_Q * (latest_acc_0 - latest_Ba) - g;
-    Eigen::Vector3d un_gyr = 0.5 * (latest_gyr_0 + angular_velocity) - latest_Bg;
-    latest_Q = latest_Q * Utility::deltaQ(un_gyr * dt);
-    Eigen::Vector3d un_acc_1 = latest_Q * (linear_acceleration - latest_Ba) - g;
-    Eigen::Vector3d un_acc = 0.5 * (un_acc_0 + un_acc_1);
-    latest_P = latest_P + dt * latest_V + 0.5 * dt * dt * un_acc;
-    latest_V = latest_V + dt * un_acc;
-    latest_acc_0 = linear_acceleration;
-    latest_gyr_0 = angular_velocity;
 }
 
+// Hand the newest window state to the IMU propagator, it replays the IMU samples after it on its own thread
 void Estimator::updateLatestStates()
 {
-    mBuf.lock();
-
-    latest_time = Headers[frame_count] + td;
-    latest_P = Ps[frame_count];
-    // std::cout << "Ps[frame_count] is " << Ps[frame_count].transpose();
-    latest_Q = Rs[frame_count];
-    latest_V = Vs[frame_count];
-    latest_Ba = Bas[frame_count];
-    latest_Bg = Bgs[frame_count];
-    fast_prop_inited = true;
-    latest_acc_0 = acc_0;
-    latest_gyr_0 = gyr_0;
-    queue<pair<double, Eigen::Vector3d>> tmp_accBuf = accBuf;
-    queue<pair<double, Eigen::Vector3d>> tmp_gyrBuf = gyrBuf;
-    while(!tmp_accBuf.empty())
-    {
-        double t = tmp_accBuf.front().first;
-        Eigen::Vector3d acc = tmp_accBuf.front().second;
-        Eigen::Vector3d gyr = tmp_gyrBuf.front().second;
-        double dt = t - latest_time;
-        if (dt > 0.03) {
-            ROS_ERROR("DTRE %4.2fms", dt*1000);
-            // exit(-1);
-        }
-        
-        
-        fastPredictIMU(t, acc, gyr);
-        tmp_accBuf.pop();
-        tmp_gyrBuf.pop();
-    }
-    mBuf.unlock();
+    IMUPropagatorState state;
+    state.t = Headers[frame_count] + td;
+    state.P = Ps[frame_count];
+    state.Q = Rs[frame_count];
+    state.V = Vs[frame_count];
+    state.Ba = Bas[frame_count];
+    state.Bg = Bgs[frame_count];
+    state.acc_0 = acc_0;
+    state.gyr_0 = gyr_0;
+    state.g = g;
+    imu_propagator.correct(state);
+
+    featureTracker.gyro_predictor.setExtrinsic(ric);
+    featureTracker.gyro_predictor.setState(Bgs[frame_count], td);
 }
@@ -22,6 +22,7 @@
 
 #include "parameters.h"
 #include "feature_manager.h"
+#include "imu_propagator.h"
 #include "../utility/utility.h"
 #include "../utility/tic_toc.h"
 #include "../initial/solve_5pts.h"
@@ -40,6 +41,33 @@
 
 class DepthCamManager;
 
+#define RESIDUAL_HIST_BINS 20
+#define RESIDUAL_HIST_BIN_SIZE 0.5 // pixel at FOCAL_LENGTH; the last bin also counts everything above
+
+// Reprojection residuals of the solved landmark observations, per camera
+struct ResidualHistogram
+{
+    int count[2][RESIDUAL_HIST_BINS];
+
+    void clear()
+    {
+        memset(count, 0, sizeof(count));
+    }
+    void add(int cam, double err_px)
+    {
+        if (!(err_px >= 0))
+            return;
+        int bin = std::min((int)(err_px / RESIDUAL_HIST_BIN_SIZE), RESIDUAL_HIST_BINS - 1);
+        count[cam][bin]++;
+    }
+    void merge(const ResidualHistogram &hist)
+    {
+        for (int c = 0; c < 2; c++)
+            for (int i = 0; i < RESIDUAL_HIST_BINS; i++)
+                count[c][i] += hist.count[c][i];
+    }
+};
+
 
 class Estimator
 {
@@ -51,7 +79,8 @@ class Estimator
     // interface
     void initFirstPose(Eigen::Vector3d p, Eigen::Matrix3d r);
     void inputIMU(double t, const Vector3d &linearAcceleration, const Vector3d &angularVelocity);
-    void inputFeature(double t, const FeatureFrame &featureFrame);
+    void inputIMUBatch(const IMUSample * samples, int num);
+    void inputFeature(double t, const FeatureFramePtr &featureFrame);
     void inputImage(double t, const cv::Mat &_img, const cv::Mat &_img1 = cv::Mat(), 
         const CvImages & up_imgs = CvImages(0), 
         const CvImages & down_imgs = CvImages(0));
@@ -60,7 +89,7 @@ class Estimator
     void inputFisheyeImage(double t, const CvCudaImages & up_imgs, const CvCudaImages & down_imgs, bool is_blank_init = false);
 
     void processIMU(double t, double dt, const Vector3d &linear_acceleration, const Vector3d &angular_velocity);
-    void processImage(const FeatureFrame &image, const double header);
+    void processImage(const FeatureFramePtr &image, const double header);
     void processMeasurements();
 
     void processDepthGeneration();
@@ -74,6 +103,7 @@ class Estimator
     void slideWindowNew();
     void slideWindowOld();
     void optimization();
+    double timeSecondNewRebuild();
     void vector2double();
     void double2vector();
     bool failureDetection();
@@ -82,12 +112,10 @@ class Estimator
     void getPoseInWorldFrame(Eigen::Matrix4d &T);
     void getPoseInWorldFrame(int index, Eigen::Matrix4d &T);
     void predictPtsInNextFrame();
-    void outliersRejection(set<int> &removeIndex);
-    double reprojectionError(Matrix3d &Ri, Vector3d &Pi, Matrix3d &rici, Vector3d &tici,
-                                     Matrix3d &Rj, Vector3d &Pj, Matrix3d &ricj, Vector3d &ticj, 
-                                     double depth, Vector3d &uvi, Vector3d &uvj);
+    void outliersRejection(set<int> &removeIndex, ResidualHistogram &residual_hist);
+    void repropagateWindow(const Vector3d &ba, const Vector3d _Bgs[]);
+    void syncRepropagation();
     void updateLatestStates();
-    void fastPredictIMU(double t, Eigen::Vector3d linear_acceleration, Eigen::Vector3d angular_velocity);
     bool IMUAvailable(double t);
     void initFirstIMUPose(vector<pair<double, Eigen::Vector3d>> &accVector);
 
@@ -107,7 +135,7 @@ class Estimator
     std::mutex odomBuf;
     queue<pair<double, Eigen::Vector3d>> accBuf;
     queue<pair<double, Eigen::Vector3d>> gyrBuf;
-    queue<pair<double,FeatureFrame >> featureBuf;
+    queue<pair<double, FeatureFramePtr>> featureBuf;
     double prevTime, curTime;
     bool openExEstimation;
 
@@ -136,6 +164,8 @@ class Estimator
     double Headers[(WINDOW_SIZE + 1)];
 
     IntegrationBase *pre_integrations[(WINDOW_SIZE + 1)];
+    std::thread repropagateThread;
+    vector<pair<int, IntegrationBase *>> repropagate_jobs;
     Vector3d acc_0, gyr_0;
 
     vector<double> dt_buf[(WINDOW_SIZE + 1)];
@@ -164,9 +194,6 @@ class Estimator
 
     double para_Pose[WINDOW_SIZE + 1][SIZE_POSE];
     double para_SpeedBias[WINDOW_SIZE + 1][SIZE_SPEEDBIAS];
-    double para_Feature[NUM_OF_F][SIZE_FEATURE];
-    std::vector<int> param_feature_id;
-    std::map<int, int> param_feature_id_to_index;
     double para_Ex_Pose[2][SIZE_POSE];
     double para_Retrive_Pose[SIZE_POSE];
     double para_Td[1][1];
@@ -183,10 +210,7 @@ class Estimator
     Eigen::Vector3d initP;
     Eigen::Matrix3d initR;
 
-    double latest_time;
-    Eigen::Vector3d latest_P, latest_V, latest_Ba, latest_Bg, latest_acc_0, latest_gyr_0;
-    Eigen::Quaterniond latest_Q;
-    bool fast_prop_inited;
+    IMUPropagator imu_propagator;
 
     bool initFirstPoseFlag;
 
@@ -10,16 +10,13 @@
 #include "feature_manager.h"
 
 // #define DEBUG_DISABLE_RETRIANGULATE
-int FeaturePerId::endFrame()
-{
-    return start_frame + feature_per_frame.size() - 1;
-}
 
 FeatureManager::FeatureManager(Matrix3d _Rs[])
     : Rs(_Rs)
 {
     for (int i = 0; i < NUM_OF_CAM; i++)
         ric[i].setIdentity();
+    clearState();
 }
 
 void FeatureManager::setRic(Matrix3d _ric[])
@@ -33,15 +30,23 @@ void FeatureManager::setRic(Matrix3d _ric[])
 void FeatureManager::clearState()
 {
     feature.clear();
+    for (int i = 0; i < FEATURE_OBS_CAP; i++)
+    {
+        tri_frame_abs[i] = -1;
+        tri_epoch[i] = 0;
+    }
+    tri_epoch_cnt = 0;
+    newest_abs = -1;
+    newest_parallax_sum = 0;
+    newest_parallax_num = 0;
 }
 
 int FeatureManager::getFeatureCount()
 {
     int cnt = 0;
-    for (auto &_it : feature)
+    for (auto &it : feature)
     {
-        auto & it = _it.second;
-        it.used_num = it.feature_per_frame.size();
+        it.used_num = it.obs_num;
         if (it.used_num >= 4 && it.good_for_solving)
         {
             cnt++;
@@ -55,48 +60,63 @@ bool FeatureManager::addFeatureCheckParallax(int frame_count, const FeatureFrame
 {
     ROS_DEBUG("input feature: %d", (int)image.size());
     ROS_DEBUG("num of feature: %d", getFeatureCount());
-    double parallax_sum = 0;
-    int parallax_num = 0;
+    // Landmarks observed in frame_count - 2 and frame_count - 1
+    double parallax_sum = newest_parallax_sum;
+    int parallax_num = newest_parallax_num;
+    newest_abs = feature.frame_base + frame_count;
+    newest_parallax_sum = 0;
+    newest_parallax_num = 0;
     last_track_num = 0;
     last_average_parallax = 0;
     new_feature_num = 0;
     long_track_num = 0;
-    for (auto &id_pts : image)
+    int num = image.size();
+    for (int i = 0; i < num; )
     {
-        FeaturePerFrame f_per_fra(id_pts.second[0].second, td);
+        // Observations [i, next) belong to one feature
+        int feature_id = image.ids[i];
+        int next = i + 1;
+        while (next < num && image.ids[next] == feature_id)
+            next++;
+        int obs_i = i, obs_cnt = next - i;
+        i = next;
+
+        FeaturePerFrame f_per_fra(image, obs_i, td);
         //In common stereo; the pts in left must in right
         //But for stereo fisheye; this is not true due to the downward top view
         //We need to modified this to enable downward top view
-        // assert(id_pts.second[0].first == 0);
-        if (id_pts.second[0].first != 0) {
+        // assert(image.cameras[obs_i] == 0);
+        if (image.cameras[obs_i] != 0) {
             //This point is right/down observation only
             f_per_fra.camera = 1;
         }
         
-        if(id_pts.second.size() == 2)
+        if(obs_cnt == 2)
         {
-            // ROS_INFO("Stereo feature %d", id_pts.first);
-            f_per_fra.rightObservation(id_pts.second[1].second);
-            // assert(id_pts.second[1].first == 1);
-            if (id_pts.second[1].first != 1) {
+            // ROS_INFO("Stereo feature %d", feature_id);
+            f_per_fra.rightObservation(image, obs_i + 1);
+            // assert(image.cameras[obs_i + 1] == 1);
+            if (image.cameras[obs_i + 1] != 1) {
                 ROS_WARN("Bug occurs on pt, skip");
                 continue;
             }
         }
 
-        int feature_id = id_pts.first;
-
-        if (feature.find(feature_id) == feature.end()) {
+        FeaturePerId * it = feature.find(feature_id);
+        if (it == nullptr) {
             //Insert
-            FeaturePerId fre(feature_id, frame_count);
+            FeaturePerId & fre = feature.insert(feature_id, frame_count);
             fre.main_cam = f_per_fra.camera;
-            feature.emplace(feature_id, fre);
-            feature[feature_id].feature_per_frame.push_back(f_per_fra);
+            fre.addObservation(f_per_fra);
             new_feature_num++;
         } else {
-            feature[feature_id].feature_per_frame.push_back(f_per_fra);
+            if (it->addObservation(f_per_fra) && inNewestPair(*it)) {
+                it->parallax = compensatedParallax2(*it, frame_count + 1);
+                newest_parallax_sum += it->parallax;
+                newest_parallax_num++;
+            }
             last_track_num++;
-            if( feature[feature_id].feature_per_frame.size() >= 4)
+            if( it->obs_num >= 4)
                 long_track_num++;
         }  
     }
@@ -106,17 +126,6 @@ bool FeatureManager::addFeatureCheckParallax(int frame_count, const FeatureFrame
         return true;
     }
 
-    for (auto &_it : feature)
-    {
-        auto & it_per_id = _it.second;
-        if (it_per_id.start_frame <= frame_count - 2 &&
-            it_per_id.start_frame + int(it_per_id.feature_per_frame.size()) - 1 >= frame_count - 1)
-        {
-            parallax_sum += compensatedParallax2(it_per_id, frame_count);
-            parallax_num++;
-        }
-    }
-
     if (parallax_num == 0)
     {
         ROS_INFO("Add KF: Parallax num ==0");
@@ -138,18 +147,15 @@ bool FeatureManager::addFeatureCheckParallax(int frame_count, const FeatureFrame
 vector<pair<Vector3d, Vector3d>> FeatureManager::getCorresponding(int frame_count_l, int frame_count_r)
 {
     vector<pair<Vector3d, Vector3d>> corres;
-    for (auto &_it : feature)
+    for (auto &it : feature)
     {
-        auto & it = _it.second;
         if (it.start_frame <= frame_count_l && it.endFrame() >= frame_count_r)
         {
             Vector3d a = Vector3d::Zero(), b = Vector3d::Zero();
-            int idx_l = frame_count_l - it.start_frame;
-            int idx_r = frame_count_r - it.start_frame;
 
-            a = it.feature_per_frame[idx_l].point;
+            a = it.point(frame_count_l);
 
-            b = it.feature_per_frame[idx_r].point;
+            b = it.point(frame_count_r);
             
             corres.push_back(make_pair(a, b));
         }
@@ -157,15 +163,16 @@ vector<pair<Vector3d, Vector3d>> FeatureManager::getCorresponding(int frame_coun
     return corres;
 }
 
-void FeatureManager::setDepth(std::map<int, double> deps)
+// Reads the solved inverse depths back from the landmark parameter block
+void FeatureManager::setDepth()
 {
-    for (auto &it : deps)
+    for (auto &it_per_id : feature)
     {
-        int _id = it.first;
-        double depth = it.second;
-        auto & it_per_id = feature[_id];
+        if (it_per_id.param_index < 0)
+            continue;
+        double depth = feature.param(it_per_id)[0];
 
-        it_per_id.used_num = it_per_id.feature_per_frame.size();
+        it_per_id.used_num = it_per_id.obs_num;
 
         it_per_id.estimated_depth = 1.0 / depth;
         it_per_id.need_triangulation = false;
@@ -180,44 +187,52 @@ void FeatureManager::setDepth(std::map<int, double> deps)
         else {
             it_per_id.solve_flag = 1;
         }
+        ft->setFeatureStatus(it_per_id.feature_id, it_per_id.solve_flag == 1 ? 3 : 2);
     }
 }
 
+// Landmarks of the last solve that came out of it with a valid depth
+int FeatureManager::getSolvedCount()
+{
+    int num = 0;
+    for (auto &it_per_id : feature)
+        if (it_per_id.param_index >= 0 && it_per_id.solve_flag == 1)
+            num++;
+    return num;
+}
+
 void FeatureManager::removeFailures()
 {
-    for (auto it = feature.begin(), it_next = feature.begin();
-         it != feature.end(); it = it_next)
-    {
-        auto & _it = it->second;
-        it_next++;
-        if (_it.solve_flag == 2)
-            feature.erase(it);
-    }
+    feature.removeIf([&](const FeaturePerId &it) {
+        if (it.solve_flag != 2)
+            return false;
+        removeNewestPair(it);
+        return true;
+    });
 }
 
 void FeatureManager::clearDepth()
 {
-    for (auto &_it : feature) {
-        auto & it_per_id = _it.second;
+    for (auto &it_per_id : feature) {
         it_per_id.estimated_depth = -1;
         it_per_id.depth_inited = false;
         it_per_id.good_for_solving = false;
+        it_per_id.dlt_solved = false;
     }
 }
 
-std::map<int, double> FeatureManager::getDepthVector()
+int FeatureManager::getDepthVector()
 {
     //This function gives actually points for solving; We only use oldest max_solve_cnt point, oldest pts has good track
     //As for some feature point not solve all the time; we do re triangulate on it
-    std::map<int, double> dep_vec;
-    for (auto &_it : feature) {
-        auto & it_per_id = _it.second;
-        it_per_id.used_num = it_per_id.feature_per_frame.size();
+    //Inverse depths of the selected points go to the parameter block of the landmark store
+    feature.clearParams();
+    for (auto &it_per_id : feature) {
+        it_per_id.used_num = it_per_id.obs_num;
         bool id_in_outouliers = outlier_features.find(it_per_id.feature_id) != outlier_features.end();
-        if(dep_vec.size() < MAX_SOLVE_CNT && it_per_id.used_num >= 4 
+        if(feature.paramNum() < MAX_SOLVE_CNT && it_per_id.used_num >= 4 
             && it_per_id.good_for_solving && !id_in_outouliers) {
-            dep_vec[it_per_id.feature_id] = 1. / it_per_id.estimated_depth;
-            ft->setFeatureStatus(it_per_id.feature_id, 3);
+            feature.addParam(it_per_id, 1. / it_per_id.estimated_depth);
         } else {
             //Clear depth; wait for re triangulate
 #ifndef DEBUG_DISABLE_RETRIANGULATE
@@ -225,7 +240,7 @@ std::map<int, double> FeatureManager::getDepthVector()
 #endif
         }
     }
-    return dep_vec;
+    return feature.paramNum();
 }
 
 
@@ -301,75 +316,21 @@ double FeatureManager::triangulatePoint3DPts(vector<Eigen::Matrix<double, 3, 4>>
 
 
 
-bool FeatureManager::solvePoseByPnP(Eigen::Matrix3d &R, Eigen::Vector3d &P, 
-                                      vector<cv::Point2f> &pts2D, vector<cv::Point3f> &pts3D)
-{
-    Eigen::Matrix3d R_initial;
-    Eigen::Vector3d P_initial;
-
-    // w_T_cam ---> cam_T_w 
-    R_initial = R.inverse();
-    P_initial = -(R_initial * P);
-
-    //printf("pnp size %d \n",(int)pts2D.size() );
-    if (int(pts2D.size()) < 4)
-    {
-        printf("feature tracking not enough, please slowly move you device! \n");
-        return false;
-    }
-    cv::Mat r, rvec, t, D, tmp_r;
-    cv::eigen2cv(R_initial, tmp_r);
-    cv::Rodrigues(tmp_r, rvec);
-    cv::eigen2cv(P_initial, t);
-    cv::Mat K = (cv::Mat_<double>(3, 3) << 1, 0, 0, 0, 1, 0, 0, 0, 1);  
-    bool pnp_succ;
-    pnp_succ = cv::solvePnP(pts3D, pts2D, K, D, rvec, t, 1);
-    //pnp_succ = solvePnPRansac(pts3D, pts2D, K, D, rvec, t, true, 100, 8.0 / focalLength, 0.99, inliers);
-
-    if(!pnp_succ)
-    {
-        printf("pnp failed ! \n");
-        return false;
-    }
-    cv::Rodrigues(rvec, r);
-    //cout << "r " << endl << r << endl;
-    Eigen::MatrixXd R_pnp;
-    cv::cv2eigen(r, R_pnp);
-    Eigen::MatrixXd T_pnp;
-    cv::cv2eigen(t, T_pnp);
-
-    // cam_T_w ---> w_T_cam
-    R = R_pnp.transpose();
-    P = R * (-T_pnp);
-
-    return true;
-}
-
 void FeatureManager::initFramePoseByPnP(int frameCnt, Vector3d Ps[], Matrix3d Rs[], Vector3d tic[], Matrix3d ric[])
 {
 
     if(frameCnt > 0)
     {
-        vector<cv::Point2f> pts2D;
-        vector<cv::Point3f> pts3D;
-        for (auto &_it : feature) {
-            auto & it_per_id = _it.second;
+        pnp.clear();
+        for (auto &it_per_id : feature) {
             if (it_per_id.depth_inited && it_per_id.good_for_solving && it_per_id.main_cam == 0 && it_per_id.used_num >= 4)
             {
-                int index = frameCnt - it_per_id.start_frame;
-                if((int)it_per_id.feature_per_frame.size() >= index + 1)
+                if(it_per_id.endFrame() >= frameCnt)
                 {
-                    Vector3d ptsInCam = ric[0] * (it_per_id.feature_per_frame[0].point * it_per_id.estimated_depth) + tic[0];
+                    Vector3d ptsInCam = ric[0] * (it_per_id.point(it_per_id.start_frame) * it_per_id.estimated_depth) + tic[0];
                     Vector3d ptsInWorld = Rs[it_per_id.start_frame] * ptsInCam + Ps[it_per_id.start_frame];
-
-                    cv::Point3f point3d(ptsInWorld.x(), ptsInWorld.y(), ptsInWorld.z());
-                    //Because PnP require 2d points; We hack here to use only z > 1 unit sphere point to init pnp
-                    Eigen::Vector3d pt = it_per_id.feature_per_frame[index].point;
-                    if (pt.z() > 0.1) {
-                        cv::Point2f point2d(pt.x()/pt.z(), pt.y()/pt.z());
-                        pts3D.push_back(point3d);
-                        pts2D.push_back(point2d);                         
-                    }
+                    // Bearings are used directly, so observations behind the image plane count as well
+                    pnp.add(ptsInWorld, it_per_id.point(frameCnt));
                 }
             }
         }
@@ -379,270 +340,397 @@ void FeatureManager::initFramePoseByPnP(int frameCnt, Vector3d Ps[], Matrix3d Rs
         RCam = Rs[frameCnt - 1] * ric[0];
         PCam = Rs[frameCnt - 1] * tic[0] + Ps[frameCnt - 1];
 
-        if(solvePoseByPnP(RCam, PCam, pts2D, pts3D))
+        // w_T_cam ---> cam_T_w
+        Eigen::Matrix3d R_cw = RCam.transpose();
+        Eigen::Vector3d t_cw = -(R_cw * PCam);
+        int inlier_num;
+        if(pnp.solve(R_cw, t_cw, inlier_num))
         {
+            // cam_T_w ---> w_T_cam
+            RCam = R_cw.transpose();
+            PCam = -(RCam * t_cw);
+
             // trans to w_T_imu
             Rs[frameCnt] = RCam * ric[0].transpose(); 
             Ps[frameCnt] = -RCam * ric[0].transpose() * tic[0] + PCam;
 
-            Eigen::Quaterniond Q(Rs[frameCnt]);
-            //cout << "frameCnt: " << frameCnt <<  " pnp Q " << Q.w() << " " << Q.vec().transpose() << endl;
-            // cout << "frameCnt: " << frameCnt << " pnp P " << Ps[frameCnt].transpose() << endl;
+            ROS_DEBUG("frame %d pnp inliers %d / %d", frameCnt, inlier_num, pnp.size());
         }
     }
 }
 
+// Adds (sign 1) or removes (sign -1) the two DLT rows of a bearing observation in the 4x4 normal matrix,
+// the camera projection is [Rt | t]
+static inline void addDLTRows(Eigen::Matrix4d &A, const Eigen::Matrix3d &Rt, const Eigen::Vector3d &t,
+                              const Eigen::Vector3d &pt, double sign)
+{
+    Eigen::Vector4d r0, r1;
+    r0 << pt.x() * Rt.row(2).transpose() - pt.z() * Rt.row(0).transpose(), pt.x() * t(2) - pt.z() * t(0);
+    r1 << pt.y() * Rt.row(2).transpose() - pt.z() * Rt.row(1).transpose(), pt.y() * t(2) - pt.z() * t(1);
+    A.noalias() += sign * (r0 * r0.transpose() + r1 * r1.transpose());
+}
+
+// Same solution as the SVD of the stacked design matrix: the right singular vector of the smallest
+// singular value is the eigenvector of A = D^T D with the smallest eigenvalue.
+// A non zero x is the previous solution, refined by inverse iteration; the eigen solver is only
+// used when the iteration does not clearly converge.
+// Returns the average row error like triangulatePoint3DPts
+static inline double solveDLT(const Eigen::Matrix4d &A, int rows, Eigen::Vector4d &x, Eigen::Vector3d &point_3d)
+{
+    bool converged = false;
+    if (x.squaredNorm() > 0) {
+        Eigen::LDLT<Eigen::Matrix4d> ldlt(A);
+        double last_step = 0;
+        for (int i = 0; i < 3 && !converged; i++) {
+            Eigen::Vector4d y = ldlt.solve(x).normalized();
+            if (y.dot(x) < 0)
+                y = -y;
+            double step = (y - x).norm();
+            x = y;
+            converged = step < 1e-12 || (i > 0 && step < 1e-9 && step < 0.01 * last_step);
+            last_step = step;
+        }
+    }
+    if (!converged) {
+        Eigen::SelfAdjointEigenSolver<Eigen::Matrix4d> es(A);
+        x = es.eigenvectors().col(0);
+    }
+    point_3d = x.head<3>() / x(3);
+    Eigen::Vector4d pts;
+    pts << point_3d, 1;
+    double err2 = pts.dot(A * pts);
+    return sqrt(max(err2, 0.0)) / rows;
+}
+
+// Refreshes the camera pose of every window frame that is new or moved beyond the thresholds,
+// landmarks accumulated with an older pose of these frames rebuild their DLT system
+void FeatureManager::updateTriangulatePoses(int frameCnt, Vector3d Ps[], Matrix3d Rs[], Vector3d tic[], Matrix3d ric[])
+{
+    for (int i = 0; i <= frameCnt; i++) {
+        int frame_abs = feature.frame_base + i;
+        int s = frame_abs % FEATURE_OBS_CAP;
+        bool moved = tri_frame_abs[s] != frame_abs;
+        Matrix3d Rt[2];
+        Vector3d center[2];
+        for (int c = 0; c < NUM_OF_CAM; c++) {
+            center[c] = Ps[i] + Rs[i] * tic[c];
+            Rt[c] = (Rs[i] * ric[c]).transpose();
+            if (!moved) {
+                double dr = Eigen::AngleAxisd(Rt[c] * tri_Rt[s][c].transpose()).angle();
+                moved = (center[c] - tri_center[s][c]).norm() > TRIANGULATE_POSE_T_THRES || dr > TRIANGULATE_POSE_R_THRES;
+            }
+        }
+        if (!moved)
+            continue;
+        for (int c = 0; c < NUM_OF_CAM; c++) {
+            tri_Rt[s][c] = Rt[c];
+            tri_center[s][c] = center[c];
+            tri_t[s][c] = -Rt[c] * center[c];
+        }
+        tri_frame_abs[s] = frame_abs;
+        tri_epoch[s] = ++tri_epoch_cnt;
+    }
+}
+
+// Brings the DLT system of a landmark up to date, returns true if it changed
+bool FeatureManager::updateDLT(FeaturePerId &it_per_id)
+{
+    bool changed = false;
+    bool stale = !it_per_id.dlt_valid || it_per_id.dlt_begin != it_per_id.start_abs;
+    for (int frame_abs = it_per_id.dlt_begin; !stale && frame_abs < it_per_id.dlt_end; frame_abs++) {
+        int s = frame_abs % FEATURE_OBS_CAP;
+        stale = tri_frame_abs[s] != frame_abs || tri_epoch[s] > it_per_id.dlt_epoch;
+    }
+    if (stale) {
+        it_per_id.dlt_A.setZero();
+        it_per_id.dlt_rows = 0;
+        it_per_id.dlt_begin = it_per_id.dlt_end = it_per_id.start_abs;
+        it_per_id.dlt_valid = true;
+        changed = true;
+    }
+
+    int main_cam_id = it_per_id.main_cam;
+    int end_abs = it_per_id.start_abs + it_per_id.obs_num;
+    for (int frame_abs = it_per_id.dlt_end; frame_abs < end_abs; frame_abs++) {
+        int s = frame_abs % FEATURE_OBS_CAP;
+        int imu_i = it_per_id.start_frame + frame_abs - it_per_id.start_abs;
+        addDLTRows(it_per_id.dlt_A, tri_Rt[s][main_cam_id], tri_t[s][main_cam_id], it_per_id.point(imu_i), 1);
+        it_per_id.dlt_rows += 2;
+        if(STEREO && it_per_id.is_stereo(imu_i)) {
+            //Secondary cam must be 1 now
+            addDLTRows(it_per_id.dlt_A, tri_Rt[s][1], tri_t[s][1], it_per_id.pointRight(imu_i), 1);
+            it_per_id.dlt_rows += 2;
+        }
+        changed = true;
+    }
+    it_per_id.dlt_end = end_abs;
+    it_per_id.dlt_epoch = tri_epoch_cnt;
+    return changed;
+}
+
+// Takes the observation of an absolute frame out of the DLT system before it leaves the window
+void FeatureManager::removeDLTFrame(FeaturePerId &it_per_id, int frame_abs)
+{
+    if (!it_per_id.dlt_valid || frame_abs < it_per_id.dlt_begin || frame_abs >= it_per_id.dlt_end)
+        return;
+    int s = frame_abs % FEATURE_OBS_CAP;
+    if (tri_frame_abs[s] != frame_abs || tri_epoch[s] > it_per_id.dlt_epoch) {
+        it_per_id.dlt_valid = false;
+        return;
+    }
+    int main_cam_id = it_per_id.main_cam;
+    int imu_i = it_per_id.start_frame + frame_abs - it_per_id.start_abs;
+    addDLTRows(it_per_id.dlt_A, tri_Rt[s][main_cam_id], tri_t[s][main_cam_id], it_per_id.point(imu_i), -1);
+    it_per_id.dlt_rows -= 2;
+    if(STEREO && it_per_id.is_stereo(imu_i)) {
+        addDLTRows(it_per_id.dlt_A, tri_Rt[s][1], tri_t[s][1], it_per_id.pointRight(imu_i), -1);
+        it_per_id.dlt_rows -= 2;
+    }
+    it_per_id.dlt_solved = false;
+}
+
+// Landmarks keep their DLT normal equations between calls: new observations are added, observations
+// leaving the window are removed and the system is rebuilt only when one of its frames moved.
+// A landmark whose system did not change gets its previous solution back without solving.
 void FeatureManager::triangulate(int frameCnt, Vector3d Ps[], Matrix3d Rs[], Vector3d tic[], Matrix3d ric[])
 {
-    for (auto &_it : feature) {
-        auto & it_per_id = _it.second;
+    updateTriangulatePoses(frameCnt, Ps, Rs, tic, ric);
+
+    // Tracker status is a std::map, it is written after the parallel loop
+    int num = feature.size();
+    triangulate_status.assign(num, 0);
+    auto landmarks = feature.begin();
+
+#pragma omp parallel for schedule(dynamic, 32)
+    for (int k = 0; k < num; k++) {
+        auto & it_per_id = landmarks[k];
         //Only solving point dnot re-triangulate
         if (!it_per_id.need_triangulation) {
             continue;
         }
         if (outlier_features.find(it_per_id.feature_id) != outlier_features.end()) {
             //Is in outliers
-            ft->setFeatureStatus(it_per_id.feature_id, -1);
+            triangulate_status[k] = -1;
             continue;
         }
 
-        int main_cam_id = it_per_id.main_cam;
-
-        std::vector<Eigen::Matrix<double, 3, 4>> poses;
-        std::vector<Eigen::Vector3d> ptss;
-        Eigen::Matrix<double, 3, 4> origin_pose;
-        auto t0 = Ps[it_per_id.start_frame] + Rs[it_per_id.start_frame] * tic[main_cam_id];
-        auto R0 = Rs[it_per_id.start_frame] * ric[main_cam_id];
-        origin_pose.leftCols<3>() = R0.transpose();
-        origin_pose.rightCols<1>() = -R0.transpose() * t0;
-        bool has_stereo = false;
-
-        Eigen::Vector3d _min = t0;
-        Eigen::Vector3d _max = t0;
-
-        for (unsigned int frame = 0; frame < it_per_id.feature_per_frame.size(); frame ++) {
-            int imu_i = it_per_id.start_frame + frame;
-            Eigen::Matrix<double, 3, 4> leftPose;
-            Eigen::Vector3d t0 = Ps[imu_i] + Rs[imu_i] * tic[main_cam_id];
-            _max.x() = max(t0.x(), _max.x());
-            _max.y() = max(t0.y(), _max.y());
-            _max.z() = max(t0.z(), _max.z());
-            
-            _min.x() = min(t0.x(), _min.x());
-            _min.y() = min(t0.y(), _min.y());
-            _min.z() = min(t0.z(), _min.z());
-
-            Eigen::Matrix3d R0 = Rs[imu_i] * ric[main_cam_id];
-            leftPose.leftCols<3>() = R0.transpose();
-            leftPose.rightCols<1>() = -R0.transpose() * t0;
-            Eigen::Vector3d point0 = it_per_id.feature_per_frame[frame].point;
-
-            poses.push_back(leftPose);
-            ptss.push_back(point0);
-
-            if(STEREO && it_per_id.feature_per_frame[frame].is_stereo) {
-                //Secondary cam must be 1 now
-                has_stereo = true;
-                Eigen::Matrix<double, 3, 4> rightPose;
-                Eigen::Vector3d t1 = Ps[imu_i] + Rs[imu_i] * tic[1];
-                Eigen::Matrix3d R1 = Rs[imu_i] * ric[1];
-                rightPose.leftCols<3>() = R1.transpose();
-                rightPose.rightCols<1>() = -R1.transpose() * t1;
-                auto point1 = it_per_id.feature_per_frame[frame].pointRight;
-                poses.push_back(rightPose);
-                ptss.push_back(point1);
-
-                _max.x() = max(t1.x(), _max.x());
-                _max.y() = max(t1.y(), _max.y());
-                _max.z() = max(t1.z(), _max.z());
-                
-                _min.x() = min(t1.x(), _min.x());
-                _min.y() = min(t1.y(), _min.y());
-                _min.z() = min(t1.z(), _min.z());
+        if (updateDLT(it_per_id) || !it_per_id.dlt_solved) {
+            int main_cam_id = it_per_id.main_cam;
+            int start_s = it_per_id.start_abs % FEATURE_OBS_CAP;
+            bool has_stereo = false;
+
+            Eigen::Vector3d _min = tri_center[start_s][main_cam_id];
+            Eigen::Vector3d _max = _min;
+            for (int imu_i = it_per_id.start_frame; imu_i <= it_per_id.endFrame(); imu_i ++) {
+                int s = (it_per_id.start_abs + imu_i - it_per_id.start_frame) % FEATURE_OBS_CAP;
+                _max = _max.cwiseMax(tri_center[s][main_cam_id]);
+                _min = _min.cwiseMin(tri_center[s][main_cam_id]);
+                if(STEREO && it_per_id.is_stereo(imu_i)) {
+                    has_stereo = true;
+                    _max = _max.cwiseMax(tri_center[s][1]);
+                    _min = _min.cwiseMin(tri_center[s][1]);
+                }
             }
-        }
-
-        if (poses.size() < 2) {
-            //No enough information
-            continue;
-        }
 
-        if (!has_stereo) {
-            //We need calculate baseline
-            if ((_max - _min).norm() < depth_estimate_baseline) {
-                //it_per_id.good_for_solving = true;
-                //it_per_id.depth_inited = true;
-                //it_per_id.need_triangulation = true;
-                //it_per_id.estimated_depth = INIT_DEPTH;
-                //if (it_per_id.feature_per_frame.size() >= 4) {
-                //    ft->setFeatureStatus(it_per_id.feature_id, 1);            
-                //}
-                continue;
+            it_per_id.dlt_solved = true;
+            it_per_id.tri_result = 0;
+            //No enough information; mono points also need enough baseline
+            if (it_per_id.dlt_rows >= 4 && (has_stereo || (_max - _min).norm() >= depth_estimate_baseline)) {
+                Eigen::Vector3d point3d;
+                double err = solveDLT(it_per_id.dlt_A, it_per_id.dlt_rows, it_per_id.dlt_x, point3d)*FOCAL_LENGTH;
+                if (err > triangulate_max_err) {
+                    it_per_id.tri_result = 1;
+                } else {
+                    Eigen::Vector3d localPoint = tri_Rt[start_s][main_cam_id] * point3d + tri_t[start_s][main_cam_id];
+                    it_per_id.tri_result = 2;
+                    it_per_id.tri_depth = localPoint.norm();
+                }
             }
         }
 
-        Eigen::Vector3d point3d;
-        double err = triangulatePoint3DPts(poses, ptss, point3d)*FOCAL_LENGTH;
-        Eigen::Vector3d localPoint = origin_pose.leftCols<3>() * point3d + origin_pose.rightCols<1>();
-        if (err > triangulate_max_err) {
-            // ROS_WARN("Feature ID %d CAM %d IS stereo %d poses %ld dep %d %f AVG ERR: %f", 
-            //     it_per_id.feature_id, 
-            //     it_per_id.main_cam,
-            //     it_per_id.feature_per_frame[0].is_stereo,
-            //     poses.size(),
-            //     it_per_id.depth_inited, it_per_id.estimated_depth, err);
-            ft->setFeatureStatus(it_per_id.feature_id, 2);
+        if (it_per_id.tri_result == 1) {
+            triangulate_status[k] = 2;
             it_per_id.good_for_solving = false;
             it_per_id.depth_inited = false;
             it_per_id.need_triangulation = true;
-            //it_per_id.estimated_depth = localPoint.norm();
-        } else {
-            if (it_per_id.feature_per_frame.size() >= 4) {
-                ft->setFeatureStatus(it_per_id.feature_id, 1);            
+        } else if (it_per_id.tri_result == 2) {
+            if (it_per_id.obs_num >= 4) {
+                triangulate_status[k] = 1;
             }
             it_per_id.depth_inited = true;
             it_per_id.good_for_solving = true;
-            it_per_id.estimated_depth = localPoint.norm();
-            if (!has_stereo && (_max - _min).norm() < depth_estimate_baseline) {
-                it_per_id.estimated_depth = INIT_DEPTH;
-            }
+            it_per_id.estimated_depth = it_per_id.tri_depth;
         }
-        // ROS_INFO("Pt3d %f %f %f LocalPt %f %f %f", point3d.x(), point3d.y(), point3d.z(), localPoint.x(), localPoint.y(), localPoint.z());
+    }
+
+    for (int k = 0; k < num; k++) {
+        if (triangulate_status[k] != 0)
+            ft->setFeatureStatus(landmarks[k].feature_id, triangulate_status[k]);
     }
 }
 
 void FeatureManager::removeOutlier(set<int> &outlierIndex)
 {
-    std::set<int>::iterator itSet;
-    for (auto it = feature.begin(), it_next = feature.begin();
-         it != feature.end(); it = it_next)
-    {
-        it_next++;
-        int index = it->first;
-        itSet = outlierIndex.find(index);
-        if(itSet != outlierIndex.end())
-        {
-            ft->setFeatureStatus(it->second.feature_id, -1);
-            feature.erase(it);
-            outlier_features.insert(it->second.feature_id);
-            //printf("remove outlier %d \n", index);
-        }
-    }
+    feature.removeIf([&](const FeaturePerId &it) {
+        if (outlierIndex.find(it.feature_id) == outlierIndex.end())
+            return false;
+        ft->setFeatureStatus(it.feature_id, -1);
+        outlier_features.insert(it.feature_id);
+        removeNewestPair(it);
+        //printf("remove outlier %d \n", it.feature_id);
+        return true;
+    });
 }
 
+// The observation rings are indexed by absolute frame number, so sliding out the oldest frame only
+// advances the base frame; the sweep below just updates indices and drops the dead landmarks
 void FeatureManager::removeBackShiftDepth(Eigen::Matrix3d marg_R, Eigen::Vector3d marg_P, Eigen::Matrix3d new_R, Eigen::Vector3d new_P)
 {
-    for (auto _it = feature.begin(), it_next = feature.begin();
-         _it != feature.end(); _it = it_next)
-    {
-        auto & it = _it->second; 
-        it_next++;
-
+    // marg camera frame -> new camera frame
+    Eigen::Matrix3d R_jm = new_R.transpose() * marg_R;
+    Eigen::Vector3d t_jm = new_R.transpose() * (marg_P - new_P);
+    feature.frame_base++;
+    feature.removeIf([&](FeaturePerId &it) {
         if (it.start_frame != 0)
+        {
             it.start_frame--;
-        else
+            return false;
+        }
+
+        Eigen::Vector3d uv_i = it.point(0);
+        dropFirstObservation(it);
+        if (it.obs_num < 2)
         {
-            Eigen::Vector3d uv_i = it.feature_per_frame[0].point;  
-            it.feature_per_frame.erase(it.feature_per_frame.begin());
-            if (it.feature_per_frame.size() < 2)
-            {
-                feature.erase(_it);
-                ft->setFeatureStatus(_it->second.feature_id, -1);
-                continue;
-            }
-            else
-            {
-                Eigen::Vector3d pts_i = uv_i * it.estimated_depth;
-                Eigen::Vector3d w_pts_i = marg_R * pts_i + marg_P;
-                Eigen::Vector3d pts_j = new_R.transpose() * (w_pts_i - new_P);
-                double dep_j = pts_j.norm();
+            ft->setFeatureStatus(it.feature_id, -1);
+            return true;
+        }
+
+        Eigen::Vector3d pts_j = R_jm * (uv_i * it.estimated_depth) + t_jm;
+        double dep_j = pts_j.norm();
 
-                it.depth_inited = true;
-                //We retriangulate this point
+        it.depth_inited = true;
+        //We retriangulate this point
 #ifndef DEBUG_DISABLE_RETRIANGULATE
-                it.need_triangulation = true;
+        it.need_triangulation = true;
 #endif
-                if (FISHEYE) {
-                    it.estimated_depth = pts_j.norm();
-                } else {
-                    if (dep_j > 0)
-                        it.estimated_depth = dep_j;
-                    else
-                        it.estimated_depth = INIT_DEPTH;
-                }
-            }
-        }
-        // remove tracking-lost feature after marginalize
-        /*
-        if (it->endFrame() < WINDOW_SIZE - 1)
-        {
-            feature.erase(it);
+        if (FISHEYE) {
+            it.estimated_depth = pts_j.norm();
+        } else {
+            if (dep_j > 0)
+                it.estimated_depth = dep_j;
+            else
+                it.estimated_depth = INIT_DEPTH;
         }
-        */
-    }
+        return false;
+    });
 }
 
 void FeatureManager::removeBack()
 {
-    for (auto it = feature.begin(), it_next = feature.begin();
-         it != feature.end(); it = it_next)
-    {
-        it_next++;
-
-        if (it->second.start_frame != 0)
-            it->second.start_frame--;
-        else
+    feature.frame_base++;
+    feature.removeIf([&](FeaturePerId &it) {
+        if (it.start_frame != 0)
         {
-            it->second.feature_per_frame.erase(it->second.feature_per_frame.begin());
-            if (it->second.feature_per_frame.size() == 0) {
-                ft->setFeatureStatus(it->second.feature_id, -1);
-                feature.erase(it);
-            }
+            it.start_frame--;
+            return false;
         }
-    }
+        dropFirstObservation(it);
+        if (it.obs_num == 0) {
+            ft->setFeatureStatus(it.feature_id, -1);
+            return true;
+        }
+        return false;
+    });
 }
 
+// The newest frame takes over the absolute number of the dropped second newest frame,
+// at most one observation per landmark is moved
 void FeatureManager::removeFront(int frame_count)
 {
-    for (auto it = feature.begin(), it_next = feature.begin(); it != feature.end(); it = it_next)
-    {
-        it_next++;
-
-        if (it->second.start_frame == frame_count)
+    int second_abs = feature.frame_base + frame_count - 1;
+    // The newest frame takes the place of the second newest, so the newest pair is now frame_count - 2 and it
+    newest_abs = second_abs;
+    newest_parallax_sum = 0;
+    newest_parallax_num = 0;
+    feature.removeIf([&](FeaturePerId &it) {
+        if (it.start_frame == frame_count)
         {
-            it->second.start_frame--;
+            it.copyObservation(frame_count, frame_count - 1);
+            it.start_frame--;
+            it.start_abs--;
+            it.dlt_begin--;
+            it.dlt_end--;
+            return false;
         }
-        else
-        {
-            int j = WINDOW_SIZE - 1 - it->second.start_frame;
-            if (it->second.endFrame() < frame_count - 1)
-                continue;
-            it->second.feature_per_frame.erase(it->second.feature_per_frame.begin() + j);
-            if (it->second.feature_per_frame.size() == 0) {
-                ft->setFeatureStatus(it->second.feature_id, -1);
-                feature.erase(it);
-            }
+        if (it.endFrame() < frame_count - 1)
+            return false;
+        removeDLTFrame(it, second_abs);
+        if (it.dlt_end > second_abs)
+            it.dlt_end--;
+        if (it.endFrame() == frame_count)
+            it.copyObservation(frame_count, frame_count - 1);
+        it.obs_num--;
+        if (it.obs_num == 0) {
+            ft->setFeatureStatus(it.feature_id, -1);
+            return true;
         }
+        if (inNewestPair(it)) {
+            it.parallax = compensatedParallax2(it, frame_count);
+            newest_parallax_sum += it.parallax;
+            newest_parallax_num++;
+        }
+        return false;
+    });
+
+    // The triangulation pose of the newest frame moves along with it
+    int s0 = (second_abs + 1) % FEATURE_OBS_CAP, s1 = second_abs % FEATURE_OBS_CAP;
+    for (int c = 0; c < NUM_OF_CAM; c++) {
+        tri_Rt[s1][c] = tri_Rt[s0][c];
+        tri_t[s1][c] = tri_t[s0][c];
+        tri_center[s1][c] = tri_center[s0][c];
     }
+    tri_frame_abs[s1] = tri_frame_abs[s0] == second_abs + 1 ? second_abs : -1;
+    tri_epoch[s1] = tri_epoch[s0];
+    tri_frame_abs[s0] = -1;
+}
+
+void FeatureManager::dropFirstObservation(FeaturePerId &it_per_id)
+{
+    removeDLTFrame(it_per_id, it_per_id.start_abs);
+    if (it_per_id.dlt_begin == it_per_id.start_abs) {
+        it_per_id.dlt_begin++;
+        it_per_id.dlt_end = max(it_per_id.dlt_end, it_per_id.dlt_begin);
+    }
+    if (it_per_id.obs_num == 2)
+        removeNewestPair(it_per_id);
+    it_per_id.dropFirstObservation();
+}
+
+void FeatureManager::removeNewestPair(const FeaturePerId &it_per_id)
+{
+    if (!inNewestPair(it_per_id))
+        return;
+    newest_parallax_sum -= it_per_id.parallax;
+    newest_parallax_num--;
 }
 
 double FeatureManager::compensatedParallax2(const FeaturePerId &it_per_id, int frame_count)
 {
     //check the second last frame is keyframe or not
     //parallax betwwen seconde last frame and third last frame
-    const FeaturePerFrame &frame_i = it_per_id.feature_per_frame[frame_count - 2 - it_per_id.start_frame];
-    const FeaturePerFrame &frame_j = it_per_id.feature_per_frame[frame_count - 1 - it_per_id.start_frame];
+    const Vector3d &point_i = it_per_id.point(frame_count - 2);
+    const Vector3d &point_j = it_per_id.point(frame_count - 1);
 
     if (FISHEYE) {
-        return (frame_i.point - frame_j.point).norm();
+        return (point_i - point_j).norm();
     } else {
         double ans = 0;
-        Vector3d p_j = frame_j.point;
+        Vector3d p_j = point_j;
 
         double u_j = p_j(0);
         double v_j = p_j(1);
 
-        Vector3d p_i = frame_i.point;
+        Vector3d p_i = point_i;
 
         //int r_i = frame_count - 2;
         //int r_j = frame_count - 1;
@@ -27,72 +27,14 @@ using namespace Eigen;
 #include "parameters.h"
 #include "../utility/tic_toc.h"
 #include "../featureTracker/feature_tracker.h"
+#include "landmark_store.h"
+#include "bearing_pnp.h"
 #define KEYFRAME_LONGTRACK_THRES 20
+// Camera motion below which a frame keeps the pose its landmarks were triangulated with
+#define TRIANGULATE_POSE_T_THRES 0.0002
+#define TRIANGULATE_POSE_R_THRES 0.0001
 
 
-class FeaturePerFrame
-{
-  public:
-    FeaturePerFrame(const TrackFeatureNoId &_point, double td)
-    {
-        point.x() = _point(0);
-        point.y() = _point(1);
-        point.z() = _point(2);
-        uv.x() = _point(3);
-        uv.y() = _point(4);
-        velocity.x() = _point(5); 
-        velocity.y() = _point(6); 
-        velocity.z() = _point(7); 
-        cur_td = td;
-        is_stereo = false;
-    }
-    void rightObservation(const TrackFeatureNoId &_point)
-    {
-        pointRight.x() = _point(0);
-        pointRight.y() = _point(1);
-        pointRight.z() = _point(2);
-        uvRight.x() = _point(3);
-        uvRight.y() = _point(4);
-        velocityRight.x() = _point(5); 
-        velocityRight.y() = _point(6); 
-        velocityRight.z() = _point(7); 
-        is_stereo = true;
-    }
-    double cur_td;
-    Vector3d point, pointRight;
-    Vector2d uv, uvRight;
-    Vector3d velocity, velocityRight;
-    bool is_stereo;
-    int camera = 0;
-};
-
-class FeaturePerId
-{
-  public:
-    const int feature_id = -1;
-    int start_frame = -1;
-    vector<FeaturePerFrame> feature_per_frame;
-    int used_num = 0;
-    double estimated_depth = -1;
-    bool depth_inited = false;
-    bool need_triangulation = true;
-    int solve_flag = 0; // 0 haven't solve yet; 1 solve succ; 2 solve fail;
-    bool good_for_solving = false;
-    int main_cam = 0;
-
-    FeaturePerId(int _feature_id, int _start_frame)
-        : feature_id(_feature_id), start_frame(_start_frame),
-          used_num(0), estimated_depth(-1.0), solve_flag(0)
-    {
-    }
-
-    FeaturePerId() {
-
-    }
-
-    int endFrame();
-};
-
 class FeatureManager
 {
   public:
@@ -105,10 +47,11 @@ class FeatureManager
     bool addFeatureCheckParallax(int frame_count, const FeatureFrame &image, double td);
     vector<pair<Vector3d, Vector3d>> getCorresponding(int frame_count_l, int frame_count_r);
     //void updateDepth(const VectorXd &x);
-    void setDepth(std::map<int, double> deps);
+    void setDepth();
+    int getSolvedCount();
     void removeFailures();
     void clearDepth();
-    std::map<int, double> getDepthVector();
+    int getDepthVector();
     void triangulate(int frameCnt, Vector3d Ps[], Matrix3d Rs[], Vector3d tic[], Matrix3d ric[]);
     void triangulatePoint(Eigen::Matrix<double, 3, 4> &Pose0, Eigen::Matrix<double, 3, 4> &Pose1,
                             Eigen::Vector2d &point0, Eigen::Vector2d &point1, Eigen::Vector3d &point_3d);
@@ -116,13 +59,11 @@ class FeatureManager
                             Eigen::Vector3d &point0, Eigen::Vector3d &point1, Eigen::Vector3d &point_3d);
     double triangulatePoint3DPts(vector<Eigen::Matrix<double, 3, 4>> &Poses, vector<Eigen::Vector3d> &points, Eigen::Vector3d &point_3d);
     void initFramePoseByPnP(int frameCnt, Vector3d Ps[], Matrix3d Rs[], Vector3d tic[], Matrix3d ric[]);
-    bool solvePoseByPnP(Eigen::Matrix3d &R_initial, Eigen::Vector3d &P_initial, 
-                            vector<cv::Point2f> &pts2D, vector<cv::Point3f> &pts3D);
     void removeBackShiftDepth(Eigen::Matrix3d marg_R, Eigen::Vector3d marg_P, Eigen::Matrix3d new_R, Eigen::Vector3d new_P);
     void removeBack();
     void removeFront(int frame_count);
     void removeOutlier(set<int> &outlierIndex);
-    map<int, FeaturePerId> feature;
+    LandmarkStore feature;
     int last_track_num;
     double last_average_parallax;
     int new_feature_num;
@@ -131,6 +72,30 @@ class FeatureManager
     set<int> outlier_features;
 
   private:
+    void updateTriangulatePoses(int frameCnt, Vector3d Ps[], Matrix3d Rs[], Vector3d tic[], Matrix3d ric[]);
+    bool updateDLT(FeaturePerId &it_per_id);
+    void removeDLTFrame(FeaturePerId &it_per_id, int frame_abs);
+    void dropFirstObservation(FeaturePerId &it_per_id);
+    bool inNewestPair(const FeaturePerId &it_per_id) const
+    {
+        return it_per_id.obs_num >= 2 && it_per_id.endAbs() == newest_abs;
+    }
+    void removeNewestPair(const FeaturePerId &it_per_id);
+
+    vector<int> triangulate_status;
+    // Camera poses the landmark DLT accumulators are built with, ring indexed by absolute frame number
+    Matrix3d tri_Rt[FEATURE_OBS_CAP][2];
+    Vector3d tri_t[FEATURE_OBS_CAP][2];
+    Vector3d tri_center[FEATURE_OBS_CAP][2];
+    int tri_frame_abs[FEATURE_OBS_CAP];
+    int tri_epoch[FEATURE_OBS_CAP];
+    int tri_epoch_cnt;
+    // Parallax statistics of the landmarks observed in the two newest frames, i.e. the ones the
+    // keyframe check of the next frame looks at. Every pass that adds or drops observations keeps them up to date
+    int newest_abs;
+    double newest_parallax_sum;
+    int newest_parallax_num;
+    BearingPnP pnp;
     double compensatedParallax2(const FeaturePerId &it_per_id, int frame_count);
     const Matrix3d *Rs;
     Matrix3d ric[2];
@@ -0,0 +1,180 @@
+/*******************************************************
+ * Copyright (C) 2019, Aerial Robotics Group, Hong Kong University of Science and Technology
+ *
+ * This file is part of VINS.
+ *
+ * Licensed under the GNU General Public License v3.0;
+ * you may not use this file except in compliance with the License.
+ *******************************************************/
+
+#include "imu_propagator.h"
+#include "parameters.h"
+#include "../utility/utility.h"
+
+// The replay history is trimmed by the corrections; this only bounds it while none come, e.g. during initialization
+#define IMU_HISTORY_MAX_TIME 30.0
+
+IMUPropagator::IMUPropagator():
+    ring_head(0), ring_tail(0), mailbox(nullptr), running(false), history_dropped_t(-1)
+{
+}
+
+IMUPropagator::~IMUPropagator()
+{
+    stop();
+    delete mailbox.exchange(nullptr);
+}
+
+void IMUPropagator::start(OutputCallback _callback)
+{
+    if (running)
+        return;
+    callback = _callback;
+    running = true;
+    propagateThread = std::thread(&IMUPropagator::run, this);
+}
+
+void IMUPropagator::stop()
+{
+    running = false;
+    wake_cv.notify_one();
+    if (propagateThread.joinable())
+        propagateThread.join();
+}
+
+void IMUPropagator::inputIMU(const IMUSample * samples, int num)
+{
+    unsigned int head = ring_head.load(std::memory_order_relaxed);
+    unsigned int tail = ring_tail.load(std::memory_order_acquire);
+    for (int i = 0; i < num; i++)
+    {
+        if (head - tail >= RING_SIZE)
+        {
+            ROS_WARN("IMU propagator buffer full, drop sample %f", samples[i].t);
+            continue;
+        }
+        ring[head % RING_SIZE] = samples[i];
+        head++;
+    }
+    ring_head.store(head, std::memory_order_release);
+    wake_cv.notify_one();
+}
+
+void IMUPropagator::correct(const IMUPropagatorState & _state)
+{
+    IMUPropagatorState * new_state = new IMUPropagatorState(_state);
+    new_state->valid = true;
+    delete mailbox.exchange(new_state, std::memory_order_acq_rel);
+    wake_cv.notify_one();
+}
+
+void IMUPropagator::reset()
+{
+    IMUPropagatorState * new_state = new IMUPropagatorState();
+    new_state->valid = false;
+    delete mailbox.exchange(new_state, std::memory_order_acq_rel);
+    wake_cv.notify_one();
+}
+
+bool IMUPropagator::popSample(IMUSample & sample)
+{
+    unsigned int tail = ring_tail.load(std::memory_order_relaxed);
+    if (tail == ring_head.load(std::memory_order_acquire))
+        return false;
+    sample = ring[tail % RING_SIZE];
+    ring_tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+void IMUPropagator::run()
+{
+    while (running)
+    {
+        IMUPropagatorState * new_state = mailbox.exchange(nullptr, std::memory_order_acq_rel);
+        if (new_state)
+        {
+            applyCorrection(*new_state);
+            delete new_state;
+        }
+
+        IMUSample sample;
+        bool has_sample = false;
+        while (popSample(sample))
+        {
+            has_sample = true;
+            history.push_back(sample);
+            if (state.valid)
+            {
+                propagate(sample);
+                if (IMU_BATCH_PUB_ALL)
+                    callback(state.P, state.Q, state.V, state.t);
+            }
+        }
+
+        if (has_sample)
+        {
+            while (!history.empty() && history.front().t < history.back().t - IMU_HISTORY_MAX_TIME)
+                dropHistoryFront();
+            if (state.valid && !IMU_BATCH_PUB_ALL)
+                callback(state.P, state.Q, state.V, state.t);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(wake_mutex);
+        wake_cv.wait_for(lock, std::chrono::milliseconds(1));
+    }
+}
+
+void IMUPropagator::applyCorrection(const IMUPropagatorState & _state)
+{
+    state = _state;
+    if (!state.valid)
+    {
+        // A reset starts over, the time may even jump back after it
+        history.clear();
+        history_dropped_t = -1;
+        return;
+    }
+
+    // The samples right after the corrected state are gone, replaying would integrate over the gap
+    if (history_dropped_t > state.t)
+    {
+        ROS_WARN("IMU propagator correction at %f is older than the replay history (%f), wait for the next one",
+            state.t, history_dropped_t);
+        state.valid = false;
+        return;
+    }
+
+    while (!history.empty() && history.front().t <= state.t)
+        dropHistoryFront();
+
+    for (auto & sample : history)
+        propagate(sample);
+}
+
+void IMUPropagator::dropHistoryFront()
+{
+    history_dropped_t = history.front().t;
+    history.pop_front();
+}
+
+void IMUPropagator::propagate(const IMUSample & sample)
+{
+    double dt = sample.t - state.t;
+    if (dt <= 0)
+        return;
+    if (dt > 0.03) {
+        ROS_ERROR("IMU propagator DT %4.2fms", dt*1000);
+    }
+
+    state.t = sample.t;
+    Eigen::Vector3d un_acc_0 = state.Q * (state.acc_0 - state.Ba) - state.g;
+    Eigen::Vector3d un_gyr = 0.5 * (state.gyr_0 + sample.gyr) - state.Bg;
+    state.Q = state.Q * Utility::deltaQ(un_gyr * dt);
+    Eigen::Vector3d un_acc_1 = state.Q * (sample.acc - state.Ba) - state.g;
+    Eigen::Vector3d un_acc = 0.5 * (un_acc_0 + un_acc_1);
+    state.P = state.P + dt * state.V + 0.5 * dt * dt * un_acc;
+    state.V = state.V + dt * un_acc;
+    state.acc_0 = sample.acc;
+    state.gyr_0 = sample.gyr;
+}
@@ -0,0 +1,87 @@
+/*******************************************************
+ * Copyright (C) 2019, Aerial Robotics Group, Hong Kong University of Science and Technology
+ *
+ * This file is part of VINS.
+ *
+ * Licensed under the GNU General Public License v3.0;
+ * you may not use this file except in compliance with the License.
+ *******************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <eigen3/Eigen/Dense>
+#include <eigen3/Eigen/Geometry>
+
+struct IMUSample
+{
+    double t;
+    Eigen::Vector3d acc;
+    Eigen::Vector3d gyr;
+};
+
+// State the backend hands to the propagator after each solve
+struct IMUPropagatorState
+{
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    bool valid = false; // false resets the propagator until the next valid state
+    double t = 0;
+    Eigen::Vector3d P, V, Ba, Bg;
+    Eigen::Quaterniond Q;
+    Eigen::Vector3d acc_0, gyr_0;
+    Eigen::Vector3d g;
+};
+
+// IMU-rate propagator running on its own thread.
+// IMU samples come in through a single-producer ring buffer and backend corrections through
+// a one-slot atomic mailbox, so neither the IMU callback nor the backend ever waits on it.
+// On a correction only the samples newer than the corrected state are replayed. The replay history
+// is kept back to the last correction; a correction older than that has no samples to replay and
+// leaves the propagator without output until the next one.
+class IMUPropagator
+{
+  public:
+    typedef std::function<void(const Eigen::Vector3d &P, const Eigen::Quaterniond &Q, const Eigen::Vector3d &V, double t)> OutputCallback;
+
+    IMUPropagator();
+    ~IMUPropagator();
+
+    void start(OutputCallback _callback);
+    void stop();
+
+    // Called from the IMU input thread only
+    void inputIMU(const IMUSample * samples, int num);
+    // Called from the backend
+    void correct(const IMUPropagatorState & state);
+    void reset();
+
+  private:
+    void run();
+    bool popSample(IMUSample & sample);
+    void applyCorrection(const IMUPropagatorState & state);
+    void dropHistoryFront();
+    void propagate(const IMUSample & sample);
+
+    static const int RING_SIZE = 1024;
+    IMUSample ring[RING_SIZE];
+    std::atomic<unsigned int> ring_head;
+    std::atomic<unsigned int> ring_tail;
+
+    std::atomic<IMUPropagatorState *> mailbox;
+
+    std::mutex wake_mutex;
+    std::condition_variable wake_cv;
+    std::atomic<bool> running;
+    std::thread propagateThread;
+    OutputCallback callback;
+
+    // Owned by the propagator thread
+    IMUPropagatorState state;
+    std::deque<IMUSample> history;
+    double history_dropped_t; // time of the newest sample dropped from the history, -1 if none
+};
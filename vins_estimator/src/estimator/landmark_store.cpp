@@ -0,0 +1,145 @@
+/*******************************************************
+ * Copyright (C) 2019, Aerial Robotics Group, Hong Kong University of Science and Technology
+ *
+ * This file is part of VINS.
+ *
+ * Licensed under the GNU General Public License v3.0;
+ * you may not use this file except in compliance with the License.
+ *******************************************************/
+
+#include "landmark_store.h"
+
+bool FeaturePerId::addObservation(const FeaturePerFrame &f_per_fra)
+{
+    if (obs_num >= FEATURE_OBS_CAP)
+    {
+        ROS_WARN("Feature %d has more observations than the window, skip", feature_id);
+        return false;
+    }
+    int k = slot(endFrame() + 1);
+    obs->point[k] = f_per_fra.point;
+    obs->velocity[k] = f_per_fra.velocity;
+    obs->cur_td[k] = f_per_fra.cur_td;
+    obs->is_stereo[k] = f_per_fra.is_stereo;
+    obs->pointRight[k] = f_per_fra.pointRight;
+    obs->velocityRight[k] = f_per_fra.velocityRight;
+    obs->uv[k] = f_per_fra.uv;
+    obs->uvRight[k] = f_per_fra.uvRight;
+    obs_num++;
+    return true;
+}
+
+void FeaturePerId::copyObservation(int from_frame, int to_frame)
+{
+    int i = slot(from_frame), k = slot(to_frame);
+    obs->point[k] = obs->point[i];
+    obs->velocity[k] = obs->velocity[i];
+    obs->cur_td[k] = obs->cur_td[i];
+    obs->is_stereo[k] = obs->is_stereo[i];
+    obs->pointRight[k] = obs->pointRight[i];
+    obs->velocityRight[k] = obs->velocityRight[i];
+    obs->uv[k] = obs->uv[i];
+    obs->uvRight[k] = obs->uvRight[i];
+}
+
+const int FlatIdIndex::EMPTY;
+
+FlatIdIndex::FlatIdIndex()
+{
+    reserve(16);
+}
+
+void FlatIdIndex::clear()
+{
+    std::fill(keys.begin(), keys.end(), EMPTY);
+    num = 0;
+}
+
+void FlatIdIndex::reserve(int n)
+{
+    // Keep the load factor under 0.5
+    int bits = 4;
+    while ((1 << bits) < 2 * n)
+        bits++;
+    keys.assign(1 << bits, EMPTY);
+    slots.assign(1 << bits, -1);
+    mask = (1u << bits) - 1;
+    shift = 32 - bits;
+    num = 0;
+}
+
+void FlatIdIndex::insert(int id, int slot)
+{
+    if (2 * (num + 1) > (int)keys.size())
+        grow();
+    unsigned int i = hash(id);
+    while (keys[i] != EMPTY && keys[i] != id)
+        i = (i + 1) & mask;
+    if (keys[i] == EMPTY)
+        num++;
+    keys[i] = id;
+    slots[i] = slot;
+}
+
+void FlatIdIndex::grow()
+{
+    std::vector<int> old_keys, old_slots;
+    old_keys.swap(keys);
+    old_slots.swap(slots);
+    reserve(old_keys.size());
+    for (unsigned int i = 0; i < old_keys.size(); i++)
+    {
+        if (old_keys[i] != EMPTY)
+            insert(old_keys[i], old_slots[i]);
+    }
+}
+
+LandmarkStore::LandmarkStore()
+{
+}
+
+void LandmarkStore::clear()
+{
+    frame_base = 0;
+    landmarks.clear();
+    index.clear();
+    obs_free.clear();
+    for (auto &o : obs_pool)
+        obs_free.push_back(o.get());
+    para_feature.clear();
+}
+
+void LandmarkStore::clearParams()
+{
+    for (auto &it_per_id : landmarks)
+        it_per_id.param_index = -1;
+    para_feature.clear();
+}
+
+void LandmarkStore::addParam(FeaturePerId &it_per_id, double inv_depth)
+{
+    it_per_id.param_index = paramNum();
+    para_feature.resize(para_feature.size() + SIZE_FEATURE);
+    para_feature[it_per_id.param_index * SIZE_FEATURE] = inv_depth;
+}
+
+FeaturePerId & LandmarkStore::insert(int feature_id, int start_frame)
+{
+    if (obs_free.empty())
+    {
+        obs_pool.emplace_back(new FeatureObservations);
+        obs_free.push_back(obs_pool.back().get());
+    }
+    index.insert(feature_id, landmarks.size());
+    landmarks.emplace_back(feature_id, start_frame, frame_base + start_frame);
+    landmarks.back().obs = obs_free.back();
+    obs_free.pop_back();
+    return landmarks.back();
+}
+
+void LandmarkStore::rebuildIndex()
+{
+    index.clear();
+    for (unsigned int i = 0; i < landmarks.size(); i++)
+        index.insert(landmarks[i].feature_id, i);
+}
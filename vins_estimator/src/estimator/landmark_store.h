@@ -0,0 +1,276 @@
+/*******************************************************
+ * Copyright (C) 2019, Aerial Robotics Group, Hong Kong University of Science and Technology
+ *
+ * This file is part of VINS.
+ *
+ * Licensed under the GNU General Public License v3.0;
+ * you may not use this file except in compliance with the License.
+ *******************************************************/
+
+#pragma once
+
+#include <vector>
+#include <limits>
+#include <memory>
+#include <eigen3/Eigen/Dense>
+#include <eigen3/Eigen/StdVector>
+
+#include <ros/assert.h>
+
+#include "parameters.h"
+#include "../featureTracker/feature_tracker.h"
+
+using namespace std;
+using namespace Eigen;
+
+// A landmark is observed in at most every frame of the window
+const int FEATURE_OBS_CAP = WINDOW_SIZE + 1;
+
+class FeaturePerFrame
+{
+  public:
+    // Observation i of a tracked frame
+    FeaturePerFrame(const FeatureFrame &frame, int i, double td)
+    {
+        point = frame.points[i];
+        uv = frame.uvs[i];
+        velocity = frame.velocities[i];
+        cur_td = td;
+        is_stereo = false;
+    }
+    void rightObservation(const FeatureFrame &frame, int i)
+    {
+        pointRight = frame.points[i];
+        uvRight = frame.uvs[i];
+        velocityRight = frame.velocities[i];
+        is_stereo = true;
+    }
+    double cur_td;
+    Vector3d point, pointRight;
+    Vector2d uv, uvRight;
+    Vector3d velocity, velocityRight;
+    bool is_stereo;
+    int camera = 0;
+};
+
+// Observations of one landmark as structure-of-arrays, so the passes that only read
+// the bearing vectors do not pull uv, velocity and right camera data through the cache.
+// Each array is a ring indexed by the absolute frame number modulo FEATURE_OBS_CAP.
+struct FeatureObservations
+{
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    Vector3d point[FEATURE_OBS_CAP];
+    Vector3d velocity[FEATURE_OBS_CAP];
+    double cur_td[FEATURE_OBS_CAP];
+    bool is_stereo[FEATURE_OBS_CAP];
+    Vector3d pointRight[FEATURE_OBS_CAP];
+    Vector3d velocityRight[FEATURE_OBS_CAP];
+    Vector2d uv[FEATURE_OBS_CAP];
+    Vector2d uvRight[FEATURE_OBS_CAP];
+};
+
+class FeaturePerId
+{
+  public:
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+    int feature_id = -1;
+    int start_frame = -1;
+    int start_abs = 0; // absolute frame number of start_frame
+    int obs_num = 0;
+    int used_num = 0;
+    double estimated_depth = -1;
+    bool depth_inited = false;
+    bool need_triangulation = true;
+    int solve_flag = 0; // 0 haven't solve yet; 1 solve succ; 2 solve fail;
+    bool good_for_solving = false;
+    int main_cam = 0;
+    int param_index = -1; // row in LandmarkStore::para_feature, -1 when not in the optimization
+    double parallax = 0; // parallax between the two newest observations
+
+    // Incremental triangulation state, maintained by FeatureManager.
+    // dlt_A holds the DLT normal equations of the frames with absolute number in [dlt_begin, dlt_end),
+    // built with the frame poses of triangulation epoch dlt_epoch
+    Matrix4d dlt_A = Matrix4d::Zero();
+    Vector4d dlt_x = Vector4d::Zero(); // last homogeneous solution
+    int dlt_rows = 0;
+    int dlt_begin = 0, dlt_end = 0;
+    int dlt_epoch = 0;
+    bool dlt_valid = false;
+    bool dlt_solved = false; // tri_result/tri_depth are up to date with dlt_A
+    int tri_result = 0; // 0 not enough baseline; 1 error too large; 2 succ
+    double tri_depth = -1;
+
+    // Owned by the landmark store and kept out of the record, so compaction only moves the small part
+    FeatureObservations *obs = nullptr;
+
+    FeaturePerId(int _feature_id, int _start_frame, int _start_abs)
+        : feature_id(_feature_id), start_frame(_start_frame), start_abs(_start_abs),
+          used_num(0), estimated_depth(-1.0), solve_flag(0)
+    {
+    }
+
+    FeaturePerId() {
+
+    }
+
+    int endFrame() const
+    {
+        return start_frame + obs_num - 1;
+    }
+    int endAbs() const
+    {
+        return start_abs + obs_num - 1;
+    }
+
+    // Observation accessors take the window frame index
+    const Vector3d & point(int frame) const { return obs->point[slot(frame)]; }
+    const Vector3d & pointRight(int frame) const { return obs->pointRight[slot(frame)]; }
+    const Vector2d & uv(int frame) const { return obs->uv[slot(frame)]; }
+    const Vector2d & uvRight(int frame) const { return obs->uvRight[slot(frame)]; }
+    const Vector3d & velocity(int frame) const { return obs->velocity[slot(frame)]; }
+    const Vector3d & velocityRight(int frame) const { return obs->velocityRight[slot(frame)]; }
+    double cur_td(int frame) const { return obs->cur_td[slot(frame)]; }
+    bool is_stereo(int frame) const { return obs->is_stereo[slot(frame)]; }
+
+    // Appends the observation of frame endFrame() + 1
+    bool addObservation(const FeaturePerFrame &f_per_fra);
+    // Drops the observation of start_frame, nothing is moved
+    void dropFirstObservation()
+    {
+        start_abs++;
+        obs_num--;
+    }
+    void copyObservation(int from_frame, int to_frame);
+
+  private:
+    int slot(int frame) const
+    {
+        return (start_abs + frame - start_frame) % FEATURE_OBS_CAP;
+    }
+};
+
+// Open addressing feature id -> slot table with linear probing.
+// Entries are never erased one by one, the landmark store rebuilds the table after compaction.
+class FlatIdIndex
+{
+  public:
+    FlatIdIndex();
+    void clear();
+    void reserve(int n);
+    void insert(int id, int slot);
+    int find(int id) const
+    {
+        unsigned int i = hash(id);
+        while (true)
+        {
+            const int key = keys[i];
+            if (key == id)
+                return slots[i];
+            if (key == EMPTY)
+                return -1;
+            i = (i + 1) & mask;
+        }
+    }
+
+  private:
+    static const int EMPTY = std::numeric_limits<int>::min();
+    unsigned int hash(int id) const
+    {
+        return ((unsigned int)id * 2654435761u) >> shift;
+    }
+    void grow();
+
+    std::vector<int> keys;
+    std::vector<int> slots;
+    unsigned int mask;
+    int shift;
+    int num;
+};
+
+// Dense slot map of the landmarks in the window.
+// Landmarks are kept contiguous in insertion order, which follows the feature id order of the tracker.
+// Their observation rings live in a pool next to them and are recycled through a free list.
+class LandmarkStore
+{
+  public:
+    typedef std::vector<FeaturePerId, Eigen::aligned_allocator<FeaturePerId>> Container;
+    typedef Container::iterator iterator;
+    typedef Container::const_iterator const_iterator;
+
+    LandmarkStore();
+
+    // Absolute frame number of window frame 0, advanced when the oldest frame is marginalized
+    int frame_base = 0;
+
+    iterator begin() { return landmarks.begin(); }
+    iterator end() { return landmarks.end(); }
+    const_iterator begin() const { return landmarks.begin(); }
+    const_iterator end() const { return landmarks.end(); }
+    int size() const { return landmarks.size(); }
+    FeaturePerId & operator[](int i) { return landmarks[i]; }
+    const FeaturePerId & operator[](int i) const { return landmarks[i]; }
+
+    void clear();
+
+    FeaturePerId * find(int feature_id)
+    {
+        int slot = index.find(feature_id);
+        return slot < 0 ? nullptr : &landmarks[slot];
+    }
+    const FeaturePerId * find(int feature_id) const
+    {
+        int slot = index.find(feature_id);
+        return slot < 0 ? nullptr : &landmarks[slot];
+    }
+    FeaturePerId & at(int feature_id)
+    {
+        FeaturePerId * it = find(feature_id);
+        ROS_ASSERT(it != nullptr);
+        return *it;
+    }
+
+    // Pointers returned by find are invalidated by insert and removeIf
+    FeaturePerId & insert(int feature_id, int start_frame);
+
+    // Optimizer parameters of the landmarks selected for solving, SIZE_FEATURE doubles per landmark.
+    // Pointers returned by param are invalidated by clearParams and addParam
+    void clearParams();
+    void addParam(FeaturePerId &it_per_id, double inv_depth);
+    int paramNum() const { return para_feature.size() / SIZE_FEATURE; }
+    double * param(const FeaturePerId &it_per_id)
+    {
+        return &para_feature[it_per_id.param_index * SIZE_FEATURE];
+    }
+
+    // Drops every landmark pred returns true for in one pass, the rest keep their order
+    template <typename Pred>
+    void removeIf(Pred pred)
+    {
+        int num = 0;
+        for (int i = 0; i < (int)landmarks.size(); i++)
+        {
+            if (pred(landmarks[i]))
+            {
+                obs_free.push_back(landmarks[i].obs);
+                continue;
+            }
+            if (num != i)
+                landmarks[num] = landmarks[i];
+            num++;
+        }
+        if (num != (int)landmarks.size())
+        {
+            landmarks.erase(landmarks.begin() + num, landmarks.end());
+            rebuildIndex();
+        }
+    }
+
+  private:
+    void rebuildIndex();
+
+    Container landmarks;
+    FlatIdIndex index;
+    std::vector<std::unique_ptr<FeatureObservations>> obs_pool;
+    std::vector<FeatureObservations *> obs_free;
+    std::vector<double> para_feature;
+};
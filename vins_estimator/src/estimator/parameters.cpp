@@ -64,6 +64,7 @@ int MAX_CNT;
 int TOP_PTS_CNT;
 int SIDE_PTS_CNT;
 int MAX_SOLVE_CNT;
+double FEATURE_BUDGET_MS;
 int RGB_DEPTH_CLOUD;
 int ENABLE_DEPTH;
 int ENABLE_PERF_OUTPUT;
@@ -71,6 +72,8 @@ int MIN_DIST;
 double F_THRESHOLD;
 int SHOW_TRACK;
 int FLOW_BACK;
+int USE_SIMD_LK;
+int IMU_BATCH_PUB_ALL;
 
 std::string configPath;
 
@@ -118,6 +121,7 @@ void readParameters(std::string config_file)
     TOP_PTS_CNT = fsSettings["top_cnt"];
     SIDE_PTS_CNT = fsSettings["side_cnt"];
     MAX_SOLVE_CNT = fsSettings["max_solve_cnt"];
+    FEATURE_BUDGET_MS = fsSettings["feature_budget_ms"];
     MIN_DIST = fsSettings["min_dist"];
 
     USE_ORB = fsSettings["use_orb"];
@@ -125,6 +129,7 @@ void readParameters(std::string config_file)
     F_THRESHOLD = fsSettings["F_threshold"];
     SHOW_TRACK = fsSettings["show_track"];
     FLOW_BACK = fsSettings["flow_back"];
+    USE_SIMD_LK = fsSettings["use_simd_lk"];
     RGB_DEPTH_CLOUD = fsSettings["rgb_depth_cloud"];
     ENABLE_DEPTH = fsSettings["enable_depth"];
     ENABLE_DOWNSAMPLE = fsSettings["enable_downsample"];
@@ -159,6 +164,7 @@ void readParameters(std::string config_file)
         GYR_N = fsSettings["gyr_n"];
         GYR_W = fsSettings["gyr_w"];
         G.z() = fsSettings["g_norm"];
+        IMU_BATCH_PUB_ALL = fsSettings["imu_batch_pub_all"];
     }
 
     SOLVER_TIME = fsSettings["max_solver_time"];
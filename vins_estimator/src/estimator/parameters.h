@@ -22,7 +22,6 @@ using namespace std;
 
 const double FOCAL_LENGTH = 460.0;
 const int WINDOW_SIZE = 10;
-const int NUM_OF_F = 1000;
 extern double triangulate_max_err;
 #define UNIT_SPHERE_ERROR
 
@@ -86,11 +85,14 @@ extern int MAX_CNT;
 extern int TOP_PTS_CNT;
 extern int SIDE_PTS_CNT;
 extern int MAX_SOLVE_CNT;
+extern double FEATURE_BUDGET_MS;
 
 extern int MIN_DIST;
 extern double F_THRESHOLD;
 extern int SHOW_TRACK;
 extern int FLOW_BACK;
+extern int USE_SIMD_LK;
+extern int IMU_BATCH_PUB_ALL;
 
 void readParameters(std::string config_file);
 
@@ -60,6 +60,24 @@ class IntegrationBase
             propagate(dt_buf[i], acc_buf[i], gyr_buf[i]);
     }
 
+    // First order update of delta_p, delta_q, delta_v to new biases with the stored bias jacobians.
+    // Returns false if the bias jump is beyond BIAS_ACC_THRESHOLD/BIAS_GYR_THRESHOLD,
+    // in that case the caller should repropagate() to keep the preintegration accurate.
+    bool correctBias(const Eigen::Vector3d &_linearized_ba, const Eigen::Vector3d &_linearized_bg)
+    {
+        Eigen::Vector3d dba = _linearized_ba - linearized_ba;
+        Eigen::Vector3d dbg = _linearized_bg - linearized_bg;
+
+        delta_p += jacobian.block<3, 3>(O_P, O_BA) * dba + jacobian.block<3, 3>(O_P, O_BG) * dbg;
+        delta_q = delta_q * Utility::deltaQ(jacobian.block<3, 3>(O_R, O_BG) * dbg);
+        delta_q.normalize();
+        delta_v += jacobian.block<3, 3>(O_V, O_BA) * dba + jacobian.block<3, 3>(O_V, O_BG) * dbg;
+        linearized_ba = _linearized_ba;
+        linearized_bg = _linearized_bg;
+
+        return dba.norm() <= BIAS_ACC_THRESHOLD && dbg.norm() <= BIAS_GYR_THRESHOLD;
+    }
+
     void midPointIntegration(double _dt, 
                             const Eigen::Vector3d &_acc_0, const Eigen::Vector3d &_gyr_0,
                             const Eigen::Vector3d &_acc_1, const Eigen::Vector3d &_gyr_1,
@@ -84,54 +102,78 @@ class IntegrationBase
             Vector3d w_x = 0.5 * (_gyr_0 + _gyr_1) - linearized_bg;
             Vector3d a_0_x = _acc_0 - linearized_ba;
             Vector3d a_1_x = _acc_1 - linearized_ba;
-            Matrix3d R_w_x, R_a_0_x, R_a_1_x;
-
-            R_w_x<<0, -w_x(2), w_x(1),
-                w_x(2), 0, -w_x(0),
-                -w_x(1), w_x(0), 0;
-            R_a_0_x<<0, -a_0_x(2), a_0_x(1),
-                a_0_x(2), 0, -a_0_x(0),
-                -a_0_x(1), a_0_x(0), 0;
-            R_a_1_x<<0, -a_1_x(2), a_1_x(1),
-                a_1_x(2), 0, -a_1_x(0),
-                -a_1_x(1), a_1_x(0), 0;
-
-            MatrixXd F = MatrixXd::Zero(15, 15);
-            F.block<3, 3>(0, 0) = Matrix3d::Identity();
-            F.block<3, 3>(0, 3) = -0.25 * delta_q.toRotationMatrix() * R_a_0_x * _dt * _dt + 
-                                  -0.25 * result_delta_q.toRotationMatrix() * R_a_1_x * (Matrix3d::Identity() - R_w_x * _dt) * _dt * _dt;
-            F.block<3, 3>(0, 6) = MatrixXd::Identity(3,3) * _dt;
-            F.block<3, 3>(0, 9) = -0.25 * (delta_q.toRotationMatrix() + result_delta_q.toRotationMatrix()) * _dt * _dt;
-            F.block<3, 3>(0, 12) = -0.25 * result_delta_q.toRotationMatrix() * R_a_1_x * _dt * _dt * -_dt;
-            F.block<3, 3>(3, 3) = Matrix3d::Identity() - R_w_x * _dt;
-            F.block<3, 3>(3, 12) = -1.0 * MatrixXd::Identity(3,3) * _dt;
-            F.block<3, 3>(6, 3) = -0.5 * delta_q.toRotationMatrix() * R_a_0_x * _dt + 
-                                  -0.5 * result_delta_q.toRotationMatrix() * R_a_1_x * (Matrix3d::Identity() - R_w_x * _dt) * _dt;
-            F.block<3, 3>(6, 6) = Matrix3d::Identity();
-            F.block<3, 3>(6, 9) = -0.5 * (delta_q.toRotationMatrix() + result_delta_q.toRotationMatrix()) * _dt;
-            F.block<3, 3>(6, 12) = -0.5 * result_delta_q.toRotationMatrix() * R_a_1_x * _dt * -_dt;
-            F.block<3, 3>(9, 9) = Matrix3d::Identity();
-            F.block<3, 3>(12, 12) = Matrix3d::Identity();
-            //cout<<"A"<<endl<<A<<endl;
-
-            MatrixXd V = MatrixXd::Zero(15,18);
-            V.block<3, 3>(0, 0) =  0.25 * delta_q.toRotationMatrix() * _dt * _dt;
-            V.block<3, 3>(0, 3) =  0.25 * -result_delta_q.toRotationMatrix() * R_a_1_x  * _dt * _dt * 0.5 * _dt;
-            V.block<3, 3>(0, 6) =  0.25 * result_delta_q.toRotationMatrix() * _dt * _dt;
-            V.block<3, 3>(0, 9) =  V.block<3, 3>(0, 3);
-            V.block<3, 3>(3, 3) =  0.5 * MatrixXd::Identity(3,3) * _dt;
-            V.block<3, 3>(3, 9) =  0.5 * MatrixXd::Identity(3,3) * _dt;
-            V.block<3, 3>(6, 0) =  0.5 * delta_q.toRotationMatrix() * _dt;
-            V.block<3, 3>(6, 3) =  0.5 * -result_delta_q.toRotationMatrix() * R_a_1_x  * _dt * 0.5 * _dt;
-            V.block<3, 3>(6, 6) =  0.5 * result_delta_q.toRotationMatrix() * _dt;
-            V.block<3, 3>(6, 9) =  V.block<3, 3>(6, 3);
-            V.block<3, 3>(9, 12) = MatrixXd::Identity(3,3) * _dt;
-            V.block<3, 3>(12, 15) = MatrixXd::Identity(3,3) * _dt;
-
-            //step_jacobian = F;
-            //step_V = V;
-            jacobian = F * jacobian;
-            covariance = F * covariance * F.transpose() + V * noise * V.transpose();
+            Matrix3d R_w_x = Utility::skewSymmetric(w_x);
+            Matrix3d R_a_0_x = Utility::skewSymmetric(a_0_x);
+            Matrix3d R_a_1_x = Utility::skewSymmetric(a_1_x);
+
+            const Matrix3d R_0 = delta_q.toRotationMatrix();
+            const Matrix3d R_1 = result_delta_q.toRotationMatrix();
+            const Matrix3d R_0_a_0_x = R_0 * R_a_0_x;
+            const Matrix3d R_1_a_1_x = R_1 * R_a_1_x;
+            const Matrix3d I_w_x = Matrix3d::Identity() - R_w_x * _dt;
+            const double dt2 = _dt * _dt;
+
+            // Non trivial 3x3 blocks of F (15x15), the rest is
+            // F_pp = F_vv = F_baba = F_bgbg = I, F_pv = I * dt, F_rbg = -I * dt
+            const Matrix3d F_pr = -0.25 * R_0_a_0_x * dt2 - 0.25 * R_1_a_1_x * I_w_x * dt2;
+            const Matrix3d F_pba = -0.25 * (R_0 + R_1) * dt2;
+            const Matrix3d F_pbg = 0.25 * R_1_a_1_x * dt2 * _dt;
+            const Matrix3d &F_rr = I_w_x;
+            const Matrix3d F_vr = -0.5 * R_0_a_0_x * _dt - 0.5 * R_1_a_1_x * I_w_x * _dt;
+            const Matrix3d F_vba = -0.5 * (R_0 + R_1) * _dt;
+            const Matrix3d F_vbg = 0.5 * R_1_a_1_x * dt2;
+
+            // Non trivial 3x3 blocks of V (15x18), the gyro noise columns of step 0 and 1 share
+            // the same blocks; V_r_g = 0.5 * I * dt, V_ba_ba = V_bg_bg = I * dt
+            const Matrix3d V_p_a0 = 0.25 * R_0 * dt2;
+            const Matrix3d V_p_g = -0.125 * R_1_a_1_x * dt2 * _dt;
+            const Matrix3d V_p_a1 = 0.25 * R_1 * dt2;
+            const Matrix3d V_v_a0 = 0.5 * R_0 * _dt;
+            const Matrix3d V_v_g = -0.25 * R_1_a_1_x * dt2;
+            const Matrix3d V_v_a1 = 0.5 * R_1 * _dt;
+
+            // jacobian = F * jacobian, covariance = F * covariance * F^T, only touching the P, R, V rows
+            auto applyF = [&](Eigen::Matrix<double, 15, 15> &M)
+            {
+                const Eigen::Matrix<double, 3, 15> M_r = M.middleRows<3>(O_R);
+                const Eigen::Matrix<double, 3, 15> M_v = M.middleRows<3>(O_V);
+                const Eigen::Matrix<double, 3, 15> M_ba = M.middleRows<3>(O_BA);
+                const Eigen::Matrix<double, 3, 15> M_bg = M.middleRows<3>(O_BG);
+                M.middleRows<3>(O_P).noalias() += F_pr * M_r + _dt * M_v + F_pba * M_ba + F_pbg * M_bg;
+                M.middleRows<3>(O_R).noalias() = F_rr * M_r - _dt * M_bg;
+                M.middleRows<3>(O_V).noalias() += F_vr * M_r + F_vba * M_ba + F_vbg * M_bg;
+            };
+
+            applyF(jacobian);
+
+            applyF(covariance);
+            covariance.transposeInPlace();
+            applyF(covariance);
+
+            // V * noise * V^T, noise is block diagonal
+            const Matrix3d N_a0 = noise.block<3, 3>(0, 0);
+            const Matrix3d N_g0 = noise.block<3, 3>(3, 3);
+            const Matrix3d N_a1 = noise.block<3, 3>(6, 6);
+            const Matrix3d N_g1 = noise.block<3, 3>(9, 9);
+            const Matrix3d N_g = N_g0 + N_g1;
+
+            const Matrix3d Q_pp = V_p_a0 * N_a0 * V_p_a0.transpose() + V_p_g * N_g * V_p_g.transpose() + V_p_a1 * N_a1 * V_p_a1.transpose();
+            const Matrix3d Q_pr = 0.5 * _dt * V_p_g * N_g;
+            const Matrix3d Q_pv = V_p_a0 * N_a0 * V_v_a0.transpose() + V_p_g * N_g * V_v_g.transpose() + V_p_a1 * N_a1 * V_v_a1.transpose();
+            const Matrix3d Q_rv = 0.5 * _dt * N_g * V_v_g.transpose();
+            const Matrix3d Q_vv = V_v_a0 * N_a0 * V_v_a0.transpose() + V_v_g * N_g * V_v_g.transpose() + V_v_a1 * N_a1 * V_v_a1.transpose();
+
+            covariance.block<3, 3>(O_P, O_P) += Q_pp;
+            covariance.block<3, 3>(O_P, O_R) += Q_pr;
+            covariance.block<3, 3>(O_R, O_P) += Q_pr.transpose();
+            covariance.block<3, 3>(O_P, O_V) += Q_pv;
+            covariance.block<3, 3>(O_V, O_P) += Q_pv.transpose();
+            covariance.block<3, 3>(O_R, O_R) += 0.25 * dt2 * N_g;
+            covariance.block<3, 3>(O_R, O_V) += Q_rv;
+            covariance.block<3, 3>(O_V, O_R) += Q_rv.transpose();
+            covariance.block<3, 3>(O_V, O_V) += Q_vv;
+            covariance.block<3, 3>(O_BA, O_BA) += dt2 * noise.block<3, 3>(12, 12);
+            covariance.block<3, 3>(O_BG, O_BG) += dt2 * noise.block<3, 3>(15, 15);
         }
 
     }
@@ -279,6 +279,12 @@ void MarginalizationInfo::marginalize()
 
     //TODO
     Eigen::MatrixXd Amm = 0.5 * (A.block(0, 0, m, m) + A.block(0, 0, m, m).transpose());
+    linearizeSchur(Amm, A.block(0, m, m, n), A.block(m, m, n, n), b.segment(0, m), b.segment(m, n));
+}
+
+void MarginalizationInfo::linearizeSchur(const Eigen::MatrixXd &Amm, const Eigen::MatrixXd &Amr, const Eigen::MatrixXd &Arr,
+                                         const Eigen::VectorXd &bmm, const Eigen::VectorXd &brr)
+{
     Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> saes(Amm);
 
     //ROS_ASSERT_MSG(saes.eigenvalues().minCoeff() >= -1e-4, "min eigenvalue %f", saes.eigenvalues().minCoeff());
@@ -286,13 +292,9 @@ void MarginalizationInfo::marginalize()
     Eigen::MatrixXd Amm_inv = saes.eigenvectors() * Eigen::VectorXd((saes.eigenvalues().array() > eps).select(saes.eigenvalues().array().inverse(), 0)).asDiagonal() * saes.eigenvectors().transpose();
     //printf("error1: %f\n", (Amm * Amm_inv - Eigen::MatrixXd::Identity(m, m)).sum());
 
-    Eigen::VectorXd bmm = b.segment(0, m);
-    Eigen::MatrixXd Amr = A.block(0, m, m, n);
-    Eigen::MatrixXd Arm = A.block(m, 0, n, m);
-    Eigen::MatrixXd Arr = A.block(m, m, n, n);
-    Eigen::VectorXd brr = b.segment(m, n);
-    A = Arr - Arm * Amm_inv * Amr;
-    b = brr - Arm * Amm_inv * bmm;
+    Eigen::MatrixXd Arm_Amm_inv = Amr.transpose() * Amm_inv;
+    Eigen::MatrixXd A = Arr - Arm_Amm_inv * Amr;
+    Eigen::VectorXd b = brr - Arm_Amm_inv * bmm;
 
     Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> saes2(A);
     Eigen::VectorXd S = Eigen::VectorXd((saes2.eigenvalues().array() > eps).select(saes2.eigenvalues().array(), 0));
@@ -310,6 +312,53 @@ void MarginalizationInfo::marginalize()
     //      (linearized_jacobians.transpose() * linearized_residuals - b).sum());
 }
 
+// Marginalize the kept block drop_i out of this prior in place.
+// Used when the block is not shared with any other factor (e.g. second new frame),
+// so that re-evaluating the prior and summing up a new A, b is not needed.
+// parameters are the current values of the kept blocks, the prior is relinearized
+// at them the same way preMarginalize() does.
+void MarginalizationInfo::marginalizeKeepBlock(double const *const *parameters, int drop_i)
+{
+    Eigen::VectorXd dx(n);
+    computeDx(parameters, dx);
+    Eigen::VectorXd r = linearized_residuals + linearized_jacobians * dx;
+    Eigen::MatrixXd A = linearized_jacobians.transpose() * linearized_jacobians;
+    Eigen::VectorXd b = linearized_jacobians.transpose() * r;
+
+    int p = keep_block_idx[drop_i] - m;
+    int s = localSize(keep_block_size[drop_i]);
+    int t = n - p - s;
+
+    //Gather the remaining rows/cols around the dropped block
+    Eigen::MatrixXd Amm = 0.5 * (A.block(p, p, s, s) + A.block(p, p, s, s).transpose());
+    Eigen::MatrixXd Amr(s, p + t);
+    Amr.leftCols(p) = A.block(p, 0, s, p);
+    Amr.rightCols(t) = A.block(p, p + s, s, t);
+    Eigen::MatrixXd Arr(p + t, p + t);
+    Arr.topLeftCorner(p, p) = A.topLeftCorner(p, p);
+    Arr.topRightCorner(p, t) = A.block(0, p + s, p, t);
+    Arr.bottomLeftCorner(t, p) = A.block(p + s, 0, t, p);
+    Arr.bottomRightCorner(t, t) = A.bottomRightCorner(t, t);
+    Eigen::VectorXd brr(p + t);
+    brr.head(p) = b.head(p);
+    brr.tail(t) = b.tail(t);
+
+    linearizeSchur(Amm, Amr, Arr, b.segment(p, s), brr);
+
+    int drop_idx = keep_block_idx[drop_i];
+    for (int i = 0; i < static_cast<int>(keep_block_size.size()); i++)
+    {
+        memcpy(keep_block_data[i], parameters[i], sizeof(double) * keep_block_size[i]);
+        if (keep_block_idx[i] > drop_idx)
+            keep_block_idx[i] -= s;
+    }
+    sum_block_size -= keep_block_size[drop_i];
+    keep_block_size.erase(keep_block_size.begin() + drop_i);
+    keep_block_idx.erase(keep_block_idx.begin() + drop_i);
+    keep_block_data.erase(keep_block_data.begin() + drop_i);
+    n -= s;
+}
+
 std::vector<double *> MarginalizationInfo::getParameterBlocks(std::unordered_map<long, double *> &addr_shift)
 {
     std::vector<double *> keep_block_addr;
@@ -332,6 +381,28 @@ std::vector<double *> MarginalizationInfo::getParameterBlocks(std::unordered_map
     return keep_block_addr;
 }
 
+void MarginalizationInfo::computeDx(double const *const *parameters, Eigen::VectorXd &dx) const
+{
+    for (int i = 0; i < static_cast<int>(keep_block_size.size()); i++)
+    {
+        int size = keep_block_size[i];
+        int idx = keep_block_idx[i] - m;
+        Eigen::VectorXd x = Eigen::Map<const Eigen::VectorXd>(parameters[i], size);
+        Eigen::VectorXd x0 = Eigen::Map<const Eigen::VectorXd>(keep_block_data[i], size);
+        if (size != 7)
+            dx.segment(idx, size) = x - x0;
+        else
+        {
+            dx.segment<3>(idx + 0) = x.head<3>() - x0.head<3>();
+            dx.segment<3>(idx + 3) = 2.0 * Utility::positify(Eigen::Quaterniond(x0(6), x0(3), x0(4), x0(5)).inverse() * Eigen::Quaterniond(x(6), x(3), x(4), x(5))).vec();
+            if (!((Eigen::Quaterniond(x0(6), x0(3), x0(4), x0(5)).inverse() * Eigen::Quaterniond(x(6), x(3), x(4), x(5))).w() >= 0))
+            {
+                dx.segment<3>(idx + 3) = 2.0 * -Utility::positify(Eigen::Quaterniond(x0(6), x0(3), x0(4), x0(5)).inverse() * Eigen::Quaterniond(x(6), x(3), x(4), x(5))).vec();
+            }
+        }
+    }
+}
+
 MarginalizationFactor::MarginalizationFactor(MarginalizationInfo* _marginalization_info):marginalization_info(_marginalization_info)
 {
     int cnt = 0;
@@ -357,24 +428,7 @@ bool MarginalizationFactor::Evaluate(double const *const *parameters, double *re
     int n = marginalization_info->n;
     int m = marginalization_info->m;
     Eigen::VectorXd dx(n);
-    for (int i = 0; i < static_cast<int>(marginalization_info->keep_block_size.size()); i++)
-    {
-        int size = marginalization_info->keep_block_size[i];
-        int idx = marginalization_info->keep_block_idx[i] - m;
-        Eigen::VectorXd x = Eigen::Map<const Eigen::VectorXd>(parameters[i], size);
-        Eigen::VectorXd x0 = Eigen::Map<const Eigen::VectorXd>(marginalization_info->keep_block_data[i], size);
-        if (size != 7)
-            dx.segment(idx, size) = x - x0;
-        else
-        {
-            dx.segment<3>(idx + 0) = x.head<3>() - x0.head<3>();
-            dx.segment<3>(idx + 3) = 2.0 * Utility::positify(Eigen::Quaterniond(x0(6), x0(3), x0(4), x0(5)).inverse() * Eigen::Quaterniond(x(6), x(3), x(4), x(5))).vec();
-            if (!((Eigen::Quaterniond(x0(6), x0(3), x0(4), x0(5)).inverse() * Eigen::Quaterniond(x(6), x(3), x(4), x(5))).w() >= 0))
-            {
-                dx.segment<3>(idx + 3) = 2.0 * -Utility::positify(Eigen::Quaterniond(x0(6), x0(3), x0(4), x0(5)).inverse() * Eigen::Quaterniond(x(6), x(3), x(4), x(5))).vec();
-            }
-        }
-    }
+    marginalization_info->computeDx(parameters, dx);
     Eigen::Map<Eigen::VectorXd>(residuals, n) = marginalization_info->linearized_residuals + marginalization_info->linearized_jacobians * dx;
     if (jacobians)
     {
@@ -62,7 +62,9 @@ class MarginalizationInfo
     void addResidualBlockInfo(ResidualBlockInfo *residual_block_info);
     void preMarginalize();
     void marginalize();
+    void marginalizeKeepBlock(double const *const *parameters, int drop_i);
     std::vector<double *> getParameterBlocks(std::unordered_map<long, double *> &addr_shift);
+    void computeDx(double const *const *parameters, Eigen::VectorXd &dx) const;
 
     std::vector<ResidualBlockInfo *> factors;
     int m, n;
@@ -80,6 +82,9 @@ class MarginalizationInfo
     const double eps = 1e-8;
     bool valid;
 
+  private:
+    void linearizeSchur(const Eigen::MatrixXd &Amm, const Eigen::MatrixXd &Amr, const Eigen::MatrixXd &Arr,
+                        const Eigen::VectorXd &bmm, const Eigen::VectorXd &brr);
 };
 
 class MarginalizationFactor : public ceres::CostFunction
@@ -0,0 +1,263 @@
+/*******************************************************
+ * Copyright (C) 2019, Aerial Robotics Group, Hong Kong University of Science and Technology
+ *
+ * This file is part of VINS.
+ *
+ * Licensed under the GNU General Public License v3.0;
+ * you may not use this file except in compliance with the License.
+ *******************************************************/
+
+#include "corner_detector.h"
+#include <cmath>
+#include <algorithm>
+#include <opencv2/features2d/features2d.hpp>
+
+namespace {
+
+// One detector per worker thread, kept across frames
+cv::ORB & workerORB()
+{
+    static thread_local cv::Ptr<cv::ORB> orb = cv::ORB::create();
+    return *orb;
+}
+
+// Strongest keypoints of one region that are clear of the grid points, strongest first. The detector sees the
+// region with a margin of its edge threshold, so keypoints near region borders are not lost
+void detectORBRegion(const cv::Mat & img, const OccupancyGrid & grid, const cv::Rect & region, int quota,
+    std::vector<cv::KeyPoint> & kps)
+{
+    cv::ORB & orb = workerORB();
+    int border = orb.getEdgeThreshold();
+    cv::Rect roi = cv::Rect(region.x - border, region.y - border, region.width + 2 * border, region.height + 2 * border) &
+        cv::Rect(0, 0, img.cols, img.rows);
+
+    orb.setMaxFeatures(quota * ORB_REGION_OVERSAMPLE);
+    orb.detect(img(roi), kps);
+
+    size_t n = 0;
+    for (auto & kp : kps) {
+        kp.pt.x += roi.x;
+        kp.pt.y += roi.y;
+        bool inside = kp.pt.x >= region.x && kp.pt.x < region.x + region.width &&
+                      kp.pt.y >= region.y && kp.pt.y < region.y + region.height;
+        if (inside && grid.isFree(kp.pt)) {
+            kps[n++] = kp;
+        }
+    }
+    kps.resize(n);
+    auto by_response = [](const cv::KeyPoint & a, const cv::KeyPoint & b) {
+        return a.response > b.response;
+    };
+    if ((int)kps.size() > quota) {
+        std::partial_sort(kps.begin(), kps.begin() + quota, kps.end(), by_response);
+        kps.resize(quota);
+    } else {
+        std::sort(kps.begin(), kps.end(), by_response);
+    }
+}
+
+struct Corner
+{
+    float score;
+    cv::Point2f pt;
+};
+
+// Scratch rows for a span of one grid row, sized once per image
+struct SpanBuffers
+{
+    std::vector<float> xx, xy, yy;    // Sobel products, span plus a one pixel ring
+    std::vector<float> hxx, hxy, hyy; // horizontal 3 tap sums
+    std::vector<float> score;
+
+    void resize(int width, int cell)
+    {
+        int n = (width + 2) * (cell + 2);
+        xx.resize(n); xy.resize(n); yy.resize(n);
+        hxx.resize(n); hxy.resize(n); hyy.resize(n);
+        score.resize(width * cell);
+    }
+};
+
+// Twice the smaller eigenvalue of the 3x3 box filtered structure tensor for the pixels [x0, x1) x [y0, y1).
+// The caller keeps the range two pixels inside the image
+void scoreSpan(const cv::Mat & img, int x0, int y0, int x1, int y1, SpanBuffers & buf)
+{
+    int w = x1 - x0 + 2, h = y1 - y0 + 2;
+    for (int r = 0; r < h; r++) {
+        int y = y0 - 1 + r;
+        const uchar * p0 = img.ptr<uchar>(y - 1) + x0 - 1;
+        const uchar * p1 = img.ptr<uchar>(y) + x0 - 1;
+        const uchar * p2 = img.ptr<uchar>(y + 1) + x0 - 1;
+        float * xx = &buf.xx[r * w], * xy = &buf.xy[r * w], * yy = &buf.yy[r * w];
+        #pragma omp simd
+        for (int i = 0; i < w; i++) {
+            float dx = (float)(p0[i + 1] - p0[i - 1]) + 2.0f * (p1[i + 1] - p1[i - 1]) + (float)(p2[i + 1] - p2[i - 1]);
+            float dy = (float)(p2[i - 1] - p0[i - 1]) + 2.0f * (p2[i] - p0[i]) + (float)(p2[i + 1] - p0[i + 1]);
+            xx[i] = dx * dx;
+            xy[i] = dx * dy;
+            yy[i] = dy * dy;
+        }
+    }
+
+    int cw = w - 2, ch = h - 2;
+    for (int r = 0; r < h; r++) {
+        const float * xx = &buf.xx[r * w], * xy = &buf.xy[r * w], * yy = &buf.yy[r * w];
+        float * hxx = &buf.hxx[r * cw], * hxy = &buf.hxy[r * cw], * hyy = &buf.hyy[r * cw];
+        #pragma omp simd
+        for (int i = 0; i < cw; i++) {
+            hxx[i] = xx[i] + xx[i + 1] + xx[i + 2];
+            hxy[i] = xy[i] + xy[i + 1] + xy[i + 2];
+            hyy[i] = yy[i] + yy[i + 1] + yy[i + 2];
+        }
+    }
+
+    for (int r = 0; r < ch; r++) {
+        const float * hxx = &buf.hxx[r * cw], * hxy = &buf.hxy[r * cw], * hyy = &buf.hyy[r * cw];
+        float * score = &buf.score[r * cw];
+        #pragma omp simd
+        for (int i = 0; i < cw; i++) {
+            float a = hxx[i] + hxx[i + cw] + hxx[i + 2 * cw];
+            float b = hxy[i] + hxy[i + cw] + hxy[i + 2 * cw];
+            float c = hyy[i] + hyy[i + cw] + hyy[i + 2 * cw];
+            score[i] = (a + c) - std::sqrt((a - c) * (a - c) + 4.0f * b * b);
+        }
+    }
+}
+
+}
+
+void detectGridCorners(const cv::Mat & img, OccupancyGrid & grid, int max_corners, double quality_level,
+    std::vector<cv::Point2f> & corners)
+{
+    corners.clear();
+    if (max_corners <= 0 || img.empty() || img.type() != CV_8UC1) {
+        return;
+    }
+
+    int cell = grid.cellSize();
+    SpanBuffers buf;
+    buf.resize(img.cols, cell);
+    std::vector<Corner> candidates;
+    cv::Point2f near_pts[9 * OCCUPANCY_CELL_CAP];
+    float min_dist2 = (float)cell * cell;
+    float max_score = 0;
+
+    for (int cy = 0; cy < grid.rows(); cy++) {
+        int y0 = std::max(cy * cell, 2), y1 = std::min((cy + 1) * cell, img.rows - 2);
+        if (y0 >= y1) {
+            continue;
+        }
+        // Runs of free cells are scored together so the kernels see long rows
+        for (int span_begin = 0; span_begin < grid.cols(); ) {
+            if (!grid.cellEmpty(span_begin, cy)) {
+                span_begin++;
+                continue;
+            }
+            int span_end = span_begin + 1;
+            while (span_end < grid.cols() && grid.cellEmpty(span_end, cy)) {
+                span_end++;
+            }
+            int sx0 = std::max(span_begin * cell, 2), sx1 = std::min(span_end * cell, img.cols - 2);
+            if (sx0 < sx1) {
+                scoreSpan(img, sx0, y0, sx1, y1, buf);
+            }
+            int sw = sx1 - sx0;
+
+            for (int cx = span_begin; cx < span_end; cx++) {
+                int x0 = std::max(cx * cell, 2), x1 = std::min((cx + 1) * cell, img.cols - 2);
+                if (x0 >= x1) {
+                    continue;
+                }
+                // Best pixel that is not too close to the points around the cell; the distance is only
+                // checked for pixels that would improve the best score
+                int near_num = grid.neighbors(cx, cy, near_pts);
+                Corner best{0, cv::Point2f()};
+                for (int r = 0; r < y1 - y0; r++) {
+                    const float * score = &buf.score[r * sw + x0 - sx0];
+                    float row_max = 0;
+                    #pragma omp simd reduction(max: row_max)
+                    for (int i = 0; i < x1 - x0; i++) {
+                        row_max = std::max(row_max, score[i]);
+                    }
+                    if (row_max <= best.score) {
+                        continue;
+                    }
+                    for (int i = 0; i < x1 - x0; i++) {
+                        if (score[i] <= best.score) {
+                            continue;
+                        }
+                        cv::Point2f pt(x0 + i, y0 + r);
+                        bool free = true;
+                        for (int k = 0; k < near_num && free; k++) {
+                            float dx = near_pts[k].x - pt.x, dy = near_pts[k].y - pt.y;
+                            free = dx * dx + dy * dy >= min_dist2;
+                        }
+                        if (free) {
+                            best.score = score[i];
+                            best.pt = pt;
+                        }
+                    }
+                }
+                if (best.score > 0) {
+                    candidates.push_back(best);
+                    max_score = std::max(max_score, best.score);
+                }
+            }
+            span_begin = span_end;
+        }
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [](const Corner & a, const Corner & b) {
+        return a.score > b.score;
+    });
+    float thres = max_score * quality_level;
+    for (auto & c : candidates) {
+        if (c.score < thres || (int)corners.size() >= max_corners) {
+            break;
+        }
+        // Neighbouring cells may have picked corners close to each other
+        if (grid.isFree(c.pt)) {
+            grid.add(c.pt);
+            corners.push_back(c.pt);
+        }
+    }
+}
+
+void detectRegionORB(const cv::Mat & img, OccupancyGrid & grid, int max_corners, int cols, int rows,
+    std::vector<cv::Point2f> & corners)
+{
+    corners.clear();
+    if (max_corners <= 0 || img.empty() || img.type() != CV_8UC1 || cols <= 0 || rows <= 0) {
+        return;
+    }
+
+    int regions = cols * rows;
+    int quota = (max_corners + regions - 1) / regions;
+    int region_w = img.cols / cols, region_h = img.rows / rows;
+    std::vector<std::vector<cv::KeyPoint>> kps(regions);
+
+    // The grid is only read until the merge
+    #pragma omp taskloop grainsize(1) shared(img, grid, kps)
+    for (int r = 0; r < regions; r++) {
+        int i = r % cols, j = r / cols;
+        // The last column and row take the remainder of the division
+        int x1 = i == cols - 1 ? img.cols : (i + 1) * region_w;
+        int y1 = j == rows - 1 ? img.rows : (j + 1) * region_h;
+        detectORBRegion(img, grid, cv::Rect(i * region_w, j * region_h, x1 - i * region_w, y1 - j * region_h),
+            quota, kps[r]);
+    }
+
+    for (int rank = 0; rank < quota && (int)corners.size() < max_corners; rank++) {
+        for (int r = 0; r < regions && (int)corners.size() < max_corners; r++) {
+            if (rank >= (int)kps[r].size()) {
+                continue;
+            }
+            // Keypoints of neighbouring regions may be close to each other
+            const cv::Point2f & pt = kps[r][rank].pt;
+            if (grid.isFree(pt)) {
+                grid.add(pt);
+                corners.push_back(pt);
+            }
+        }
+    }
+}
@@ -0,0 +1,33 @@
+/*******************************************************
+ * Copyright (C) 2019, Aerial Robotics Group, Hong Kong University of Science and Technology
+ *
+ * This file is part of VINS.
+ *
+ * Licensed under the GNU General Public License v3.0;
+ * you may not use this file except in compliance with the License.
+ *******************************************************/
+
+#pragma once
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#include "occupancy_grid.h"
+
+// ORB candidates asked for per region, in multiples of its quota; some fall outside the region or next to a point
+#define ORB_REGION_OVERSAMPLE 3
+
+// Shi-Tomasi corners of a CV_8UC1 image, at most one per cell of the occupancy grid.
+// Cells that already hold a point are not scored at all, and the min distance to the points of the grid
+// and between the new corners is checked on the grid instead of a mask. The new corners are added to the grid.
+// Like cv::goodFeaturesToTrack, corners weaker than quality_level times the strongest one are dropped,
+// the strongest here being taken over the scored cells only.
+void detectGridCorners(const cv::Mat & img, OccupancyGrid & grid, int max_corners, double quality_level,
+    std::vector<cv::Point2f> & corners);
+
+// ORB keypoints of a CV_8UC1 image split into cols x rows regions, each region with an equal share of
+// max_corners. The regions are detected in parallel OpenMP tasks, each worker thread with its own persistent
+// detector; every region keeps its strongest keypoints that are clear of the grid points, and the regions are
+// merged rank by rank so a cut at max_corners leaves them all represented. The new corners are added to the grid.
+void detectRegionORB(const cv::Mat & img, OccupancyGrid & grid, int max_corners, int cols, int rows,
+    std::vector<cv::Point2f> & corners);
@@ -0,0 +1,62 @@
+/*******************************************************
+ * Copyright (C) 2019, Aerial Robotics Group, Hong Kong University of Science and Technology
+ *
+ * This file is part of VINS.
+ *
+ * Licensed under the GNU General Public License v3.0;
+ * you may not use this file except in compliance with the License.
+ *******************************************************/
+
+#include "feature_budget.h"
+#include <algorithm>
+#include "../estimator/parameters.h"
+
+void FeatureBudget::reportSolve(double solve_ms, int solved_num)
+{
+    if (FEATURE_BUDGET_MS <= 0)
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    solve_ms_avg = solve_ms_avg < 0 ? solve_ms : solve_ms_avg + FEATURE_BUDGET_SMOOTH * (solve_ms - solve_ms_avg);
+
+    // Shrink on whichever of load and saturation asks for it, grow only when both allow
+    double load_err = 1.0 - solve_ms_avg / FEATURE_BUDGET_MS;
+    double fill_err = FEATURE_BUDGET_FILL - (double)solved_num / std::max(MAX_SOLVE_CNT, 1);
+    double err = std::min(std::max(std::min(load_err, fill_err), -0.5), 0.5);
+    scale = std::min(std::max(scale * (1.0 + FEATURE_BUDGET_GAIN * err), FEATURE_BUDGET_MIN_SCALE), 1.0);
+
+    if (ENABLE_PERF_OUTPUT)
+        ROS_INFO("Feature budget: solve %.1fms solved %d scale %.2f", solve_ms_avg, solved_num, scale);
+}
+
+void FeatureBudget::reportTracks(int stream, int tracked_num, int useful_num)
+{
+    if (FEATURE_BUDGET_MS <= 0 || tracked_num == 0)
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    double u = (double)useful_num / tracked_num;
+    usefulness[stream] = usefulness[stream] < 0 ? u : usefulness[stream] + FEATURE_BUDGET_SMOOTH * (u - usefulness[stream]);
+}
+
+int FeatureBudget::target(int stream, int configured)
+{
+    if (FEATURE_BUDGET_MS <= 0)
+        return configured;
+    std::lock_guard<std::mutex> lock(mutex);
+    double best = 0;
+    for (int s = 0; s < FEATURE_BUDGET_STREAMS; s++)
+        best = std::max(best, usefulness[s]);
+
+    // Until something was solved every stream is equally useful
+    double share = best > 0 && usefulness[stream] >= 0 ? std::max(usefulness[stream] / best, FEATURE_BUDGET_MIN_SCALE) : 1.0;
+    double s = std::max(scale * share, FEATURE_BUDGET_MIN_SCALE);
+    return std::max((int)(configured * s + 0.5), 1);
+}
+
+void FeatureBudget::reset()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    scale = 1.0;
+    solve_ms_avg = -1;
+    for (int s = 0; s < FEATURE_BUDGET_STREAMS; s++)
+        usefulness[s] = -1;
+}
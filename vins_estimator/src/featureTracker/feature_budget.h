@@ -0,0 +1,49 @@
+/*******************************************************
+ * Copyright (C) 2019, Aerial Robotics Group, Hong Kong University of Science and Technology
+ *
+ * This file is part of VINS.
+ *
+ * Licensed under the GNU General Public License v3.0;
+ * you may not use this file except in compliance with the License.
+ *******************************************************/
+
+#pragma once
+
+#include <mutex>
+
+// Streams with their own feature count: up top, down top and up side for the fisheye (the down side follows
+// the up side), the left image for the pinhole
+#define FEATURE_BUDGET_STREAMS 3
+// Lowest share of the configured count a stream is cut to
+#define FEATURE_BUDGET_MIN_SCALE 0.3
+// Step of the scale per solve, relative to the error
+#define FEATURE_BUDGET_GAIN 0.1
+// Fill of the solve (solved landmarks over max_solve_cnt) the controller aims at
+#define FEATURE_BUDGET_FILL 0.95
+// Weight of a new measurement in the solve time and usefulness averages
+#define FEATURE_BUDGET_SMOOTH 0.2
+
+// Feedback controller for the feature counts of the tracker.
+// The backend reports its solve time and how many landmarks the solve kept (solve_flag == 1) after each
+// solve; the counts of all streams are scaled down while the solve takes longer than feature_budget_ms, or
+// while it is saturated, and back up toward the configured ones when it has time and lacks landmarks.
+// The scaled count is split by usefulness, the share of a stream's tracks the backend solved, so a stream
+// whose features never make it to the solve is cut first.
+// The backend reports from its thread and the tracking tasks from theirs, so everything is behind one mutex.
+class FeatureBudget
+{
+  public:
+    void reportSolve(double solve_ms, int solved_num);
+    void reportTracks(int stream, int tracked_num, int useful_num);
+    // Count for the stream, at most the configured one; the configured one when feature_budget_ms is 0
+    int target(int stream, int configured);
+    // Back to the configured counts after the backend restarts
+    void reset();
+
+  private:
+    std::mutex mutex;
+    double scale = 1.0;
+    double solve_ms_avg = -1;
+    // Negative until the stream reports
+    double usefulness[FEATURE_BUDGET_STREAMS] = {-1, -1, -1};
+};
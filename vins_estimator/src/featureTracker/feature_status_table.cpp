@@ -0,0 +1,40 @@
+/*******************************************************
+ * Copyright (C) 2019, Aerial Robotics Group, Hong Kong University of Science and Technology
+ *
+ * This file is part of VINS.
+ *
+ * Licensed under the GNU General Public License v3.0;
+ * you may not use this file except in compliance with the License.
+ *******************************************************/
+
+#include "feature_status_table.h"
+
+const int FeatureStatusTable::CAPACITY;
+
+FeatureStatusTable::FeatureStatusTable():
+    slots(new std::atomic<uint64_t>[CAPACITY])
+{
+    clear();
+}
+
+void FeatureStatusTable::clear()
+{
+    for (int i = 0; i < CAPACITY; i++)
+        slots[i].store(makeEntry(-1, 0), std::memory_order_relaxed);
+}
+
+void FeatureStatusTable::set(int feature_id, int status)
+{
+    if (feature_id < 0)
+        return;
+    std::atomic<uint64_t> &entry = slots[slot(feature_id)];
+    uint64_t old = entry.load(std::memory_order_relaxed);
+    // Ids only grow, a late status of an evicted track must not take the slot back.
+    // Removal is final: a status that arrives for the id afterwards (a triangulation or a solve of a frame
+    // queued before the removal) does not bring the track back
+    while (entryId(old) < feature_id || (entryId(old) == feature_id && entryStatus(old) >= 0))
+    {
+        if (entry.compare_exchange_weak(old, makeEntry(feature_id, status), std::memory_order_relaxed))
+            return;
+    }
+}
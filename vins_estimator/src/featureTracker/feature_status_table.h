@@ -0,0 +1,66 @@
+/*******************************************************
+ * Copyright (C) 2019, Aerial Robotics Group, Hong Kong University of Science and Technology
+ *
+ * This file is part of VINS.
+ *
+ * Licensed under the GNU General Public License v3.0;
+ * you may not use this file except in compliance with the License.
+ *******************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// Fixed capacity feature id -> status table shared by the tracker and the backend.
+// A slot is picked by the low bits of the id and tagged with the whole id, so the high bits act as
+// a generation: the track that reuses the slot of an older, long dead track simply takes it over.
+// A negative status is final for its id, like an entry of the old removed set: later statuses of the same id
+// are ignored and only a newer id can take the slot. The trackers drop a removed track on their next frame,
+// so the removal only has to outlive that frame, far less than the CAPACITY ids it takes to reach the slot again.
+// Each entry is one atomic word, the backend may set statuses while the tracker reads them.
+class FeatureStatusTable
+{
+  public:
+    static const int CAPACITY = 1 << 16;
+
+    FeatureStatusTable();
+    void clear();
+    void set(int feature_id, int status);
+
+    // False if the id has no status yet, or its slot was taken by a newer track
+    bool find(int feature_id, int &status) const
+    {
+        uint64_t entry = slots[slot(feature_id)].load(std::memory_order_relaxed);
+        if (entryId(entry) != feature_id)
+            return false;
+        status = entryStatus(entry);
+        return true;
+    }
+    bool removed(int feature_id) const
+    {
+        int status;
+        return find(feature_id, status) && status < 0;
+    }
+
+  private:
+    static int slot(int feature_id)
+    {
+        return feature_id & (CAPACITY - 1);
+    }
+    static uint64_t makeEntry(int feature_id, int status)
+    {
+        return ((uint64_t)(uint32_t)feature_id << 32) | (uint32_t)status;
+    }
+    static int entryId(uint64_t entry)
+    {
+        return (int)(uint32_t)(entry >> 32);
+    }
+    static int entryStatus(uint64_t entry)
+    {
+        return (int)(uint32_t)entry;
+    }
+
+    std::unique_ptr<std::atomic<uint64_t>[]> slots;
+};
@@ -63,41 +63,71 @@ FeatureTracker::FeatureTracker()
     stereo_cam = 0;
     n_id = 0;
     hasPrediction = false;
+    prev_time = 0;
     sum_n = 0;
 }
 
 
-void FeatureTracker::setMask()
+void FeatureTracker::setMask(int max_pts)
 {
-    mask = cv::Mat(row, col, CV_8UC1, cv::Scalar(255));
+    vector<int> keep;
+    for (unsigned int i = 0; i < ids.size(); i++)
+        if (!pts_status.removed(ids[i]))
+            keep.push_back(i);
+    keepIndices(cur_pts, keep);
+    keepIndices(ids, keep);
+    keepIndices(track_cnt, keep);
 
     // prefer to keep features that are tracked for long time
-    vector<pair<int, pair<cv::Point2f, int>>> cnt_pts_id;
-
-    for (unsigned int i = 0; i < cur_pts.size(); i++)
-        cnt_pts_id.push_back(make_pair(track_cnt[i], make_pair(cur_pts[i], ids[i])));
+    suppressFeatures(grid, cv::Size(col, row), cur_pts, track_cnt, ids, max_pts);
+}
 
-    sort(cnt_pts_id.begin(), cnt_pts_id.end(), [](const pair<int, pair<cv::Point2f, int>> &a, const pair<int, pair<cv::Point2f, int>> &b)
-         {
-            return a.first > b.first;
-         });
+void FeatureTracker::suppressFeatures(OccupancyGrid & grid, cv::Size shape, vector<cv::Point2f> & cur_pts,
+    vector<int> & track_cnt, vector<int> & ids, int max_pts)
+{
+    vector<int> keep;
+    grid.reset(shape, MIN_DIST);
+    grid.suppress(cur_pts, track_cnt, keep, max_pts);
+    keepIndices(cur_pts, keep);
+    keepIndices(ids, keep);
+    keepIndices(track_cnt, keep);
+}
 
-    cur_pts.clear();
-    ids.clear();
-    track_cnt.clear();
+void FeatureTracker::limitTracks(vector<cv::Point2f> & cur_pts, vector<int> & track_cnt, vector<int> & ids, int max_pts)
+{
+    if ((int)cur_pts.size() <= max_pts)
+        return;
+    // Track count of the shortest track that stays; ties are kept in index order
+    vector<int> cnt(track_cnt);
+    std::nth_element(cnt.begin(), cnt.begin() + max_pts - 1, cnt.end(), std::greater<int>());
+    int thres = cnt[max_pts - 1];
+    int above = 0;
+    for (int c : track_cnt)
+        if (c > thres)
+            above++;
+
+    vector<int> keep;
+    int ties = max_pts - above;
+    for (size_t i = 0; i < track_cnt.size(); i++) {
+        if (track_cnt[i] > thres || (track_cnt[i] == thres && ties-- > 0))
+            keep.push_back(i);
+    }
+    keepIndices(cur_pts, keep);
+    keepIndices(ids, keep);
+    keepIndices(track_cnt, keep);
+}
 
-    for (auto &it : cnt_pts_id)
-    {
-        if (removed_pts.find(it.second.second) == removed_pts.end()) {
-            if (mask.at<uchar>(it.second.first) == 255)
-            {
-                cur_pts.push_back(it.second.first);
-                ids.push_back(it.second.second);
-                track_cnt.push_back(it.first);
-                cv::circle(mask, it.second.first, MIN_DIST, 0, -1);
-            }
-        }
+int FeatureTracker::budgetTarget(int stream, const vector<int> & ids, int configured)
+{
+    // Status 3 marks the landmarks the last solve kept
+    int useful = 0;
+    for (int id : ids) {
+        int status;
+        if (pts_status.find(id, status) && status == 3)
+            useful++;
     }
+    feature_budget.reportTracks(stream, ids.size(), useful);
+    return feature_budget.target(stream, configured);
 }
 
 void FeatureTracker::addPoints()
@@ -118,108 +148,41 @@ double distance(cv::Point2f &pt1, cv::Point2f &pt2)
     return sqrt(dx * dx + dy * dy);
 }
 
-void FeatureTracker::drawTrackImage(cv::Mat & img, vector<cv::Point2f> pts, vector<int> ids, map<int, cv::Point2f> prev_pts) {
-    char idtext[10] = {0};
-    for (size_t j = 0; j < pts.size(); j++) {
-        //Not tri
-        //Not solving
-        //Just New point yellow
-        cv::Scalar color = cv::Scalar(0, 255, 255);
-        if (pts_status.find(ids[j]) != pts_status.end()) {
-            int status = pts_status[ids[j]];
-            if (status < 0) {
-                //Removed points
-                color = cv::Scalar(0, 0, 0);
-            }
-
-            if (status == 1) {
-                //Good pt; But not used for solving; Blue 
-                color = cv::Scalar(255, 0, 0);
-            }
-
-            if (status == 2) {
-                //Bad pt; Red
-                color = cv::Scalar(0, 0, 255);
-            }
-
-            if (status == 3) {
-                //Good pt for solving; Green
-                color = cv::Scalar(0, 255, 0);
-            }
-
-        }
-
-        cv::circle(img, pts[j], 1, color, 2);
-
-        sprintf(idtext, "%d", ids[j]);
-	    cv::putText(img, idtext, pts[j] - cv::Point2f(5, 0), cv::FONT_HERSHEY_SIMPLEX, 1, color, 3);
-
-    }
-
-    for (size_t i = 0; i < ids.size(); i++)
-    {
-        int id = ids[i];
-        auto mapIt = prev_pts.find(id);
-        if(mapIt != prev_pts.end()) {
-            cv::arrowedLine(img, pts[i], mapIt->second, cv::Scalar(0, 255, 0), 1, 8, 0, 0.2);
-        }
-    }
-}
-
-
-std::vector<cv::Point2f> detect_orb_by_region(const cv::Mat & _img, const cv::Mat & _mask, int features, int cols = 4, int rows = 4) {
-    int small_width = _img.cols / cols;
-    int small_height = _img.rows / rows;
-    
-    auto _orb = cv::ORB::create(10);
-    std::vector<cv::Point2f> ret;
-    for (int i = 0; i < cols; i ++) {
-        for (int j = 0; j < rows; j ++) {
-            std::vector<cv::KeyPoint> kpts;
-            cv::Rect roi(small_width*i, small_height*j, small_width, small_height);
-            std::cout << "ROI " << roi << "Img " << _img.size() << std::endl;
-            _orb->detect(_img(roi), kpts, _mask(roi));
-            printf("Detected %ld features in reigion (%d, %d)\n", kpts.size(), i, j);
-
-            for (auto kp : kpts) {
-                kp.pt.x = kp.pt.x + small_width*i;
-                kp.pt.y = kp.pt.y + small_width*j;
-                ret.push_back(kp.pt);
-            }
+void FeatureTracker::trackView(TrackView & view, const cv::Mat & img, const vector<cv::Point2f> & pts, const vector<int> & ids,
+    TrackSlots<cv::Point2f> & prev_pts) const
+{
+    view.img = img;
+    view.pts.assign(pts.begin(), pts.end());
+    view.ids.assign(ids.begin(), ids.end());
+    view.status.resize(ids.size());
+    view.prev_pts.resize(ids.size());
+    view.has_prev.resize(ids.size());
+
+    const vector<int> & slot = prev_pts.match(ids);
+    for (size_t i = 0; i < ids.size(); i++) {
+        int status = 0;
+        view.status[i] = pts_status.find(ids[i], status) ? status : 0;
+        view.has_prev[i] = slot[i] >= 0;
+        if (slot[i] >= 0) {
+            view.prev_pts[i] = prev_pts.prev(slot[i]);
         }
     }
-
-    return ret;
 }
 
 
-void FeatureTracker::detectPoints(const cv::Mat & img, const cv::Mat & mask, vector<cv::Point2f> & n_pts, vector<cv::Point2f> & cur_pts, int require_pts) {
+void FeatureTracker::detectPoints(const cv::Mat & img, OccupancyGrid & grid, vector<cv::Point2f> & n_pts, vector<cv::Point2f> & cur_pts, int require_pts) {
     int lack_up_top_pts = require_pts - static_cast<int>(cur_pts.size());
 
     //Add Points Top
     TicToc tic;
     ROS_INFO("Lost %d pts; Require %d will detect %d", lack_up_top_pts, require_pts, lack_up_top_pts > require_pts/4);
     if (lack_up_top_pts > require_pts/4) {
-        if(mask.empty())
-            cout << "mask is empty " << endl;
-        if (mask.type() != CV_8UC1)
-            cout << "mask type wrong " << endl;
-        
         if (!USE_ORB) {
-            cv::Mat d_prevPts;
-            cv::goodFeaturesToTrack(img, d_prevPts, lack_up_top_pts, 0.01, MIN_DIST, mask);
-            if(!d_prevPts.empty()) {
-                n_pts = cv::Mat_<cv::Point2f>(cv::Mat(d_prevPts));
-            }
-            else {
-                n_pts.clear();
-            }
+            detectGridCorners(img, grid, lack_up_top_pts, 0.01, n_pts);
+        } else if (img.cols == img.rows) {
+            detectRegionORB(img, grid, lack_up_top_pts, 4, 4, n_pts);
         } else {
-            if (img.cols == img.rows) {
-                n_pts = detect_orb_by_region(img, mask, lack_up_top_pts, 4, 4);
-            } else {
-                n_pts = detect_orb_by_region(img, mask, lack_up_top_pts, 4, 1);
-            }
+            detectRegionORB(img, grid, lack_up_top_pts, 4, 1, n_pts);
         }
 
     }
@@ -232,48 +195,62 @@ void FeatureTracker::detectPoints(const cv::Mat & img, const cv::Mat & mask, vec
 
  }
 
-void FeatureTracker::setup_feature_frame(FeatureFrame & ff, vector<int> ids, vector<cv::Point2f> cur_pts, vector<cv::Point3f> cur_un_pts, vector<cv::Point3f> cur_pts_vel, int camera_id) {
-    ROS_INFO("Setup feature frame pts %ld un pts %ld vel %ld on Camera %d", cur_pts.size(), cur_un_pts.size(), cur_pts_vel.size(), camera_id);
-    for (size_t i = 0; i < ids.size(); i++)
-    {
-        /*
-        if (ids.size() != cur_pts.size() || ids.size() != cur_un_pts.size() || ids.size() != cur_pts_vel.size()) {
-            ROS_ERROR("Inconsistent vector sizes: ids: %zu, cur_pts: %zu, cur_un_pts: %zu, cur_pts_vel: %zu", 
-            ids.size(), cur_pts.size(), cur_un_pts.size(), cur_pts_vel.size());
-            return; // early return to avoid further processing
-        }
-        */
-        
+void FeatureFrame::reserve(int n)
+{
+    ids.reserve(n);
+    cameras.reserve(n);
+    points.reserve(n);
+    uvs.reserve(n);
+    velocities.reserve(n);
+}
 
-        int feature_id = ids[i];
-        double x, y ,z;
-        x = cur_un_pts[i].x;
-        y = cur_un_pts[i].y;
-        z = cur_un_pts[i].z;
-        double p_u, p_v;
-        p_u = cur_pts[i].x;
-        p_v = cur_pts[i].y;
-        double velocity_x, velocity_y, velocity_z;
-        velocity_x = cur_pts_vel[i].x;
-        velocity_y = cur_pts_vel[i].y;
-        velocity_z = cur_pts_vel[i].z;
-
-        TrackFeatureNoId xyz_uv_velocity;
-        xyz_uv_velocity << x, y, z, p_u, p_v, velocity_x, velocity_y, velocity_z;
-
-        // ROS_INFO("FeaturePts Id %d; Cam %d; pos %f, %f, %f uv %f, %f, vel %f, %f, %f", feature_id, camera_id,
-            // x, y, z, p_u, p_v, velocity_x, velocity_y, velocity_z);
-        ff[feature_id].emplace_back(camera_id,  xyz_uv_velocity);
-    }
- }
+void FeatureFrame::add(int id, int camera, const Eigen::Vector3d &point, const Eigen::Vector2d &uv, const Eigen::Vector3d &velocity)
+{
+    ids.push_back(id);
+    cameras.push_back(camera);
+    points.push_back(point);
+    uvs.push_back(uv);
+    velocities.push_back(velocity);
+}
 
+void FeatureFrame::sortById()
+{
+    if (std::is_sorted(ids.begin(), ids.end()))
+        return;
+
+    vector<int> order(ids.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        return ids[a] < ids[b];
+    });
+
+    FeatureFrame sorted;
+    sorted.reserve(order.size());
+    for (int i : order)
+        sorted.add(ids[i], cameras[i], points[i], uvs[i], velocities[i]);
+    *this = std::move(sorted);
+}
 
-FeatureFrame FeatureTracker::setup_feature_frame() {
-    FeatureFrame ff;
-    setup_feature_frame(ff, ids_up_top, cur_up_top_pts, cur_up_top_un_pts, up_top_vel, 0);   
-    setup_feature_frame(ff, ids_up_side, cur_up_side_pts, cur_up_side_un_pts, up_side_vel, 0);
-    setup_feature_frame(ff, ids_down_top, cur_down_top_pts, cur_down_top_un_pts, down_top_vel, 1);
-    setup_feature_frame(ff, ids_down_side, cur_down_side_pts, cur_down_side_un_pts, down_side_vel, 1);
+FeatureFramePtr FeatureTracker::setup_feature_frame() {
+    // Up top and up side are camera 0, down top and down side camera 1
+    const vector<int> * ids[4] = {&ids_up_top, &ids_up_side, &ids_down_top, &ids_down_side};
+    const vector<cv::Point2f> * pts[4] = {&cur_up_top_pts, &cur_up_side_pts, &cur_down_top_pts, &cur_down_side_pts};
+    const vector<cv::Point3f> * un_pts[4] = {&cur_up_top_un_pts, &cur_up_side_un_pts, &cur_down_top_un_pts, &cur_down_side_un_pts};
+    const vector<cv::Point3f> * vel[4] = {&up_top_vel, &up_side_vel, &down_top_vel, &down_side_vel};
+    const int camera_id[4] = {0, 0, 1, 1};
+
+    auto ff = std::make_shared<FeatureFrame>();
+    ff->reserve(ids_up_top.size() + ids_up_side.size() + ids_down_top.size() + ids_down_side.size());
+    mergeById(ids, 4, [&](int s, int i) {
+        const cv::Point2f & pt = (*pts[s])[i];
+        const cv::Point3f & un_pt = (*un_pts[s])[i];
+        const cv::Point3f & v = (*vel[s])[i];
+        ff->add((*ids[s])[i], camera_id[s], Eigen::Vector3d(un_pt.x, un_pt.y, un_pt.z),
+            Eigen::Vector2d(pt.x, pt.y), Eigen::Vector3d(v.x, v.y, v.z));
+    });
+    ROS_INFO("Setup feature frame up top %ld up side %ld down top %ld down side %ld", ids_up_top.size(),
+        ids_up_side.size(), ids_down_top.size(), ids_down_side.size());
 
     return ff;
 }
@@ -298,6 +275,19 @@ vector<cv::Point3f> FeatureTracker::undistortedPtsTop(vector<cv::Point2f> &pts,
 }
 
 
+// Pyramid LK between two PyramidPool pyramids, through the fixed-point kernel when use_simd_lk is set
+static void pyramidFlow(const vector<cv::Mat> & prev_pyr, const vector<cv::Mat> & cur_pyr,
+    const vector<cv::Point2f> & prev_pts, vector<cv::Point2f> & cur_pts, vector<uchar> & status, int max_level,
+    cv::TermCriteria criteria = cv::TermCriteria(cv::TermCriteria::COUNT+cv::TermCriteria::EPS, 30, 0.01), int flags = 0)
+{
+    if (USE_SIMD_LK) {
+        trackPyramidLK(prev_pyr, cur_pyr, prev_pts, cur_pts, status, WIN_SIZE, max_level, criteria, flags);
+    } else {
+        vector<float> err;
+        cv::calcOpticalFlowPyrLK(prev_pyr, cur_pyr, prev_pts, cur_pts, status, err, WIN_SIZE, max_level, criteria, flags);
+    }
+}
+
 vector<cv::Point2f> FeatureTracker::opticalflow_track(vector<cv::Mat> * cur_pyr, 
                         vector<cv::Mat> * prev_pyr, vector<cv::Point2f> & prev_pts, 
                         vector<int> & ids, vector<int> & track_cnt, vector<cv::Point2f> prediction_points) const {
@@ -309,7 +299,7 @@ vector<cv::Point2f> FeatureTracker::opticalflow_track(vector<cv::Mat> * cur_pyr,
 
     for (size_t i = 0; i < ids.size(); i ++) {
         int _id = ids[i];
-        if (removed_pts.find(_id) == removed_pts.end()) {
+        if (!pts_status.removed(_id)) {
             status.push_back(1);
         } else {
             status.push_back(0);
@@ -326,14 +316,13 @@ vector<cv::Point2f> FeatureTracker::opticalflow_track(vector<cv::Mat> * cur_pyr,
     vector<cv::Point2f> cur_pts;
     TicToc t_og;
     status.clear();
-    vector<float> err;
-    cv::calcOpticalFlowPyrLK(*prev_pyr, *cur_pyr, prev_pts, cur_pts, status, err, WIN_SIZE, PYR_LEVEL);
+    pyramidFlow(*prev_pyr, *cur_pyr, prev_pts, cur_pts, status, PYR_LEVEL);
     std::cout << "Prev pts" << prev_pts.size() << std::endl;    
     if(FLOW_BACK)
     {
         vector<cv::Point2f> reverse_pts;
         vector<uchar> reverse_status;
-        cv::calcOpticalFlowPyrLK(*cur_pyr, *prev_pyr, cur_pts, reverse_pts, reverse_status, err, WIN_SIZE, PYR_LEVEL);
+        pyramidFlow(*cur_pyr, *prev_pyr, cur_pts, reverse_pts, reverse_status, PYR_LEVEL);
 
         for(size_t i = 0; i < status.size(); i++)
         {
@@ -374,7 +363,8 @@ vector<cv::Point2f> FeatureTracker::opticalflow_track(vector<cv::Mat> * cur_pyr,
 
 vector<cv::Point2f> FeatureTracker::opticalflow_track(cv::Mat & cur_img, vector<cv::Mat> * cur_pyr, 
                         cv::Mat & prev_img, vector<cv::Mat> * prev_pyr, vector<cv::Point2f> & prev_pts, 
-                        vector<int> & ids, vector<int> & track_cnt, vector<cv::Point2f> prediction_points) const {
+                        vector<int> & ids, vector<int> & track_cnt, const vector<cv::Point2f> & prediction_points,
+                        bool prediction_confident) const {
     if (prev_pts.size() == 0) {
         return vector<cv::Point2f>();
     }
@@ -383,13 +373,19 @@ vector<cv::Point2f> FeatureTracker::opticalflow_track(cv::Mat & cur_img, vector<
 
     for (size_t i = 0; i < ids.size(); i ++) {
         int _id = ids[i];
-        if (removed_pts.find(_id) == removed_pts.end()) {
+        if (!pts_status.removed(_id)) {
             status.push_back(1);
         } else {
             status.push_back(0);
         }
     }
 
+    vector<cv::Point2f> cur_pts;
+    bool has_prediction = prediction_points.size() == prev_pts.size();
+    if (has_prediction) {
+        cur_pts = prediction_points;
+        reduceVector(cur_pts, status);
+    }
     reduceVector(prev_pts, status);
     reduceVector(ids, status);
     
@@ -397,22 +393,46 @@ vector<cv::Point2f> FeatureTracker::opticalflow_track(cv::Mat & cur_img, vector<
         return vector<cv::Point2f>();
     }
 
-    vector<cv::Point2f> cur_pts;
     TicToc t_og;
     status.clear();
-    vector<float> err;
     
     TicToc t_build;
 
     TicToc t_calc;
-    cv::calcOpticalFlowPyrLK(*prev_pyr, *cur_pyr, prev_pts, cur_pts, status, err, WIN_SIZE, PYR_LEVEL);
+    // A confident prediction leaves only the parallax of the translation to LK, so the coarse levels are skipped
+    bool short_search = has_prediction && prediction_confident;
+    if (has_prediction) {
+        pyramidFlow(*prev_pyr, *cur_pyr, prev_pts, cur_pts, status,
+            short_search ? PREDICT_PYR_LEVEL : PYR_LEVEL,
+            cv::TermCriteria(cv::TermCriteria::COUNT+cv::TermCriteria::EPS, short_search ? PREDICT_LK_ITER : 30, 0.01), 
+            cv::OPTFLOW_USE_INITIAL_FLOW);
+
+        int succ_num = 0;
+        for (size_t i = 0; i < status.size(); i++)
+        {
+            if (status[i])
+                succ_num++;
+        }
+        if (short_search && succ_num < 10) {
+            short_search = false;
+            pyramidFlow(*prev_pyr, *cur_pyr, prev_pts, cur_pts, status, PYR_LEVEL);
+        }
+    } else {
+        pyramidFlow(*prev_pyr, *cur_pyr, prev_pts, cur_pts, status, PYR_LEVEL);
+    }
     // cv::calcOpticalFlowPyrLK(prev_img, cur_img, prev_pts, cur_pts, status, err, WIN_SIZE, PYR_LEVEL);
     // std::cout << "Track img Prev pts" << prev_pts.size() << " TS " << t_calc.toc() << std::endl;    
     if(FLOW_BACK)
     {
         vector<cv::Point2f> reverse_pts;
         vector<uchar> reverse_status;
-        cv::calcOpticalFlowPyrLK(*cur_pyr, *prev_pyr, cur_pts, reverse_pts, reverse_status, err, WIN_SIZE, PYR_LEVEL);
+        if (short_search) {
+            reverse_pts = prev_pts;
+            pyramidFlow(*cur_pyr, *prev_pyr, cur_pts, reverse_pts, reverse_status, PREDICT_PYR_LEVEL,
+                cv::TermCriteria(cv::TermCriteria::COUNT+cv::TermCriteria::EPS, PREDICT_LK_ITER, 0.01), cv::OPTFLOW_USE_INITIAL_FLOW);
+        } else {
+            pyramidFlow(*cur_pyr, *prev_pyr, cur_pts, reverse_pts, reverse_status, PYR_LEVEL);
+        }
         // cv::calcOpticalFlowPyrLK(cur_img, prev_img, cur_pts, reverse_pts, reverse_status, err, WIN_SIZE, PYR_LEVEL);
 
         for(size_t i = 0; i < status.size(); i++)
@@ -455,16 +475,8 @@ vector<cv::Point2f> FeatureTracker::opticalflow_track(cv::Mat & cur_img, vector<
     return cur_pts;
 } 
 
-map<int, cv::Point2f> pts_map(vector<int> ids, vector<cv::Point2f> cur_pts) {
-    map<int, cv::Point2f> prevMap;
-    for (unsigned int i = 0; i < ids.size(); i ++) {
-        prevMap[ids[i]] = cur_pts[i];
-    }
-    return prevMap;
-}
-
 
-FeatureFrame FeatureTracker::trackImage(double _cur_time, const cv::Mat &_img, const cv::Mat &_img1)
+FeatureFramePtr FeatureTracker::trackImage(double _cur_time, const cv::Mat &_img, const cv::Mat &_img1)
 {
     TicToc t_r;
     cur_time = _cur_time;
@@ -664,22 +676,19 @@ FeatureFrame FeatureTracker::trackImage(double _cur_time, const cv::Mat &_img, c
     //rejectWithF();
     ROS_DEBUG("set mask begins");
     TicToc t_m;
-    setMask();
+    int max_cnt = budgetTarget(0, ids, MAX_CNT);
+    setMask(max_cnt);
     // ROS_DEBUG("set mask costs %fms", t_m.toc());
     // printf("set mask costs %fms\n", t_m.toc());
     ROS_DEBUG("detect feature begins");
     
-    int n_max_cnt = MAX_CNT - static_cast<int>(cur_pts.size());
+    int n_max_cnt = max_cnt - static_cast<int>(cur_pts.size());
     if(!USE_GPU)
     {
-        if (n_max_cnt > MAX_CNT/4)
+        if (n_max_cnt > max_cnt/4)
         {
             TicToc t_t;
-            if(mask.empty())
-                cout << "mask is empty " << endl;
-            if (mask.type() != CV_8UC1)
-                cout << "mask type wrong " << endl;
-            cv::goodFeaturesToTrack(cur_img, n_pts, MAX_CNT - cur_pts.size(), 0.01, MIN_DIST, mask);
+            detectGridCorners(cur_img, grid, n_max_cnt, 0.01, n_pts);
         }
         else
             n_pts.clear();
@@ -691,14 +700,10 @@ FeatureFrame FeatureTracker::trackImage(double _cur_time, const cv::Mat &_img, c
     else
     {
 #ifdef USE_CUDA
-        if (n_max_cnt > MAX_CNT/4)
+        if (n_max_cnt > max_cnt/4)
         {
-            if(mask.empty())
-                cout << "mask is empty " << endl;
-            if (mask.type() != CV_8UC1)
-                cout << "mask type wrong " << endl;
-          
-            cv::Ptr<cv::cuda::CornersDetector> detector = cv::cuda::createGoodFeaturesToTrackDetector(cur_gpu_img.type(), MAX_CNT - cur_pts.size(), 0.01, MIN_DIST);
+            grid.drawMask(mask);
+            cv::Ptr<cv::cuda::CornersDetector> detector = cv::cuda::createGoodFeaturesToTrackDetector(cur_gpu_img.type(), n_max_cnt, 0.01, MIN_DIST);
             cv::cuda::GpuMat d_prevPts;
             cv::cuda::GpuMat gpu_mask(mask);
             detector->detect(cur_gpu_img, d_prevPts, gpu_mask);
@@ -725,7 +730,7 @@ FeatureFrame FeatureTracker::trackImage(double _cur_time, const cv::Mat &_img, c
     }
 
     cur_un_pts = undistortedPts(cur_pts, m_camera[0]);
-    pts_velocity = ptsVelocity(ids, cur_un_pts, cur_un_pts_map, prev_un_pts_map);
+    ptsVelocity(ids, cur_un_pts, un_pts_slots, pts_velocity);
 
     if(!_img1.empty() && stereo_cam)
     {
@@ -733,7 +738,6 @@ FeatureFrame FeatureTracker::trackImage(double _cur_time, const cv::Mat &_img, c
         cur_right_pts.clear();
         cur_un_right_pts.clear();
         right_pts_velocity.clear();
-        cur_un_right_pts_map.clear();
         if(!cur_pts.empty())
         {
             //printf("stereo image; track feature on right image\n");
@@ -815,88 +819,49 @@ FeatureFrame FeatureTracker::trackImage(double _cur_time, const cv::Mat &_img, c
             // reduceVector(cur_un_pts, status);
             // reduceVector(pts_velocity, status);
             cur_un_right_pts = undistortedPts(cur_right_pts, m_camera[1]);
-            right_pts_velocity = ptsVelocity(ids_right, cur_un_right_pts, cur_un_right_pts_map, prev_un_right_pts_map);
+            ptsVelocity(ids_right, cur_un_right_pts, un_right_pts_slots, right_pts_velocity);
             
         }
-        prev_un_right_pts_map = cur_un_right_pts_map;
+        // Nothing is stored when the left image has no points, the right camera then starts over
+        un_right_pts_slots.swap();
     }
-    if(SHOW_TRACK)
-        drawTrack(cur_img, rightImg, ids, cur_pts, cur_right_pts, prevLeftPtsMap);
+    if(SHOW_TRACK && track_drawer.wanted())
+        drawTrack(cur_img, rightImg, ids, cur_pts, cur_right_pts, left_pts_slots);
 
     prev_img = cur_img;
 #ifdef USE_CUDA
     prev_gpu_img = cur_gpu_img;
 #endif
     prev_pts = cur_pts;
-    prev_un_pts = cur_un_pts;
-    prev_un_pts_map = cur_un_pts_map;
+    un_pts_slots.swap();
     prev_time = cur_time;
     hasPrediction = false;
 
-    prevLeftPtsMap.clear();
-    for(size_t i = 0; i < cur_pts.size(); i++)
-        prevLeftPtsMap[ids[i]] = cur_pts[i];
-
-    FeatureFrame featureFrame;
-    for (size_t i = 0; i < ids.size(); i++)
+    if(SHOW_TRACK)
     {
-        int feature_id = ids[i];
-        double x, y ,z;
-        x = cur_un_pts[i].x;
-        y = cur_un_pts[i].y;
-        z = 1;
-
-#ifdef UNIT_SPHERE_ERROR
-        Eigen::Vector3d un_pt(x, y, z);
-        un_pt.normalize();
-        x = un_pt.x();
-        y = un_pt.y();
-        z = un_pt.z();
-#endif
-
-        double p_u, p_v;
-        p_u = cur_pts[i].x;
-        p_v = cur_pts[i].y;
-        int camera_id = 0;
-        double velocity_x, velocity_y;
-        velocity_x = pts_velocity[i].x;
-        velocity_y = pts_velocity[i].y;
-
-        TrackFeatureNoId xyz_uv_velocity;
-        xyz_uv_velocity << x, y, z, p_u, p_v, velocity_x, velocity_y, 0;
-        featureFrame[feature_id].emplace_back(camera_id,  xyz_uv_velocity);
+        left_pts_slots.store(ids, cur_pts);
+        left_pts_slots.swap();
     }
 
-    if (!_img1.empty() && stereo_cam)
+    auto featureFrame = std::make_shared<FeatureFrame>();
+    featureFrame->reserve(ids.size() + ids_right.size());
+    auto addPoint = [&](int feature_id, int camera_id, const cv::Point2f & pt, const cv::Point2f & un_pt, const cv::Point2f & vel)
     {
-        for (size_t i = 0; i < ids_right.size(); i++)
-        {
-            int feature_id = ids_right[i];
-            double x, y ,z;
-            x = cur_un_right_pts[i].x;
-            y = cur_un_right_pts[i].y;
-            z = 1;
-
+        Eigen::Vector3d un(un_pt.x, un_pt.y, 1);
 #ifdef UNIT_SPHERE_ERROR
-            Eigen::Vector3d un_pt(x, y, z);
-            un_pt.normalize();
-            x = un_pt.x();
-            y = un_pt.y();
-            z = un_pt.z();
+        un.normalize();
 #endif
-            double p_u, p_v;
-            p_u = cur_right_pts[i].x;
-            p_v = cur_right_pts[i].y;
-            int camera_id = 1;
-            double velocity_x, velocity_y;
-            velocity_x = right_pts_velocity[i].x;
-            velocity_y = right_pts_velocity[i].y;
-
-            TrackFeatureNoId xyz_uv_velocity;
-            xyz_uv_velocity << x, y, z, p_u, p_v, velocity_x, velocity_y, 0;
-            featureFrame[feature_id].emplace_back(camera_id,  xyz_uv_velocity);
-        }
-    }
+        featureFrame->add(feature_id, camera_id, un, Eigen::Vector2d(pt.x, pt.y), Eigen::Vector3d(vel.x, vel.y, 0));
+    };
+    // Left and right ids are both ascending, merged the frame is ordered by id without sorting
+    const vector<int> * streams[2] = {&ids, &ids_right};
+    int stream_num = (!_img1.empty() && stereo_cam) ? 2 : 1;
+    mergeById(streams, stream_num, [&](int s, int i) {
+        if (s == 0)
+            addPoint(ids[i], 0, cur_pts[i], cur_un_pts[i], pts_velocity[i]);
+        else
+            addPoint(ids_right[i], 1, cur_right_pts[i], cur_un_right_pts[i], right_pts_velocity[i]);
+    });
 
     printf("feature track whole time %f PTS %ld\n", t_r.toc(), cur_un_pts.size());
     return featureFrame;
@@ -1007,153 +972,71 @@ vector<cv::Point2f> FeatureTracker::undistortedPts(vector<cv::Point2f> &pts, cam
     return un_pts;
 }
 
-vector<cv::Point3f> FeatureTracker::ptsVelocity3D(vector<int> &ids, vector<cv::Point3f> &cur_pts, 
-                                            map<int, cv::Point3f> &cur_id_pts, map<int, cv::Point3f> &prev_id_pts)
+void FeatureTracker::ptsVelocity3D(const vector<int> &ids, const vector<cv::Point3f> &cur_pts, TrackSlots<cv::Point3f> &slots,
+    vector<cv::Point3f> &pts_velocity)
 {
-    // ROS_INFO("Pts %ld Prev pts %ld IDS %ld", cur_pts.size(), prev_id_pts.size(), ids.size());
-    vector<cv::Point3f> pts_velocity;
-    cur_id_pts.clear();
-    for (unsigned int i = 0; i < ids.size(); i++)
-    {
-        cur_id_pts.insert(make_pair(ids[i], cur_pts[i]));
-    }
+    pts_velocity.assign(cur_pts.size(), cv::Point3f(0, 0, 0));
 
     // caculate points velocity
-    if (!prev_id_pts.empty())
+    if (!slots.empty())
     {
         double dt = cur_time - prev_time;
-        
-        for (unsigned int i = 0; i < cur_pts.size(); i++)
-        {
-            std::map<int, cv::Point3f>::iterator it;
-            it = prev_id_pts.find(ids[i]);
-            if (it != prev_id_pts.end())
-            {
-                double v_x = (cur_pts[i].x - it->second.x) / dt;
-                double v_y = (cur_pts[i].y - it->second.y) / dt;
-                double v_z = (cur_pts[i].z - it->second.z) / dt;
-                pts_velocity.push_back(cv::Point3f(v_x, v_y, v_z));
-                // ROS_INFO("Dt %f, vel %f %f %f", v_x, v_y, v_z);
+        const vector<int> & slot = slots.match(ids);
 
-            }
-            else
-                pts_velocity.push_back(cv::Point3f(0, 0, 0));
+        // Previous positions go into the output first, new tracks are differenced against themselves
+        for (unsigned int i = 0; i < cur_pts.size(); i++)
+            pts_velocity[i] = slot[i] >= 0 ? slots.prev(slot[i]) : cur_pts[i];
 
-        }
-    }
-    else
-    {
+        #pragma omp simd
         for (unsigned int i = 0; i < cur_pts.size(); i++)
         {
-            pts_velocity.push_back(cv::Point3f(0, 0, 0));
+            pts_velocity[i].x = (cur_pts[i].x - pts_velocity[i].x) / dt;
+            pts_velocity[i].y = (cur_pts[i].y - pts_velocity[i].y) / dt;
+            pts_velocity[i].z = (cur_pts[i].z - pts_velocity[i].z) / dt;
         }
     }
-    return pts_velocity;
+
+    slots.store(ids, cur_pts);
 }
 
-vector<cv::Point2f> FeatureTracker::ptsVelocity(vector<int> &ids, vector<cv::Point2f> &pts, 
-                                            map<int, cv::Point2f> &cur_id_pts, map<int, cv::Point2f> &prev_id_pts)
+void FeatureTracker::ptsVelocity(const vector<int> &ids, const vector<cv::Point2f> &pts, TrackSlots<cv::Point2f> &slots,
+    vector<cv::Point2f> &pts_velocity)
 {
-    vector<cv::Point2f> pts_velocity;
-    cur_id_pts.clear();
-    for (unsigned int i = 0; i < ids.size(); i++)
-    {
-        cur_id_pts.insert(make_pair(ids[i], pts[i]));
-    }
+    pts_velocity.assign(pts.size(), cv::Point2f(0, 0));
 
     // caculate points velocity
-    if (!prev_id_pts.empty())
+    if (!slots.empty())
     {
         double dt = cur_time - prev_time;
-        
+        const vector<int> & slot = slots.match(ids);
+
         for (unsigned int i = 0; i < pts.size(); i++)
-        {
-            std::map<int, cv::Point2f>::iterator it;
-            it = prev_id_pts.find(ids[i]);
-            if (it != prev_id_pts.end())
-            {
-                double v_x = (pts[i].x - it->second.x) / dt;
-                double v_y = (pts[i].y - it->second.y) / dt;
-                pts_velocity.push_back(cv::Point2f(v_x, v_y));
-            }
-            else
-                pts_velocity.push_back(cv::Point2f(0, 0));
+            pts_velocity[i] = slot[i] >= 0 ? slots.prev(slot[i]) : pts[i];
 
-        }
-    }
-    else
-    {
-        for (unsigned int i = 0; i < cur_pts.size(); i++)
+        #pragma omp simd
+        for (unsigned int i = 0; i < pts.size(); i++)
         {
-            pts_velocity.push_back(cv::Point2f(0, 0));
+            pts_velocity[i].x = (pts[i].x - pts_velocity[i].x) / dt;
+            pts_velocity[i].y = (pts[i].y - pts_velocity[i].y) / dt;
         }
     }
-    return pts_velocity;
+
+    slots.store(ids, pts);
 }
 
 void FeatureTracker::drawTrack(const cv::Mat &imLeft, const cv::Mat &imRight, 
                                vector<int> &curLeftIds,
                                vector<cv::Point2f> &curLeftPts, 
                                vector<cv::Point2f> &curRightPts,
-                               map<int, cv::Point2f> &prevLeftPtsMap)
+                               TrackSlots<cv::Point2f> &prevLeftPts)
 {
-    //int rows = imLeft.rows;
-    int cols = imLeft.cols;
-    if (!imRight.empty() && stereo_cam)
-        cv::hconcat(imLeft, imRight, imTrack);
-    else
-        imTrack = imLeft.clone();
-
-    // cv::cvtColor(imTrack, imTrack, CV_GRAY2RGB);
-
-    drawTrackImage(imTrack, curLeftPts, curLeftIds, prevLeftPtsMap);
-
-    // for (size_t j = 0; j < curLeftPts.size(); j++)
-    // {
-    //     double len = std::min(1.0, 1.0 * track_cnt[j] / 20);
-    //     if(ENABLE_DOWNSAMPLE) {
-    //         cv::circle(imTrack, curLeftPts[j]*2, 2, cv::Scalar(255 * (1 - len), 0, 255 * len), 2);
-    //     } else {
-    //         cv::circle(imTrack, curLeftPts[j], 2, cv::Scalar(255 * (1 - len), 0, 255 * len), 2);
-    //     }
-    // }
-    if (!imRight.empty() && stereo_cam)
-    {
-        for (size_t i = 0; i < curRightPts.size(); i++)
-        {
-            if(ENABLE_DOWNSAMPLE) {
-                cv::Point2f rightPt = curRightPts[i]*2;
-                rightPt.x += cols;
-                cv::circle(imTrack, rightPt, 2, cv::Scalar(0, 255, 0), 2);
-            } else {
-                cv::Point2f rightPt = curRightPts[i];
-                rightPt.x += cols;
-                cv::circle(imTrack, rightPt, 2, cv::Scalar(0, 255, 0), 2);
-            }
-            //cv::Point2f leftPt = curLeftPtsTrackRight[i];
-            //cv::line(imTrack, leftPt, rightPt, cv::Scalar(0, 255, 0), 1, 8, 0);
-        }
-    }
-    
-    // map<int, cv::Point2f>::iterator mapIt;
-    // for (size_t i = 0; i < curLeftIds.size(); i++)
-    // {
-    //     int id = curLeftIds[i];
-    //     mapIt = prevLeftPtsMap.find(id);
-    //     if(mapIt != prevLeftPtsMap.end())
-    //     {
-    //         if(ENABLE_DOWNSAMPLE) {
-    //             cv::arrowedLine(imTrack, curLeftPts[i]*2, mapIt->second*2, cv::Scalar(0, 255, 0), 1, 8, 0, 0.2);
-    //         } else {
-    //             cv::arrowedLine(imTrack, curLeftPts[i], mapIt->second, cv::Scalar(0, 255, 0), 1, 8, 0, 0.2);
-    //         }
-    //     }
-    // }
-
-
-
-    cv::imshow("Track", imTrack);
-    cv::waitKey(2);
+    track_job.t = cur_time;
+    track_job.fisheye = false;
+    track_job.stereo = stereo_cam;
+    trackView(track_job.views[0], imLeft, curLeftPts, curLeftIds, prevLeftPts);
+    track_job.views[1].img = imRight;
+    track_job.right_pts.assign(curRightPts.begin(), curRightPts.end());
+    track_drawer.submit(track_job);
 }
 
 
@@ -1199,8 +1082,3 @@ void FeatureTracker::removeOutliers(set<int> &removePtsIds)
     reduceVector(track_cnt, status);
 }
 
-
-cv::Mat FeatureTracker::getTrackImage()
-{
-    return imTrack;
-}
@@ -14,10 +14,12 @@
 #include <cstdio>
 #include <iostream>
 #include <queue>
+#include <memory>
 #include <execinfo.h>
 #include <csignal>
 #include <opencv2/opencv.hpp>
 #include <eigen3/Eigen/Dense>
+#include <eigen3/Eigen/StdVector>
 
 #include "../utility/opencv_cuda.h"
 
@@ -26,6 +28,15 @@
 #include "camodocal/camera_models/PinholeCamera.h"
 #include "../estimator/parameters.h"
 #include "../utility/tic_toc.h"
+#include "feature_status_table.h"
+#include "pyramid_pool.h"
+#include "stage_trace.h"
+#include "corner_detector.h"
+#include "pyramid_lk.h"
+#include "track_slots.h"
+#include "gyro_predictor.h"
+#include "feature_budget.h"
+#include "track_drawer.h"
 
 #ifdef WITH_VWORKS
 #include "vworks_feature_tracker.hpp"
@@ -33,6 +44,9 @@
 
 #define PYR_LEVEL 3
 #define WIN_SIZE cv::Size(21, 21)
+// LK from a gyro-predicted position
+#define PREDICT_PYR_LEVEL 1
+#define PREDICT_LK_ITER 10
 
 using namespace std;
 using namespace camodocal;
@@ -44,49 +58,105 @@ bool inBorder(const cv::Point2f &pt, cv::Size shape);
 void reduceVector(vector<cv::Point2f> &v, vector<uchar> status);
 void reduceVector(vector<int> &v, vector<uchar> status);
 
-typedef Eigen::Matrix<double, 8, 1> TrackFeatureNoId;
-typedef pair<int, TrackFeatureNoId> TrackFeature;
-typedef vector<TrackFeature> FeatureFramenoId;
-typedef map<int, FeatureFramenoId> FeatureFrame;
+// Keeps the entries at the given ascending indices, in place
+template <typename T>
+void keepIndices(vector<T> &v, const vector<int> &keep)
+{
+    for (size_t i = 0; i < keep.size(); i++)
+        v[i] = v[keep[i]];
+    v.resize(keep.size());
+}
+
+// Visits the points of up to four streams in ascending id order, calling visit(stream, index).
+// Every stream must have ascending ids, which the trackers keep by only ever dropping points
+// and appending new ids. Equal ids are visited in stream order.
+template <typename Visit>
+void mergeById(const vector<int> * const * streams, int num, Visit visit)
+{
+    size_t pos[4] = {0, 0, 0, 0};
+    while (true)
+    {
+        int best = -1;
+        for (int s = 0; s < num; s++)
+        {
+            if (pos[s] < streams[s]->size() && (best < 0 || (*streams[s])[pos[s]] < (*streams[best])[pos[best]]))
+                best = s;
+        }
+        if (best < 0)
+            return;
+        visit(best, pos[best]++);
+    }
+}
+
+// Features of one image as parallel arrays, one entry per observation, ordered by feature id.
+// A feature seen by both cameras has its camera 0 observation first.
+// The tracker fills it once and hands it to the backend through a shared pointer, it is never copied
+class FeatureFrame
+{
+  public:
+    vector<int> ids;
+    vector<int> cameras;
+    vector<Eigen::Vector3d> points; // undistorted bearing vectors
+    vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d>> uvs;
+    vector<Eigen::Vector3d> velocities;
+
+    int size() const { return ids.size(); }
+    void reserve(int n);
+    void add(int id, int camera, const Eigen::Vector3d &point, const Eigen::Vector2d &uv, const Eigen::Vector3d &velocity);
+    // Stable, the observations of one feature keep their insertion order.
+    // The trackers fill the frame in id order, this is for frames that come from elsewhere
+    void sortById();
+};
+typedef std::shared_ptr<const FeatureFrame> FeatureFramePtr;
 class Estimator;
 class FisheyeUndist;
-map<int, cv::Point2f> pts_map(vector<int> ids, vector<cv::Point2f> cur_pts);
 
 class FeatureTracker
 {
 public:
     Estimator * estimator = nullptr;
     FeatureTracker();
-    FeatureFrame trackImage(double _cur_time, const cv::Mat &_img, const cv::Mat &_img1 = cv::Mat());
+    FeatureFramePtr trackImage(double _cur_time, const cv::Mat &_img, const cv::Mat &_img1 = cv::Mat());
 
-    FeatureFrame trackImage_fisheye(double _cur_time, const std::vector<cv::Mat> & fisheye_imgs_up, const std::vector<cv::Mat> & fisheye_imgs_down);
+    FeatureFramePtr trackImage_fisheye(double _cur_time, const std::vector<cv::Mat> & fisheye_imgs_up, const std::vector<cv::Mat> & fisheye_imgs_down);
 
 #ifdef USE_CUDA
-    FeatureFrame trackImage_fisheye(double _cur_time, 
+    FeatureFramePtr trackImage_fisheye(double _cur_time, 
         const std::vector<cv::cuda::GpuMat> & fisheye_imgs_up, 
         const std::vector<cv::cuda::GpuMat> & fisheye_imgs_down, bool is_blank_init = false);
 
     vector<cv::Point2f> opticalflow_track(cv::cuda::GpuMat & cur_img, 
                         std::vector<cv::cuda::GpuMat> & prev_pyr, vector<cv::Point2f> & prev_pts, 
                         vector<int> & ids, vector<int> & track_cnt,
-                        bool is_lr_track, vector<cv::Point2f> prediction_points = vector<cv::Point2f>());
+                        bool is_lr_track, const vector<cv::Point2f> & prediction_points = vector<cv::Point2f>(),
+                        bool prediction_confident = false);
 #endif
     
     vector<cv::Point2f> opticalflow_track(vector<cv::Mat> * cur_pyr, 
                         vector<cv::Mat> * prev_pyr, vector<cv::Point2f> & prev_pts, 
                         vector<int> & ids, vector<int> & track_cnt, vector<cv::Point2f> prediction_points = vector<cv::Point2f>()) const;
 
+    // LK starts from prediction_points when there is one for every point
     vector<cv::Point2f> opticalflow_track(cv::Mat & cur_img, vector<cv::Mat> * cur_pyr, 
                         cv::Mat & prev_img, vector<cv::Mat> * prev_pyr, vector<cv::Point2f> & prev_pts, 
-                        vector<int> & ids, vector<int> & track_cnt, vector<cv::Point2f> prediction_points = vector<cv::Point2f>()) const;
+                        vector<int> & ids, vector<int> & track_cnt, const vector<cv::Point2f> & prediction_points = vector<cv::Point2f>(),
+                        bool prediction_confident = false) const;
 
-    void setMask();
+    void setMask(int max_pts);
     void setMaskFisheye();
-    cv::Mat setMaskFisheye(cv::Size shape, vector<cv::Point2f> & cur_pts, vector<int> & track_cnt, vector<int> & ids);
+    // Keeps the features min_dist apart, longest tracks first, and at most max_pts of them
+    void suppressFeatures(OccupancyGrid & grid, cv::Size shape, vector<cv::Point2f> & cur_pts, vector<int> & track_cnt, vector<int> & ids,
+        int max_pts = INT_MAX);
+    // Keeps the max_pts longest tracks, for the trackers that do not suppress on the grid
+    void limitTracks(vector<cv::Point2f> & cur_pts, vector<int> & track_cnt, vector<int> & ids, int max_pts);
+    // Reports the stream's tracks to the feature budget and returns the feature count it allows
+    int budgetTarget(int stream, const vector<int> & ids, int configured);
     void setMaskFisheye(cv::cuda::GpuMat & mask, cv::Size shape, vector<cv::Point2f> & cur_pts, 
         vector<int> & track_cnt, vector<int> & ids);
     void addPoints();
     void addPointsFisheye();
+    void addPointsFisheye(const vector<cv::Point2f> & n_pts, vector<cv::Point2f> & cur_pts,
+        vector<int> & ids, vector<int> & track_cnt);
     void readIntrinsicParameter(const vector<string> &calib_file);
     void showUndistortion(const string &name);
     void rejectWithF();
@@ -94,12 +164,13 @@ public:
     vector<cv::Point2f> undistortedPts(vector<cv::Point2f> &pts, camodocal::CameraPtr cam);
     vector<cv::Point3f> undistortedPtsTop(vector<cv::Point2f> &pts, FisheyeUndist & fisheye);
     vector<cv::Point3f> undistortedPtsSide(vector<cv::Point2f> &pts, FisheyeUndist & fisheye, bool is_downward);
+    // Where the points move in the flattened images when the camera rotates by R (see GyroPredictor::predict)
+    vector<cv::Point2f> predictPtsTop(const vector<cv::Point2f> &pts, FisheyeUndist & fisheye, const Eigen::Matrix3d & R) const;
+    vector<cv::Point2f> predictPtsSide(const vector<cv::Point2f> &pts, FisheyeUndist & fisheye, const Eigen::Matrix3d & R, bool is_downward) const;
 
-    vector<cv::Point2f> ptsVelocity(vector<int> &ids, vector<cv::Point2f> &pts, 
-                                    map<int, cv::Point2f> &cur_id_pts, map<int, cv::Point2f> &prev_id_pts);
+    void ptsVelocity(const vector<int> &ids, const vector<cv::Point2f> &pts, TrackSlots<cv::Point2f> &slots, vector<cv::Point2f> &pts_velocity);
 
-    vector<cv::Point3f> ptsVelocity3D(vector<int> &ids, vector<cv::Point3f> &pts, 
-                                    map<int, cv::Point3f> &cur_id_pts, map<int, cv::Point3f> &prev_id_pts);
+    void ptsVelocity3D(const vector<int> &ids, const vector<cv::Point3f> &pts, TrackSlots<cv::Point3f> &slots, vector<cv::Point3f> &pts_velocity);
 
     void showTwoImage(const cv::Mat &img1, const cv::Mat &img2, 
                       vector<cv::Point2f> pts1, vector<cv::Point2f> pts2);
@@ -107,10 +178,9 @@ public:
                     vector<int> &curLeftIds,
                     vector<cv::Point2f> &curLeftPts, 
                     vector<cv::Point2f> &curRightPts,
-                    map<int, cv::Point2f> &prevLeftPtsMap);
+                    TrackSlots<cv::Point2f> &prevLeftPts);
     
-    void setup_feature_frame(FeatureFrame & ff, vector<int> ids, vector<cv::Point2f> cur_pts, vector<cv::Point3f> cur_un_pts, vector<cv::Point3f> cur_pts_vel, int camera_id);
-    FeatureFrame setup_feature_frame();
+    FeatureFramePtr setup_feature_frame();
     
 #ifdef USE_CUDA
     void drawTrackFisheye(const cv::Mat & img_up, const cv::Mat & img_down, 
@@ -126,11 +196,12 @@ public:
                             cv::Mat imUpSide, 
                             cv::Mat imDownSide);
 
-    void drawTrackImage(cv::Mat & img, vector<cv::Point2f> pts, vector<int> ids, map<int, cv::Point2f> prev_pts);
+    // Copies the points of one image and their previous positions for the drawing thread
+    void trackView(TrackView & view, const cv::Mat & img, const vector<cv::Point2f> & pts, const vector<int> & ids,
+        TrackSlots<cv::Point2f> & prev_pts) const;
 
     void setPrediction(map<int, Eigen::Vector3d> &predictPts);
     void removeOutliers(set<int> &removePtsIds);
-    cv::Mat getTrackImage();
     bool inBorder(const cv::Point2f &pt);
     bool inBorder(const cv::Point2f &pt, cv::Size shape) const;
 
@@ -139,20 +210,20 @@ public:
     void detectPoints(const cv::cuda::GpuMat & img, vector<cv::Point2f> & n_pts, 
         vector<cv::Point2f> & cur_pts, int require_pts);
 
-    void detectPoints(const cv::Mat & img, const cv::Mat & mask, vector<cv::Point2f> & n_pts, vector<cv::Point2f> & cur_pts, int require_pts);
+    void detectPoints(const cv::Mat & img, OccupancyGrid & grid, vector<cv::Point2f> & n_pts, vector<cv::Point2f> & cur_pts, int require_pts);
 
     void setFeatureStatus(int feature_id, int status) {
-        this->pts_status[feature_id] = status;
-        if (status < 0) {
-            removed_pts.insert(feature_id);
-        }
+        pts_status.set(feature_id, status);
     }
 
     int row, col;
-    cv::Mat imTrack;
     cv::Mat mask;
+    // Kept tracks and new features, MIN_DIST apart
+    OccupancyGrid grid;
 
+    // Raster masks for the VisionWorks detector only
     cv::Mat mask_up_top, mask_down_top, mask_up_side;
+    OccupancyGrid grid_up_top, grid_down_top, grid_up_side;
     cv::Size top_size;
     cv::Size side_size;
     
@@ -165,7 +236,9 @@ public:
     std::vector<cv::cuda::GpuMat> prev_up_top_pyr_cuda, prev_down_top_pyr_cuda, prev_up_side_pyr_cuda;
 
     cv::Mat prev_up_top_img_cpu, prev_down_top_img_cpu, prev_up_side_img_cpu;
-    std::vector<cv::Mat> * prev_up_top_pyr = nullptr, * prev_down_top_pyr = nullptr, * prev_up_side_pyr = nullptr;
+    // The down side pyramid is only tracked against the up side one of the same frame, its second buffer stays unused
+    PyramidPool up_top_pyrs, down_top_pyrs, up_side_pyrs, down_side_pyrs;
+    StageTrace stage_trace;
 
     vector<cv::Point2f> n_pts;
     vector<cv::Point2f> n_pts_up_top, n_pts_down_top, n_pts_up_side;
@@ -174,28 +247,24 @@ public:
     vector<cv::Point2f> predict_pts;
     vector<cv::Point2f> predict_pts_debug;
     vector<cv::Point2f> prev_pts, cur_pts, cur_right_pts;
-    vector<cv::Point2f> prev_un_pts, cur_un_pts, cur_un_right_pts;
+    vector<cv::Point2f> cur_un_pts, cur_un_right_pts;
     vector<cv::Point2f> pts_velocity, right_pts_velocity;
     vector<int> ids, ids_right;
     vector<int> pts_img_id, pts_img_id_right;
-    map<int, int> pts_status;
+    // Negative status marks the points removed by the backend
+    FeatureStatusTable pts_status;
 
 
     vector<cv::Point2f> predict_up_side, predict_pts_left_top, predict_pts_right_top, predict_pts_down_side;
     vector<cv::Point2f> prev_up_top_pts, cur_up_top_pts, prev_up_side_pts, cur_up_side_pts, prev_down_top_pts, prev_down_side_pts;
     
-    vector<cv::Point3f> prev_up_top_un_pts,  prev_up_side_un_pts, prev_down_top_un_pts, prev_down_side_un_pts;
     vector<cv::Point2f> cur_down_top_pts, cur_down_side_pts;
 
     vector<cv::Point3f> up_top_vel, up_side_vel, down_top_vel, down_side_vel;
     vector<cv::Point3f> cur_up_top_un_pts, cur_up_side_un_pts, cur_down_top_un_pts, cur_down_side_un_pts;
 
     vector<int> ids_up_top, ids_up_side, ids_down_top, ids_down_side;
-    map<int, cv::Point2f> up_top_prevLeftPtsMap;
-    map<int, cv::Point2f> down_top_prevLeftPtsMap;
-    map<int, cv::Point2f> up_side_prevLeftPtsMap;
-    map<int, cv::Point2f> down_side_prevLeftPtsMap;
-    set<int> removed_pts;
+    TrackSlots<cv::Point2f> up_top_pts_slots, down_top_pts_slots, up_side_pts_slots, down_side_pts_slots;
 
 
     // vector<cv::Point2f> prev_un_pts, cur_un_pts, cur_un_right_pts;
@@ -208,15 +277,9 @@ public:
     vector<int> track_down_top_cnt;
     vector<int> track_up_side_cnt;
     vector<int> track_down_side_cnt;
-    map<int, cv::Point2f> cur_un_pts_map, prev_un_pts_map;
-    map<int, cv::Point2f> cur_un_right_pts_map, prev_un_right_pts_map;
-
-    map<int, cv::Point3f> cur_up_top_un_pts_map, prev_up_top_un_pts_map;
-    map<int, cv::Point3f> cur_down_top_un_pts_map, prev_down_top_un_pts_map;
-    map<int, cv::Point3f> cur_up_side_un_pts_map, prev_up_side_un_pts_map;
-    map<int, cv::Point3f> cur_down_side_un_pts_map, prev_down_side_un_pts_map;
-
-    map<int, cv::Point2f> prevLeftPtsMap;
+    TrackSlots<cv::Point2f> un_pts_slots, un_right_pts_slots;
+    TrackSlots<cv::Point3f> up_top_un_pts_slots, down_top_un_pts_slots, up_side_un_pts_slots, down_side_un_pts_slots;
+    TrackSlots<cv::Point2f> left_pts_slots;
     vector<camodocal::CameraPtr> m_camera;
     vector<FisheyeUndist> fisheys_undists;
     double cur_time;
@@ -225,6 +288,14 @@ public:
     int n_id;
     bool hasPrediction;
 
+    // Fed by the estimator, the fisheye tracker predicts the flow from the rotation since the last frame
+    GyroPredictor gyro_predictor;
+    // Fed by the estimator after each solve, scales the feature counts to the backend load
+    FeatureBudget feature_budget;
+    // show_track images are drawn and published off the tracking thread
+    TrackDrawer track_drawer;
+    TrackDrawJob track_job;
+
 #ifdef WITH_VWORKS
     cv::cuda::GpuMat up_side_img_fix;
     cv::cuda::GpuMat down_side_img_fix;
@@ -248,7 +319,7 @@ public:
     nvx::FeatureTracker* tracker_down_side = nullptr;
 
     void init_vworks_tracker(cv::cuda::GpuMat & up_top_img, cv::cuda::GpuMat & down_top_img, cv::cuda::GpuMat & up_side_img, cv::cuda::GpuMat & down_side_img);
-    FeatureFrame trackImage_fisheye_vworks(double _cur_time, const std::vector<cv::cuda::GpuMat> & fisheye_imgs_up, const std::vector<cv::cuda::GpuMat> & fisheye_imgs_down);
+    FeatureFramePtr trackImage_fisheye_vworks(double _cur_time, const std::vector<cv::cuda::GpuMat> & fisheye_imgs_up, const std::vector<cv::cuda::GpuMat> & fisheye_imgs_down);
 
     void process_vworks_tracking(nvx::FeatureTracker* _tracker, vector<int> & _ids, vector<cv::Point2f> & prev_pts, vector<cv::Point2f> & cur_pts, 
         vector<int> & _track, vector<cv::Point2f> & n_pts, map<int, int> &_id_by_index, bool debug_output=false);
@@ -11,29 +11,23 @@ Eigen::Quaterniond t4 = t3 * Eigen::AngleAxisd(M_PI / 2, Eigen::Vector3d(0, 1, 0
 Eigen::Quaterniond t_down(Eigen::AngleAxisd(M_PI, Eigen::Vector3d(1, 0, 0)));
 
 
-void FeatureTracker::addPointsFisheye()
+void FeatureTracker::addPointsFisheye(const vector<cv::Point2f> & n_pts, vector<cv::Point2f> & cur_pts,
+    vector<int> & ids, vector<int> & track_cnt)
 {
-    // ROS_INFO("Up top new pts %d", n_pts_up_top.size());
-    for (auto &p : n_pts_up_top)
-    {
-        cur_up_top_pts.push_back(p);
-        ids_up_top.push_back(n_id++);
-        track_up_top_cnt.push_back(1);
-    }
-
-    for (auto &p : n_pts_down_top)
+    for (auto &p : n_pts)
     {
-        cur_down_top_pts.push_back(p);
-        ids_down_top.push_back(n_id++);
-        track_down_top_cnt.push_back(1);
+        cur_pts.push_back(p);
+        ids.push_back(n_id++);
+        track_cnt.push_back(1);
     }
+}
 
-    for (auto &p : n_pts_up_side)
-    {
-        cur_up_side_pts.push_back(p);
-        ids_up_side.push_back(n_id++);
-        track_up_side_cnt.push_back(1);
-    }
+void FeatureTracker::addPointsFisheye()
+{
+    // ROS_INFO("Up top new pts %d", n_pts_up_top.size());
+    addPointsFisheye(n_pts_up_top, cur_up_top_pts, ids_up_top, track_up_top_cnt);
+    addPointsFisheye(n_pts_down_top, cur_down_top_pts, ids_down_top, track_down_top_cnt);
+    addPointsFisheye(n_pts_up_side, cur_up_side_pts, ids_up_side, track_up_side_cnt);
 }
 
 cv::Mat concat_side(const std::vector<cv::Mat> & arr) {
@@ -54,54 +48,20 @@ cv::Mat concat_side(const std::vector<cv::Mat> & arr) {
     }
 }
 
-cv::Mat FeatureTracker::setMaskFisheye(cv::Size shape, vector<cv::Point2f> & cur_pts,
-    vector<int> & track_cnt, vector<int> & ids) {
-    mask = cv::Mat(shape, CV_8UC1, cv::Scalar(255));
-
-    // prefer to keep features that are tracked for long time
-    vector<pair<int, pair<cv::Point2f, int>>> cnt_pts_id;
-
-    for (unsigned int i = 0; i < cur_pts.size(); i++)
-        cnt_pts_id.push_back(make_pair(track_cnt[i], make_pair(cur_pts[i], ids[i])));
-
-    sort(cnt_pts_id.begin(), cnt_pts_id.end(), [](const pair<int, pair<cv::Point2f, int>> &a, const pair<int, pair<cv::Point2f, int>> &b)
-         {
-            return a.first > b.first;
-         });
-
-    cur_pts.clear();
-    ids.clear();
-    track_cnt.clear();
-
-    for (auto &it : cnt_pts_id)
-    {
-        // if (removed_pts.find(it.second.second) == removed_pts.end()) {
-            if (mask.at<uchar>(it.second.first) == 255)
-            {
-                cur_pts.push_back(it.second.first);
-                ids.push_back(it.second.second);
-                track_cnt.push_back(it.first);
-                cv::circle(mask, it.second.first, MIN_DIST, 0, -1);
-            }
-        // }
-    }
-
-    return mask;
-}
-
-
 void FeatureTracker::setMaskFisheye() {
-    //TODO:Set mask for fisheye
     if(enable_up_top) {
-        mask_up_top = setMaskFisheye(top_size, cur_up_top_pts, track_up_top_cnt, ids_up_top);
+        suppressFeatures(grid_up_top, top_size, cur_up_top_pts, track_up_top_cnt, ids_up_top);
+        grid_up_top.drawMask(mask_up_top);
     }
 
     if(enable_down_top) {
-        mask_down_top = setMaskFisheye(top_size, cur_down_top_pts, track_down_top_cnt, ids_down_top);
+        suppressFeatures(grid_down_top, top_size, cur_down_top_pts, track_down_top_cnt, ids_down_top);
+        grid_down_top.drawMask(mask_down_top);
     }
 
     if(enable_up_side) {
-        mask_up_side = setMaskFisheye(side_size, cur_up_side_pts, track_up_side_cnt, ids_up_side);
+        suppressFeatures(grid_up_side, side_size, cur_up_side_pts, track_up_side_cnt, ids_up_side);
+        grid_up_side.drawMask(mask_up_side);
     }
 }
 
@@ -113,94 +73,18 @@ void FeatureTracker::drawTrackFisheye(const cv::Mat & img_up,
     cv::Mat imUpSide, 
     cv::Mat imDownSide)
 {
-    // ROS_INFO("Up image %d, down %d", imUp.size(), imDown.size());
-    cv::Mat imTrack;
-    cv::Mat fisheye_up;
-    cv::Mat fisheye_down;
-    
-    int side_height = imUpSide.size().height;
-    int width = imUpTop.size().width;
-    //128
-    if (img_up.size().width == 1024) {
-        fisheye_up = img_up(cv::Rect(190, 62, 900, 900));
-        fisheye_down = img_down(cv::Rect(190, 62, 900, 900));
-    } else {
-        fisheye_up = cv::Mat(cv::Size(900, 900), CV_8UC3, cv::Scalar(0, 0, 0)); 
-        fisheye_down = cv::Mat(cv::Size(900, 900), CV_8UC3, cv::Scalar(0, 0, 0)); 
-    }
-
-    cv::resize(fisheye_up, fisheye_up, cv::Size(width, width));
-    cv::resize(fisheye_down, fisheye_down, cv::Size(width, width));
-    if (fisheye_up.channels() != 3) {
-        cv::cvtColor(fisheye_up,   fisheye_up,   CV_GRAY2BGR);
-        cv::cvtColor(fisheye_down, fisheye_down, CV_GRAY2BGR);
-    }
-
-    if (imUpTop.channels() != 3) {
-        if (!imUpTop.empty()) {
-            cv::cvtColor(imUpTop, imUpTop, CV_GRAY2BGR);
-        }
-    
-        if(!imDownTop.empty()) {
-            cv::cvtColor(imDownTop, imDownTop, CV_GRAY2BGR);
-        }
-        
-        if(!imUpSide.empty()) {
-            cv::cvtColor(imUpSide, imUpSide, CV_GRAY2BGR);
-        }
-
-        if(!imDownSide.empty()) {
-            cv::cvtColor(imDownSide, imDownSide, CV_GRAY2BGR);
-        }
-    }
-
-    if(enable_up_top) {
-        drawTrackImage(imUpTop, cur_up_top_pts, ids_up_top, up_top_prevLeftPtsMap);
-    }
-
-    if(enable_down_top) {
-        drawTrackImage(imDownTop, cur_down_top_pts, ids_down_top, down_top_prevLeftPtsMap);
-    }
-
-    if(enable_up_side) {
-        drawTrackImage(imUpSide, cur_up_side_pts, ids_up_side, up_side_prevLeftPtsMap);
-    }
-
-    if(enable_down_side) {
-        drawTrackImage(imDownSide, cur_down_side_pts, ids_down_side, down_side_prevLeftPtsMap);
-    }
-
-    //Show images
-    int side_count = 3;
-    if (enable_rear_side) {
-        side_count = 4;
-    }
-
-    for (int i = 1; i < side_count + 1; i ++) {
-        cv::line(imUpSide, cv::Point2d(i*width, 0), cv::Point2d(i*width, side_height), cv::Scalar(255, 0, 0), 1);
-        cv::line(imDownSide, cv::Point2d(i*width, 0), cv::Point2d(i*width, side_height), cv::Scalar(255, 0, 0), 1);
-    }
-
-    cv::vconcat(imUpSide, imDownSide, imTrack);
-
-    cv::Mat top_cam;
-
-
-    cv::hconcat(imUpTop, imDownTop, top_cam);
-    cv::hconcat(fisheye_up, top_cam, top_cam);
-    cv::hconcat(top_cam, fisheye_down, top_cam); 
-    // ROS_INFO("Imtrack width %d", imUpSide.size().width);
-    cv::resize(top_cam, top_cam, cv::Size(imUpSide.size().width, imUpSide.size().width/4));
-    
-    cv::vconcat(top_cam, imTrack, imTrack);
-    
-    double fx = ((double)SHOW_WIDTH) / ((double) imUpSide.size().width);
-    cv::resize(imTrack, imTrack, cv::Size(), fx, fx);
-    cv::imshow("tracking", imTrack);
-    cv::waitKey(2);
+    track_job.t = cur_time;
+    track_job.fisheye = true;
+    track_job.raw_up = img_up;
+    track_job.raw_down = img_down;
+    trackView(track_job.views[0], imUpTop, cur_up_top_pts, ids_up_top, up_top_pts_slots);
+    trackView(track_job.views[1], imDownTop, cur_down_top_pts, ids_down_top, down_top_pts_slots);
+    trackView(track_job.views[2], imUpSide, cur_up_side_pts, ids_up_side, up_side_pts_slots);
+    trackView(track_job.views[3], imDownSide, cur_down_side_pts, ids_down_side, down_side_pts_slots);
+    track_drawer.submit(track_job);
 }
 
-FeatureFrame FeatureTracker::trackImage_fisheye(double _cur_time, const std::vector<cv::Mat> & fisheye_imgs_up, const std::vector<cv::Mat> & fisheye_imgs_down) {
+FeatureFramePtr FeatureTracker::trackImage_fisheye(double _cur_time, const std::vector<cv::Mat> & fisheye_imgs_up, const std::vector<cv::Mat> & fisheye_imgs_down) {
     // ROS_INFO("tracking fisheye cpu %ld:%ld", fisheye_imgs_up.size(), fisheye_imgs_down.size());
     cur_time = _cur_time;
     static double count = 0;
@@ -213,12 +97,16 @@ FeatureFrame FeatureTracker::trackImage_fisheye(double _cur_time, const std::vec
     cv::Mat up_top_img = fisheye_imgs_up[0];
     cv::Mat down_top_img = fisheye_imgs_down[0];
 
-    std::vector<cv::Mat> * up_top_pyr = nullptr, * down_top_pyr = nullptr, * up_side_pyr = nullptr, * down_side_pyr = nullptr;
     double concat_cost = t_r.toc();
 
     top_size = up_top_img.size();
     side_size = up_side_img.size();
 
+    // Rotation of both cameras since the last frame from the gyro, LK starts where it moves the features
+    Eigen::Matrix3d gyro_R[2];
+    bool gyro_confident = false;
+    bool gyro_predicted = gyro_predictor.predict(prev_time, cur_time, gyro_R, gyro_confident);
+
     //Clear All current pts
     cur_up_top_pts.clear();
     cur_up_side_pts.clear();
@@ -231,154 +119,150 @@ FeatureFrame FeatureTracker::trackImage_fisheye(double _cur_time, const std::vec
     cur_down_side_un_pts.clear();
 
 
-    TicToc t_pyr;
-    #pragma omp parallel sections 
+    // The stages run as a task graph instead of phases that each wait for their slowest direction.
+    // Every direction goes pyramid -> LK -> mask and detection -> new ids -> undistortion and velocity on its own.
+    // The down side stereo LK only needs the up side points and both side pyramids.
+    // New ids are handed out in the fixed up top, down top, up side order so the ids do not depend on the timing.
+    // The tokens below only carry the dependencies, one per stage output
+    struct { char pyr[4], pts[4], id; } dep;
+    TicToc t_g;
+    stage_trace.reset();
+    #pragma omp parallel
+    #pragma omp single
     {
-        #pragma omp section 
-        {
-            if(enable_up_top) {
-                // printf("Building up top pyr\n");
-                up_top_pyr = new std::vector<cv::Mat>();
-                cv::buildOpticalFlowPyramid(up_top_img, *up_top_pyr, WIN_SIZE, PYR_LEVEL, true);//, cv::BORDER_REFLECT101, cv::BORDER_CONSTANT, false);
-            }
-        }
-        
-        #pragma omp section 
-        {
-            if(enable_down_top) {
-                // printf("Building down top pyr\n");
-                down_top_pyr = new std::vector<cv::Mat>();
-                cv::buildOpticalFlowPyramid(down_top_img, *down_top_pyr, WIN_SIZE, PYR_LEVEL, true);
-            }
-        }
-        
-        #pragma omp section 
-        {
-            if(enable_up_side) {
-                // printf("Building up side pyr\n");
-                up_side_pyr = new std::vector<cv::Mat>();
-                cv::buildOpticalFlowPyramid(up_side_img, *up_side_pyr, WIN_SIZE, PYR_LEVEL, true);
-            }
+        #pragma omp task depend(out: dep.pyr[0])
+        if (enable_up_top) {
+            StageTrace::Scope s(stage_trace, "pyr up top");
+            up_top_pyrs.build(up_top_img, WIN_SIZE, PYR_LEVEL);
         }
-        
-        #pragma omp section 
-        {
-            if(enable_down_side) {
-                // printf("Building downn side pyr\n");
-                down_side_pyr = new std::vector<cv::Mat>();
-                cv::buildOpticalFlowPyramid(down_side_img, *down_side_pyr, WIN_SIZE, PYR_LEVEL, true);
-            }
-        }
-    }
 
-    static double pyr_sum = 0;
-    pyr_sum += t_pyr.toc();
-
-    TicToc t_t;
-    #pragma omp parallel sections
-    {
-        #pragma omp section 
-        {
-            //If has predict;
-            if (enable_up_top) {
-                // printf("Start track up top\n");
-                cur_up_top_pts = opticalflow_track(up_top_img, up_top_pyr, prev_up_top_img_cpu, prev_up_top_pyr, prev_up_top_pts, ids_up_top, track_up_top_cnt);
-                // printf("End track up top\n");
-            }
+        #pragma omp task depend(out: dep.pyr[1])
+        if (enable_down_top) {
+            StageTrace::Scope s(stage_trace, "pyr down top");
+            down_top_pyrs.build(down_top_img, WIN_SIZE, PYR_LEVEL);
         }
 
-        #pragma omp section 
-        {
-            if (enable_up_side) {
-                // printf("Start track up side\n");
-                cur_up_side_pts = opticalflow_track(up_side_img, up_side_pyr, prev_up_side_img_cpu, prev_up_side_pyr, prev_up_side_pts, ids_up_side, track_up_side_cnt);
-                // printf("End track up side\n");
-            }
+        #pragma omp task depend(out: dep.pyr[2])
+        if (enable_up_side) {
+            StageTrace::Scope s(stage_trace, "pyr up side");
+            up_side_pyrs.build(up_side_img, WIN_SIZE, PYR_LEVEL);
         }
 
-        #pragma omp section 
-        {
-            if (enable_down_top) {
-                // printf("Start track down top\n");
-                cur_down_top_pts = opticalflow_track(down_top_img, down_top_pyr, prev_down_top_img_cpu, prev_down_top_pyr, prev_down_top_pts, ids_down_top, track_down_top_cnt);
-                // printf("End track down top\n");
-            }
+        #pragma omp task depend(out: dep.pyr[3])
+        if (enable_down_side) {
+            StageTrace::Scope s(stage_trace, "pyr down side");
+            down_side_pyrs.build(down_side_img, WIN_SIZE, PYR_LEVEL);
         }
 
-        
-       
-    }
-    
-
-    static double lk_sum = 0;
-    lk_sum += t_t.toc();
+        #pragma omp task depend(in: dep.pyr[0]) depend(out: dep.pts[0])
+        if (enable_up_top) {
+            StageTrace::Scope s(stage_trace, "lk up top");
+            vector<cv::Point2f> predict_up_top;
+            if (gyro_predicted)
+                predict_up_top = predictPtsTop(prev_up_top_pts, fisheys_undists[0], gyro_R[0]);
+            cur_up_top_pts = opticalflow_track(up_top_img, up_top_pyrs.cur(), prev_up_top_img_cpu, up_top_pyrs.prev(), prev_up_top_pts, ids_up_top, track_up_top_cnt,
+                predict_up_top, gyro_confident);
+        }
 
-    TicToc t_d;
+        #pragma omp task depend(in: dep.pyr[1]) depend(out: dep.pts[1])
+        if (enable_down_top) {
+            StageTrace::Scope s(stage_trace, "lk down top");
+            vector<cv::Point2f> predict_down_top;
+            if (gyro_predicted)
+                predict_down_top = predictPtsTop(prev_down_top_pts, fisheys_undists[1], gyro_R[1]);
+            cur_down_top_pts = opticalflow_track(down_top_img, down_top_pyrs.cur(), prev_down_top_img_cpu, down_top_pyrs.prev(), prev_down_top_pts, ids_down_top, track_down_top_cnt,
+                predict_down_top, gyro_confident);
+        }
 
-    setMaskFisheye();
+        #pragma omp task depend(in: dep.pyr[2]) depend(out: dep.pts[2])
+        if (enable_up_side) {
+            StageTrace::Scope s(stage_trace, "lk up side");
+            vector<cv::Point2f> predict_up_side;
+            if (gyro_predicted)
+                predict_up_side = predictPtsSide(prev_up_side_pts, fisheys_undists[0], gyro_R[0], false);
+            cur_up_side_pts = opticalflow_track(up_side_img, up_side_pyrs.cur(), prev_up_side_img_cpu, up_side_pyrs.prev(), prev_up_side_pts, ids_up_side, track_up_side_cnt,
+                predict_up_side, gyro_confident);
+        }
 
-    #pragma omp parallel sections
-    {
-        #pragma omp section
-        {
-            if (enable_up_top) {
-                detectPoints(up_top_img, mask_up_top, n_pts_up_top, cur_up_top_pts, TOP_PTS_CNT);
-            }
+        #pragma omp task depend(inout: dep.pts[0])
+        if (enable_up_top) {
+            StageTrace::Scope s(stage_trace, "detect up top");
+            int max_cnt = budgetTarget(0, ids_up_top, TOP_PTS_CNT);
+            suppressFeatures(grid_up_top, top_size, cur_up_top_pts, track_up_top_cnt, ids_up_top, max_cnt);
+            detectPoints(up_top_img, grid_up_top, n_pts_up_top, cur_up_top_pts, max_cnt);
         }
 
-        #pragma omp section
-        {
-            if (enable_down_top) {
-                detectPoints(down_top_img, mask_down_top, n_pts_down_top, cur_down_top_pts, TOP_PTS_CNT);
-            }
+        #pragma omp task depend(inout: dep.pts[1])
+        if (enable_down_top) {
+            StageTrace::Scope s(stage_trace, "detect down top");
+            int max_cnt = budgetTarget(1, ids_down_top, TOP_PTS_CNT);
+            suppressFeatures(grid_down_top, top_size, cur_down_top_pts, track_down_top_cnt, ids_down_top, max_cnt);
+            detectPoints(down_top_img, grid_down_top, n_pts_down_top, cur_down_top_pts, max_cnt);
         }
 
-        #pragma omp section
-        {
-            if (enable_up_side) {
-                detectPoints(up_side_img, mask_up_side, n_pts_up_side, cur_up_side_pts, SIDE_PTS_CNT);
-            }
+        #pragma omp task depend(inout: dep.pts[2])
+        if (enable_up_side) {
+            StageTrace::Scope s(stage_trace, "detect up side");
+            int max_cnt = budgetTarget(2, ids_up_side, SIDE_PTS_CNT);
+            suppressFeatures(grid_up_side, side_size, cur_up_side_pts, track_up_side_cnt, ids_up_side, max_cnt);
+            detectPoints(up_side_img, grid_up_side, n_pts_up_side, cur_up_side_pts, max_cnt);
         }
-    }
 
-    ROS_INFO("Detect cost %fms", t_d.toc());
+        #pragma omp task depend(inout: dep.pts[0], dep.id)
+        addPointsFisheye(n_pts_up_top, cur_up_top_pts, ids_up_top, track_up_top_cnt);
 
-    static double detect_sum = 0;
+        #pragma omp task depend(inout: dep.pts[1], dep.id)
+        addPointsFisheye(n_pts_down_top, cur_down_top_pts, ids_down_top, track_down_top_cnt);
 
-    detect_sum = detect_sum + t_d.toc();
+        #pragma omp task depend(inout: dep.pts[2], dep.id)
+        addPointsFisheye(n_pts_up_side, cur_up_side_pts, ids_up_side, track_up_side_cnt);
 
-    addPointsFisheye();
-    
-    TicToc t_tk;
-    {
+        #pragma omp task depend(in: dep.pyr[2], dep.pyr[3], dep.pts[2]) depend(out: dep.pts[3])
         if (enable_down_side) {
+            StageTrace::Scope s(stage_trace, "lk down side");
             ids_down_side = ids_up_side;
             std::vector<cv::Point2f> down_side_init_pts = cur_up_side_pts;
             if (down_side_init_pts.size() > 0) {
-                cur_down_side_pts = opticalflow_track(down_side_img, down_side_pyr, up_side_img, up_side_pyr, down_side_init_pts, ids_down_side, track_down_side_cnt);
+                cur_down_side_pts = opticalflow_track(down_side_img, down_side_pyrs.cur(), up_side_img, up_side_pyrs.cur(), down_side_init_pts, ids_down_side, track_down_side_cnt);
             }
         }
-    }
 
-    ROS_INFO("Tracker 2 cost %fms", t_tk.toc());
+        //Undist points and calculate velocitys
+        #pragma omp task depend(in: dep.pts[0])
+        {
+            StageTrace::Scope s(stage_trace, "undist up top");
+            cur_up_top_un_pts = undistortedPtsTop(cur_up_top_pts, fisheys_undists[0]);
+            ptsVelocity3D(ids_up_top, cur_up_top_un_pts, up_top_un_pts_slots, up_top_vel);
+        }
 
-    //Undist points
-    cur_up_top_un_pts = undistortedPtsTop(cur_up_top_pts, fisheys_undists[0]);
-    cur_down_top_un_pts = undistortedPtsTop(cur_down_top_pts, fisheys_undists[1]);
+        #pragma omp task depend(in: dep.pts[1])
+        {
+            StageTrace::Scope s(stage_trace, "undist down top");
+            cur_down_top_un_pts = undistortedPtsTop(cur_down_top_pts, fisheys_undists[1]);
+            ptsVelocity3D(ids_down_top, cur_down_top_un_pts, down_top_un_pts_slots, down_top_vel);
+        }
 
-    cur_up_side_un_pts = undistortedPtsSide(cur_up_side_pts, fisheys_undists[0], false);
-    cur_down_side_un_pts = undistortedPtsSide(cur_down_side_pts, fisheys_undists[1], true);
+        #pragma omp task depend(in: dep.pts[2])
+        {
+            StageTrace::Scope s(stage_trace, "undist up side");
+            cur_up_side_un_pts = undistortedPtsSide(cur_up_side_pts, fisheys_undists[0], false);
+            ptsVelocity3D(ids_up_side, cur_up_side_un_pts, up_side_un_pts_slots, up_side_vel);
+        }
 
-    //Calculate Velocitys
-    up_top_vel = ptsVelocity3D(ids_up_top, cur_up_top_un_pts, cur_up_top_un_pts_map, prev_up_top_un_pts_map);
-    down_top_vel = ptsVelocity3D(ids_down_top, cur_down_top_un_pts, cur_down_top_un_pts_map, prev_down_top_un_pts_map);
+        #pragma omp task depend(in: dep.pts[3])
+        {
+            StageTrace::Scope s(stage_trace, "undist down side");
+            cur_down_side_un_pts = undistortedPtsSide(cur_down_side_pts, fisheys_undists[1], true);
+            ptsVelocity3D(ids_down_side, cur_down_side_un_pts, down_side_un_pts_slots, down_side_vel);
+        }
+    }
 
-    up_side_vel = ptsVelocity3D(ids_up_side, cur_up_side_un_pts, cur_up_side_un_pts_map, prev_up_side_un_pts_map);
-    down_side_vel = ptsVelocity3D(ids_down_side, cur_down_side_un_pts, cur_down_side_un_pts_map, prev_down_side_un_pts_map);
+    static double graph_sum = 0;
+    graph_sum += t_g.toc();
 
     // ROS_INFO("Up top VEL %ld", up_top_vel.size());
     double tcost_all = t_r.toc();
-    if (SHOW_TRACK) {
+    if (SHOW_TRACK && track_drawer.wanted()) {
         drawTrackFisheye(cv::Mat(), cv::Mat(), up_top_img, down_top_img, up_side_img, down_side_img);
     }
 
@@ -387,46 +271,33 @@ FeatureFrame FeatureTracker::trackImage_fisheye(double _cur_time, const std::vec
     prev_down_top_img_cpu = down_top_img;
     prev_up_side_img_cpu = up_side_img;
 
-    if(prev_down_top_pyr != nullptr) {
-        delete prev_down_top_pyr;
-    }
-
-    if(prev_up_top_pyr != nullptr) {
-        delete prev_up_top_pyr;
-    }
-
-    if (prev_up_side_pyr!=nullptr) {
-        delete prev_up_side_pyr;
-    }
-
-    if (down_side_pyr!=nullptr) {
-        delete down_side_pyr;
-    }
-
-    prev_down_top_pyr = down_top_pyr;
-    prev_up_top_pyr = up_top_pyr;
-    prev_up_side_pyr = up_side_pyr;
+    // This frame's pyramids become the previous ones, the old previous buffers are rebuilt in place next frame
+    up_top_pyrs.swap();
+    down_top_pyrs.swap();
+    up_side_pyrs.swap();
 
     prev_up_top_pts = cur_up_top_pts;
     prev_down_top_pts = cur_down_top_pts;
     prev_up_side_pts = cur_up_side_pts;
     prev_down_side_pts = cur_down_side_pts;
 
-    prev_up_top_un_pts = cur_up_top_un_pts;
-    prev_down_top_un_pts = cur_down_top_un_pts;
-    prev_up_side_un_pts = cur_up_side_un_pts;
-    prev_down_side_un_pts = cur_down_side_un_pts;
-
-    prev_up_top_un_pts_map = cur_up_top_un_pts_map;
-    prev_down_top_un_pts_map = cur_down_top_un_pts_map;
-    prev_up_side_un_pts_map = cur_up_side_un_pts_map;
-    prev_down_side_un_pts_map = cur_up_side_un_pts_map;
+    // ptsVelocity3D stored this frame's undistorted points, they become the previous ones
+    up_top_un_pts_slots.swap();
+    down_top_un_pts_slots.swap();
+    up_side_un_pts_slots.swap();
+    down_side_un_pts_slots.swap();
     prev_time = cur_time;
 
-    up_top_prevLeftPtsMap = pts_map(ids_up_top, cur_up_top_pts);
-    down_top_prevLeftPtsMap = pts_map(ids_down_top, cur_down_top_pts);
-    up_side_prevLeftPtsMap = pts_map(ids_up_side, cur_up_side_pts);
-    down_side_prevLeftPtsMap = pts_map(ids_down_side, cur_down_side_pts);
+    if (SHOW_TRACK) {
+        up_top_pts_slots.store(ids_up_top, cur_up_top_pts);
+        down_top_pts_slots.store(ids_down_top, cur_down_top_pts);
+        up_side_pts_slots.store(ids_up_side, cur_up_side_pts);
+        down_side_pts_slots.store(ids_down_side, cur_down_side_pts);
+        up_top_pts_slots.swap();
+        down_top_pts_slots.swap();
+        up_side_pts_slots.swap();
+        down_side_pts_slots.swap();
+    }
 
     // hasPrediction = false;
     auto ff = setup_feature_frame();
@@ -435,8 +306,14 @@ FeatureFrame FeatureTracker::trackImage_fisheye(double _cur_time, const std::vec
 
     whole_sum += t_r.toc();
 
-    printf("FT Whole %fms; AVG %fms\n DetectAVG %fms PYRAvg %fms LKAvg %fms Concat %fms PTS %ld T\n", 
-        t_r.toc(), whole_sum/count, detect_sum/count, pyr_sum/count, lk_sum/count, concat_cost, ff.size());
+    printf("FT Whole %fms; AVG %fms\n TrackGraphAVG %fms Concat %fms PTS %d T\n", 
+        t_r.toc(), whole_sum/count, graph_sum/count, concat_cost, ff->size());
+    if (ENABLE_PERF_OUTPUT) {
+        stage_trace.print();
+        ROS_INFO("Pyramid allocations: up top %ld (%ldKB) down top %ld (%ldKB) up side %ld (%ldKB) down side %ld (%ldKB)",
+            up_top_pyrs.alloc_num, up_top_pyrs.alloc_bytes/1024, down_top_pyrs.alloc_num, down_top_pyrs.alloc_bytes/1024,
+            up_side_pyrs.alloc_num, up_side_pyrs.alloc_bytes/1024, down_side_pyrs.alloc_num, down_side_pyrs.alloc_bytes/1024);
+    }
     return ff;
 }
 
@@ -503,3 +380,78 @@ vector<cv::Point3f> FeatureTracker::undistortedPtsSide(vector<cv::Point2f> &pts,
     return un_pts;
 }
 
+vector<cv::Point2f> FeatureTracker::predictPtsTop(const vector<cv::Point2f> &pts, FisheyeUndist & fisheye, const Eigen::Matrix3d & R) const {
+    auto & cam = fisheye.cam_top;
+    Eigen::Matrix3d R_inv = R.transpose();
+    //Points rotated out of the top image keep their position
+    vector<cv::Point2f> pred_pts(pts);
+    for (unsigned int i = 0; i < pts.size(); i++)
+    {
+        Eigen::Vector2d a(pts[i].x, pts[i].y);
+        Eigen::Vector3d b;
+        cam->liftProjective(a, b);
+        b = R_inv * b;
+        if (b.z() < 1e-2) {
+            continue;
+        }
+
+        Eigen::Vector2d uv;
+        cam->spaceToPlane(b, uv);
+        if (uv.x() >= 0 && uv.x() < cam->imageWidth() && uv.y() >= 0 && uv.y() < cam->imageHeight()) {
+            pred_pts[i] = cv::Point2f(uv.x(), uv.y());
+        }
+    }
+    return pred_pts;
+}
+
+vector<cv::Point2f> FeatureTracker::predictPtsSide(const vector<cv::Point2f> &pts, FisheyeUndist & fisheye, const Eigen::Matrix3d & R, bool is_downward) const {
+    auto & cam = fisheye.cam_side;
+    const Eigen::Quaterniond side_rot[4] = {t1, t2, t3, t4};
+    int side_count = enable_rear_side ? 4 : 3;
+    int width = top_size.width;
+    Eigen::Matrix3d R_inv = R.transpose();
+    //Same side pos and downward rotations as undistortedPtsSide; a point may rotate into the next side pos
+    vector<cv::Point2f> pred_pts(pts);
+    for (unsigned int i = 0; i < pts.size(); i++)
+    {
+        Eigen::Vector2d a(pts[i].x, pts[i].y);
+        if(ENABLE_DOWNSAMPLE) {
+            a = a*2;
+        }
+
+        int side_pos = floor(a.x() / width);
+        if (side_pos < 0 || side_pos >= side_count) {
+            continue;
+        }
+        a.x() = a.x() - side_pos*width;
+
+        Eigen::Vector3d b;
+        cam->liftProjective(a, b);
+        b = side_rot[side_pos] * b;
+        if (is_downward) {
+            b = t_down.inverse() * (R_inv * (t_down * b));
+        } else {
+            b = R_inv * b;
+        }
+
+        for (int k = 0; k < side_count; k++) {
+            Eigen::Vector3d v = side_rot[k].inverse() * b;
+            if (v.z() < 1e-2) {
+                continue;
+            }
+            Eigen::Vector2d uv;
+            cam->spaceToPlane(v, uv);
+            if (uv.x() < 0 || uv.x() >= width || uv.y() < 0 || uv.y() >= cam->imageHeight()) {
+                continue;
+            }
+            uv.x() += k*width;
+            if(ENABLE_DOWNSAMPLE) {
+                uv = uv/2;
+            }
+            pred_pts[i] = cv::Point2f(uv.x(), uv.y());
+            break;
+        }
+    }
+    return pred_pts;
+}
+
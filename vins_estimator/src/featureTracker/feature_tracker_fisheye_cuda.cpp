@@ -100,7 +100,7 @@ std::vector<cv::cuda::GpuMat> buildImagePyramid(const cv::cuda::GpuMat& prevImg,
 vector<cv::Point2f> FeatureTracker::opticalflow_track(cv::cuda::GpuMat & cur_img, 
                         std::vector<cv::cuda::GpuMat> & prev_pyr, vector<cv::Point2f> & prev_pts, 
                         vector<int> & ids, vector<int> & track_cnt,
-                        bool is_lr_track, vector<cv::Point2f> prediction_points){
+                        bool is_lr_track, const vector<cv::Point2f> & prediction_points, bool prediction_confident){
 
 
     TicToc tic1;
@@ -117,15 +117,20 @@ vector<cv::Point2f> FeatureTracker::opticalflow_track(cv::cuda::GpuMat & cur_img
 
     for (size_t i = 0; i < ids.size(); i ++) {
         int _id = ids[i];
-        if (removed_pts.find(_id) == removed_pts.end()) {
+        if (!pts_status.removed(_id)) {
             status.push_back(1);
         } else {
             status.push_back(0);
         }
     }
 
+    vector<cv::Point2f> cur_pts;
+    bool has_prediction = prediction_points.size() == prev_pts.size();
+    if (has_prediction) {
+        cur_pts = prediction_points;
+        reduceVector(cur_pts, status);
+    }
     reduceVector(prev_pts, status);
-    reduceVector(cur_pts, status);
     reduceVector(ids, status);
     
     if (prev_pts.size() == 0) {
@@ -134,24 +139,32 @@ vector<cv::Point2f> FeatureTracker::opticalflow_track(cv::cuda::GpuMat & cur_img
         return vector<cv::Point2f>();
     }
 
-    vector<cv::Point2f> cur_pts;
     TicToc t_og;
     cv::cuda::GpuMat prev_gpu_pts(prev_pts);
     cv::cuda::GpuMat cur_gpu_pts(cur_pts);
     cv::cuda::GpuMat gpu_status;
     status.clear();
 
-    //Assume No Prediction Need to add later
+    bool short_search = has_prediction && prediction_confident;
     cv::Ptr<cv::cuda::SparsePyrLKOpticalFlow> d_pyrLK_sparse = cv::cuda::SparsePyrLKOpticalFlow::create(
-        cv::Size(21, 21), 3, 30, false);
+        cv::Size(21, 21), short_search ? PREDICT_PYR_LEVEL : PYR_LEVEL, short_search ? PREDICT_LK_ITER : 30, has_prediction);
 
     d_pyrLK_sparse->calc(prev_pyr, cur_pyr, prev_gpu_pts, cur_gpu_pts, gpu_status);
+
+    gpu_status.download(status);
+
+    // A wrong prediction loses nearly every track in the short search; search the whole pyramid again like the CPU path
+    if (short_search && std::count(status.begin(), status.end(), 1) < 10) {
+        short_search = false;
+        cur_gpu_pts.release();
+        d_pyrLK_sparse = cv::cuda::SparsePyrLKOpticalFlow::create(cv::Size(21, 21), PYR_LEVEL, 30, false);
+        d_pyrLK_sparse->calc(prev_pyr, cur_pyr, prev_gpu_pts, cur_gpu_pts, gpu_status);
+        gpu_status.download(status);
+    }
     
     // std::cout << "Prev gpu pts" << prev_gpu_pts.size() << std::endl;    
     // std::cout << "Cur gpu pts" << cur_gpu_pts.size() << std::endl;
     cur_gpu_pts.download(cur_pts);
-
-    gpu_status.download(status);
     if(FLOW_BACK)
     {
         // ROS_INFO("Is flow back");
@@ -206,7 +219,7 @@ vector<cv::Point2f> FeatureTracker::opticalflow_track(cv::cuda::GpuMat & cur_img
     return cur_pts;
 }
 
-FeatureFrame FeatureTracker::trackImage_fisheye(double _cur_time,   
+FeatureFramePtr FeatureTracker::trackImage_fisheye(double _cur_time,   
         const std::vector<cv::cuda::GpuMat> & fisheye_imgs_up,
         const std::vector<cv::cuda::GpuMat> & fisheye_imgs_down,
         bool is_blank_init) {
@@ -229,6 +242,11 @@ FeatureFrame FeatureTracker::trackImage_fisheye(double _cur_time,
     top_size = up_top_img.size();
     side_size = up_side_img.size();
 
+    // Rotation of both cameras since the last frame from the gyro, LK starts where it moves the features
+    Eigen::Matrix3d gyro_R[2];
+    bool gyro_confident = false;
+    bool gyro_predicted = gyro_predictor.predict(prev_time, cur_time, gyro_R, gyro_confident);
+
     //Clear All current pts
     cur_up_top_pts.clear();
     cur_up_side_pts.clear();
@@ -262,14 +280,17 @@ FeatureFrame FeatureTracker::trackImage_fisheye(double _cur_time,
 
     if (enable_up_top) {
         // ROS_INFO("Tracking top");
-        cur_up_top_pts = opticalflow_track(up_top_img, prev_up_top_pyr_cuda, prev_up_top_pts, ids_up_top, track_up_top_cnt, false);
+        cur_up_top_pts = opticalflow_track(up_top_img, prev_up_top_pyr_cuda, prev_up_top_pts, ids_up_top, track_up_top_cnt, false,
+            gyro_predicted ? predictPtsTop(prev_up_top_pts, fisheys_undists[0], gyro_R[0]) : vector<cv::Point2f>(), gyro_confident);
     }
     if (enable_up_side) {
-        cur_up_side_pts = opticalflow_track(up_side_img, prev_up_side_pyr_cuda, prev_up_side_pts, ids_up_side, track_up_side_cnt, false);
+        cur_up_side_pts = opticalflow_track(up_side_img, prev_up_side_pyr_cuda, prev_up_side_pts, ids_up_side, track_up_side_cnt, false,
+            gyro_predicted ? predictPtsSide(prev_up_side_pts, fisheys_undists[0], gyro_R[0], false) : vector<cv::Point2f>(), gyro_confident);
     }
 
     if (enable_down_top) {
-        cur_down_top_pts = opticalflow_track(down_top_img, prev_down_top_pyr_cuda, prev_down_top_pts, ids_down_top, track_down_top_cnt, false);
+        cur_down_top_pts = opticalflow_track(down_top_img, prev_down_top_pyr_cuda, prev_down_top_pts, ids_down_top, track_down_top_cnt, false,
+            gyro_predicted ? predictPtsTop(prev_down_top_pts, fisheys_undists[1], gyro_R[1]) : vector<cv::Point2f>(), gyro_confident);
     }
     
     ft_time_sum += t_ft.toc();
@@ -277,15 +298,22 @@ FeatureFrame FeatureTracker::trackImage_fisheye(double _cur_time,
     ROS_WARN("Optical flow 1 %fms", t_ft.toc());
     
     TicToc t_d;
+    // The feature budget bounds the tracks carried to the next frame as well as the new ones
     if (enable_up_top) {
-        detectPoints(up_top_img, n_pts_up_top, cur_up_top_pts, TOP_PTS_CNT);
+        int max_cnt = budgetTarget(0, ids_up_top, TOP_PTS_CNT);
+        limitTracks(cur_up_top_pts, track_up_top_cnt, ids_up_top, max_cnt);
+        detectPoints(up_top_img, n_pts_up_top, cur_up_top_pts, max_cnt);
     }
     if (enable_down_top) {
-        detectPoints(down_top_img, n_pts_down_top, cur_down_top_pts, TOP_PTS_CNT);
+        int max_cnt = budgetTarget(1, ids_down_top, TOP_PTS_CNT);
+        limitTracks(cur_down_top_pts, track_down_top_cnt, ids_down_top, max_cnt);
+        detectPoints(down_top_img, n_pts_down_top, cur_down_top_pts, max_cnt);
     }
 
     if (enable_up_side) {
-        detectPoints(up_side_img, n_pts_up_side, cur_up_side_pts, SIDE_PTS_CNT);
+        int max_cnt = budgetTarget(2, ids_up_side, SIDE_PTS_CNT);
+        limitTracks(cur_up_side_pts, track_up_side_cnt, ids_up_side, max_cnt);
+        detectPoints(up_side_img, n_pts_up_side, cur_up_side_pts, max_cnt);
     }
 
 
@@ -319,15 +347,15 @@ FeatureFrame FeatureTracker::trackImage_fisheye(double _cur_time,
     cur_down_side_un_pts = undistortedPtsSide(cur_down_side_pts, fisheys_undists[1], true);
 
     //Calculate Velocitys
-    up_top_vel = ptsVelocity3D(ids_up_top, cur_up_top_un_pts, cur_up_top_un_pts_map, prev_up_top_un_pts_map);
-    down_top_vel = ptsVelocity3D(ids_down_top, cur_down_top_un_pts, cur_down_top_un_pts_map, prev_down_top_un_pts_map);
+    ptsVelocity3D(ids_up_top, cur_up_top_un_pts, up_top_un_pts_slots, up_top_vel);
+    ptsVelocity3D(ids_down_top, cur_down_top_un_pts, down_top_un_pts_slots, down_top_vel);
 
-    up_side_vel = ptsVelocity3D(ids_up_side, cur_up_side_un_pts, cur_up_side_un_pts_map, prev_up_side_un_pts_map);
-    down_side_vel = ptsVelocity3D(ids_down_side, cur_down_side_un_pts, cur_down_side_un_pts_map, prev_down_side_un_pts_map);
+    ptsVelocity3D(ids_up_side, cur_up_side_un_pts, up_side_un_pts_slots, up_side_vel);
+    ptsVelocity3D(ids_down_side, cur_down_side_un_pts, down_side_un_pts_slots, down_side_vel);
 
     // ROS_INFO("Up top VEL %ld", up_top_vel.size());
     double tcost_all = t_r.toc();
-    if (SHOW_TRACK) {
+    if (SHOW_TRACK && track_drawer.wanted()) {
         drawTrackFisheye(cv::Mat(), cv::Mat(), up_top_img, down_top_img, up_side_img, down_side_img);
     }
         
@@ -340,29 +368,31 @@ FeatureFrame FeatureTracker::trackImage_fisheye(double _cur_time,
     prev_up_side_pts = cur_up_side_pts;
     prev_down_side_pts = cur_down_side_pts;
 
-    prev_up_top_un_pts = cur_up_top_un_pts;
-    prev_down_top_un_pts = cur_down_top_un_pts;
-    prev_up_side_un_pts = cur_up_side_un_pts;
-    prev_down_side_un_pts = cur_down_side_un_pts;
-
-    prev_up_top_un_pts_map = cur_up_top_un_pts_map;
-    prev_down_top_un_pts_map = cur_down_top_un_pts_map;
-    prev_up_side_un_pts_map = cur_up_side_un_pts_map;
-    prev_down_side_un_pts_map = cur_up_side_un_pts_map;
+    // ptsVelocity3D stored this frame's undistorted points, they become the previous ones
+    up_top_un_pts_slots.swap();
+    down_top_un_pts_slots.swap();
+    up_side_un_pts_slots.swap();
+    down_side_un_pts_slots.swap();
     prev_time = cur_time;
 
-    up_top_prevLeftPtsMap = pts_map(ids_up_top, cur_up_top_pts);
-    down_top_prevLeftPtsMap = pts_map(ids_down_top, cur_down_top_pts);
-    up_side_prevLeftPtsMap = pts_map(ids_up_side, cur_up_side_pts);
-    down_side_prevLeftPtsMap = pts_map(ids_down_side, cur_down_side_pts);
+    if (SHOW_TRACK) {
+        up_top_pts_slots.store(ids_up_top, cur_up_top_pts);
+        down_top_pts_slots.store(ids_down_top, cur_down_top_pts);
+        up_side_pts_slots.store(ids_up_side, cur_up_side_pts);
+        down_side_pts_slots.store(ids_down_side, cur_down_side_pts);
+        up_top_pts_slots.swap();
+        down_top_pts_slots.swap();
+        up_side_pts_slots.swap();
+        down_side_pts_slots.swap();
+    }
 
     // hasPrediction = false;
     auto ff = setup_feature_frame();
 
-    printf("FT Whole %fms; Detect AVG %fms OpticalFlow %fms concat %fms PTS %ld T\n", 
+    printf("FT Whole %fms; Detect AVG %fms OpticalFlow %fms concat %fms PTS %d T\n", 
         t_r.toc(), detected_time_sum/count, 
         ft_time_sum/count,
-        concat_cost, ff.size());
+        concat_cost, ff->size());
     return ff;
 }
 #endif
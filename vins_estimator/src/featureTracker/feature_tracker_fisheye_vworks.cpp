@@ -168,8 +168,25 @@ void FeatureTracker::process_vworks_tracking(nvx::FeatureTracker* _tracker, vect
                 _id, cur_pos_id, cv_cur_pts[i].x, cv_cur_pts[i].y);
         }
     }
-    
+
     _id_by_index = new_id_by_index;
+
+    // VisionWorks returns the points in its own order, the feature frame merges the streams by ascending id
+    vector<int> order(_ids.size());
+    for (unsigned int i = 0; i < order.size(); i ++) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return _ids[a] < _ids[b]; });
+    vector<int> sorted_ids(order.size()), sorted_track(order.size());
+    vector<cv::Point2f> sorted_pts(order.size());
+    for (unsigned int i = 0; i < order.size(); i ++) {
+        sorted_ids[i] = _ids[order[i]];
+        sorted_pts[i] = cur_pts[order[i]];
+        sorted_track[i] = track[order[i]];
+    }
+    _ids.swap(sorted_ids);
+    cur_pts.swap(sorted_pts);
+    track.swap(sorted_track);
 }
 
 void FeatureTracker::init_vworks_tracker(cv::cuda::GpuMat & up_top_img, cv::cuda::GpuMat & down_top_img, cv::cuda::GpuMat & up_side_img, cv::cuda::GpuMat & down_side_img) {
@@ -225,7 +242,7 @@ void FeatureTracker::init_vworks_tracker(cv::cuda::GpuMat & up_top_img, cv::cuda
 
 
 
-FeatureFrame FeatureTracker::trackImage_fisheye(double _cur_time,   
+FeatureFramePtr FeatureTracker::trackImage_fisheye(double _cur_time,   
         const std::vector<cv::cuda::GpuMat> & fisheye_imgs_up,
         const std::vector<cv::cuda::GpuMat> & fisheye_imgs_down) {
                 cur_time = _cur_time;
@@ -335,15 +352,15 @@ FeatureFrame FeatureTracker::trackImage_fisheye(double _cur_time,
     cur_down_side_un_pts = undistortedPtsSide(cur_down_side_pts, fisheys_undists[1], true);
 
     //Calculate Velocitys
-    up_top_vel = ptsVelocity3D(ids_up_top, cur_up_top_un_pts, cur_up_top_un_pts_map, prev_up_top_un_pts_map);
-    down_top_vel = ptsVelocity3D(ids_down_top, cur_down_top_un_pts, cur_down_top_un_pts_map, prev_down_top_un_pts_map);
+    ptsVelocity3D(ids_up_top, cur_up_top_un_pts, up_top_un_pts_slots, up_top_vel);
+    ptsVelocity3D(ids_down_top, cur_down_top_un_pts, down_top_un_pts_slots, down_top_vel);
 
-    up_side_vel = ptsVelocity3D(ids_up_side, cur_up_side_un_pts, cur_up_side_un_pts_map, prev_up_side_un_pts_map);
-    down_side_vel = ptsVelocity3D(ids_down_side, cur_down_side_un_pts, cur_down_side_un_pts_map, prev_down_side_un_pts_map);
+    ptsVelocity3D(ids_up_side, cur_up_side_un_pts, up_side_un_pts_slots, up_side_vel);
+    ptsVelocity3D(ids_down_side, cur_down_side_un_pts, down_side_un_pts_slots, down_side_vel);
 
     // ROS_INFO("Up top VEL %ld", up_top_vel.size());
     double tcost_all = t_r.toc();
-    if (SHOW_TRACK) {
+    if (SHOW_TRACK && track_drawer.wanted()) {
         drawTrackFisheye(cv::Mat(), cv::Mat(), up_top_img, down_top_img, up_side_img, down_side_img);
     }
         
@@ -356,26 +373,28 @@ FeatureFrame FeatureTracker::trackImage_fisheye(double _cur_time,
     prev_up_side_pts = cur_up_side_pts;
     prev_down_side_pts = cur_down_side_pts;
 
-    prev_up_top_un_pts = cur_up_top_un_pts;
-    prev_down_top_un_pts = cur_down_top_un_pts;
-    prev_up_side_un_pts = cur_up_side_un_pts;
-    prev_down_side_un_pts = cur_down_side_un_pts;
-
-    prev_up_top_un_pts_map = cur_up_top_un_pts_map;
-    prev_down_top_un_pts_map = cur_down_top_un_pts_map;
-    prev_up_side_un_pts_map = cur_up_side_un_pts_map;
-    prev_down_side_un_pts_map = cur_up_side_un_pts_map;
+    // ptsVelocity3D stored this frame's undistorted points, they become the previous ones
+    up_top_un_pts_slots.swap();
+    down_top_un_pts_slots.swap();
+    up_side_un_pts_slots.swap();
+    down_side_un_pts_slots.swap();
     prev_time = cur_time;
 
-    up_top_prevLeftPtsMap = pts_map(ids_up_top, cur_up_top_pts);
-    down_top_prevLeftPtsMap = pts_map(ids_down_top, cur_down_top_pts);
-    up_side_prevLeftPtsMap = pts_map(ids_up_side, cur_up_side_pts);
-    down_side_prevLeftPtsMap = pts_map(ids_down_side, cur_down_side_pts);
+    if (SHOW_TRACK) {
+        up_top_pts_slots.store(ids_up_top, cur_up_top_pts);
+        down_top_pts_slots.store(ids_down_top, cur_down_top_pts);
+        up_side_pts_slots.store(ids_up_side, cur_up_side_pts);
+        down_side_pts_slots.store(ids_down_side, cur_down_side_pts);
+        up_top_pts_slots.swap();
+        down_top_pts_slots.swap();
+        up_side_pts_slots.swap();
+        down_side_pts_slots.swap();
+    }
 
     // hasPrediction = false;
     auto ff = setup_feature_frame();
 
-    printf("FT Whole %fms; MainProcess %fms concat %fms PTS %ld T\n", t_r.toc(), tcost_all, concat_cost, ff.size());
+    printf("FT Whole %fms; MainProcess %fms concat %fms PTS %d T\n", t_r.toc(), tcost_all, concat_cost, ff->size());
     return ff;
 }
 
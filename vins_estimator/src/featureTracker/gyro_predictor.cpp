@@ -0,0 +1,88 @@
+/*******************************************************
+ * Copyright (C) 2019, Aerial Robotics Group, Hong Kong University of Science and Technology
+ *
+ * This file is part of VINS.
+ *
+ * Licensed under the GNU General Public License v3.0;
+ * you may not use this file except in compliance with the License.
+ *******************************************************/
+
+#include "gyro_predictor.h"
+#include "../utility/utility.h"
+
+void GyroPredictor::input(const IMUSample * samples, int num)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (int i = 0; i < num; i++)
+        gyr_buf.push_back(std::make_pair(samples[i].t, samples[i].gyr));
+    while (!gyr_buf.empty() && gyr_buf.back().first - gyr_buf.front().first > GYRO_PREDICT_HISTORY)
+        gyr_buf.pop_front();
+}
+
+void GyroPredictor::setExtrinsic(const Eigen::Matrix3d _ric[2])
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    ric[0] = _ric[0];
+    ric[1] = _ric[1];
+}
+
+void GyroPredictor::setState(const Eigen::Vector3d & _bg, double _td)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    bg = _bg;
+    td = _td;
+    has_state = true;
+}
+
+void GyroPredictor::resetState()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    bg.setZero();
+    has_state = false;
+}
+
+bool GyroPredictor::predict(double t0, double t1, Eigen::Matrix3d R_cam[2], bool & confident)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    double a = t0 + td, b = t1 + td;
+
+    // Only the last sample before the interval is needed for it and later ones
+    while (gyr_buf.size() >= 2 && gyr_buf[1].first <= a)
+        gyr_buf.pop_front();
+
+    if (gyr_buf.empty() || b <= a)
+        return false;
+    if (gyr_buf.front().first > a + GYRO_PREDICT_MAX_GAP || gyr_buf.back().first < b - GYRO_PREDICT_MAX_GAP)
+        return false;
+
+    // The rate is linear between samples and held beyond the first and last one, every piece is
+    // integrated with its midpoint rate
+    Eigen::Quaterniond dq = Eigen::Quaterniond::Identity();
+    auto integrate = [&](double lo, double hi, const Eigen::Vector3d & w_lo, const Eigen::Vector3d & w_hi) {
+        if (hi > lo)
+            dq = dq * Utility::deltaQ((0.5 * (w_lo + w_hi) - bg) * (hi - lo));
+    };
+
+    const auto & first = gyr_buf.front();
+    integrate(a, std::min(first.first, b), first.second, first.second);
+    for (size_t i = 0; i + 1 < gyr_buf.size() && gyr_buf[i].first < b; i++)
+    {
+        const auto & s0 = gyr_buf[i];
+        const auto & s1 = gyr_buf[i + 1];
+        double lo = std::max(a, s0.first), hi = std::min(b, s1.first);
+        if (hi <= lo)
+            continue;
+        double span = s1.first - s0.first;
+        integrate(lo, hi, s0.second + (s1.second - s0.second) * ((lo - s0.first) / span),
+                          s0.second + (s1.second - s0.second) * ((hi - s0.first) / span));
+    }
+    const auto & last = gyr_buf.back();
+    integrate(std::max(a, last.first), b, last.second, last.second);
+
+    dq.normalize();
+    Eigen::Matrix3d R_body = dq.toRotationMatrix();
+    for (int k = 0; k < 2; k++)
+        R_cam[k] = ric[k].transpose() * R_body * ric[k];
+    confident = has_state;
+    return true;
+}
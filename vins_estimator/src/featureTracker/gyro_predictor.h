@@ -0,0 +1,48 @@
+/*******************************************************
+ * Copyright (C) 2019, Aerial Robotics Group, Hong Kong University of Science and Technology
+ *
+ * This file is part of VINS.
+ *
+ * Licensed under the GNU General Public License v3.0;
+ * you may not use this file except in compliance with the License.
+ *******************************************************/
+
+#pragma once
+
+#include <mutex>
+#include <deque>
+#include <utility>
+#include <eigen3/Eigen/Dense>
+
+#include "../estimator/imu_propagator.h"
+
+// Largest gap between the frame interval and the gyro samples covering it, seconds
+#define GYRO_PREDICT_MAX_GAP 0.01
+// Samples older than this are dropped even when no frame asks for them
+#define GYRO_PREDICT_HISTORY 1.0
+
+// Camera rotation between two frames integrated from the raw gyro, for starting the optical flow
+// of the fisheye tracker where the features will be instead of where they were.
+// Samples come from the IMU input thread, bias, extrinsic and time offset from the backend after each
+// solve and the prediction is asked for by the tracker, so everything is behind one mutex.
+class GyroPredictor
+{
+  public:
+    void input(const IMUSample * samples, int num);
+    void setExtrinsic(const Eigen::Matrix3d ric[2]);
+    void setState(const Eigen::Vector3d & bg, double td);
+    // Forget the bias after the backend restarts
+    void resetState();
+
+    // R_cam[k] rotates camera k at t1 into camera k at t0, so a bearing f seen at t0 is expected at R_cam[k]^T f.
+    // Returns false when the gyro does not cover [t0, t1]; confident tells whether the backend bias was applied
+    bool predict(double t0, double t1, Eigen::Matrix3d R_cam[2], bool & confident);
+
+  private:
+    std::mutex mutex;
+    std::deque<std::pair<double, Eigen::Vector3d>> gyr_buf;
+    Eigen::Matrix3d ric[2] = {Eigen::Matrix3d::Identity(), Eigen::Matrix3d::Identity()};
+    Eigen::Vector3d bg = Eigen::Vector3d::Zero();
+    double td = 0;
+    bool has_state = false;
+};
@@ -0,0 +1,115 @@
+/*******************************************************
+ * Copyright (C) 2019, Aerial Robotics Group, Hong Kong University of Science and Technology
+ *
+ * This file is part of VINS.
+ *
+ * Licensed under the GNU General Public License v3.0;
+ * you may not use this file except in compliance with the License.
+ *******************************************************/
+
+#include "occupancy_grid.h"
+#include <opencv2/imgproc/imgproc.hpp>
+
+void OccupancyGrid::reset(cv::Size size, int min_dist)
+{
+    this->size = size;
+    cell = std::max(min_dist, 1);
+    min_dist2 = (float)min_dist * min_dist;
+    grid_cols = std::max((size.width + cell - 1) / cell, 1);
+    grid_rows = std::max((size.height + cell - 1) / cell, 1);
+    cnt.assign(grid_cols * grid_rows, 0);
+    pts.resize(grid_cols * grid_rows * OCCUPANCY_CELL_CAP);
+}
+
+bool OccupancyGrid::isFree(const cv::Point2f & pt) const
+{
+    int cx = cellX(pt.x), cy = cellY(pt.y);
+    for (int y = std::max(cy - 1, 0); y <= std::min(cy + 1, grid_rows - 1); y++) {
+        for (int x = std::max(cx - 1, 0); x <= std::min(cx + 1, grid_cols - 1); x++) {
+            int c = y * grid_cols + x;
+            const cv::Point2f * p = &pts[c * OCCUPANCY_CELL_CAP];
+            for (int i = 0; i < cnt[c]; i++) {
+                float dx = p[i].x - pt.x, dy = p[i].y - pt.y;
+                if (dx * dx + dy * dy < min_dist2) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+void OccupancyGrid::add(const cv::Point2f & pt)
+{
+    int c = cellY(pt.y) * grid_cols + cellX(pt.x);
+    if (cnt[c] < OCCUPANCY_CELL_CAP) {
+        pts[c * OCCUPANCY_CELL_CAP + cnt[c]] = pt;
+        cnt[c]++;
+    }
+}
+
+int OccupancyGrid::neighbors(int cx, int cy, cv::Point2f * out) const
+{
+    int num = 0;
+    for (int y = std::max(cy - 1, 0); y <= std::min(cy + 1, grid_rows - 1); y++) {
+        for (int x = std::max(cx - 1, 0); x <= std::min(cx + 1, grid_cols - 1); x++) {
+            int c = y * grid_cols + x;
+            for (int i = 0; i < cnt[c]; i++) {
+                out[num++] = pts[c * OCCUPANCY_CELL_CAP + i];
+            }
+        }
+    }
+    return num;
+}
+
+void OccupancyGrid::suppress(const std::vector<cv::Point2f> & _pts, const std::vector<int> & track_cnt, std::vector<int> & keep,
+    int max_pts)
+{
+    int n = _pts.size();
+    int max_cnt = 0;
+    for (int i = 0; i < n; i++) {
+        max_cnt = std::max(max_cnt, track_cnt[i]);
+    }
+
+    // Bucket starts for descending track counts, ties keep their index order
+    track_bucket.assign(max_cnt + 2, 0);
+    for (int i = 0; i < n; i++) {
+        track_bucket[max_cnt - std::max(track_cnt[i], 0) + 1]++;
+    }
+    for (int c = 1; c <= max_cnt + 1; c++) {
+        track_bucket[c] += track_bucket[c - 1];
+    }
+    order.resize(n);
+    for (int i = 0; i < n; i++) {
+        order[track_bucket[max_cnt - std::max(track_cnt[i], 0)]++] = i;
+    }
+
+    kept.assign(n, 0);
+    int kept_num = 0;
+    for (int k = 0; k < n && kept_num < max_pts; k++) {
+        int i = order[k];
+        if (isFree(_pts[i])) {
+            add(_pts[i]);
+            kept[i] = 1;
+            kept_num++;
+        }
+    }
+
+    keep.clear();
+    for (int i = 0; i < n; i++) {
+        if (kept[i]) {
+            keep.push_back(i);
+        }
+    }
+}
+
+void OccupancyGrid::drawMask(cv::Mat & mask) const
+{
+    mask.create(size, CV_8UC1);
+    mask.setTo(cv::Scalar(255));
+    for (int c = 0; c < grid_cols * grid_rows; c++) {
+        for (int i = 0; i < cnt[c]; i++) {
+            cv::circle(mask, pts[c * OCCUPANCY_CELL_CAP + i], cell, 0, -1);
+        }
+    }
+}
@@ -0,0 +1,57 @@
+/*******************************************************
+ * Copyright (C) 2019, Aerial Robotics Group, Hong Kong University of Science and Technology
+ *
+ * This file is part of VINS.
+ *
+ * Licensed under the GNU General Public License v3.0;
+ * you may not use this file except in compliance with the License.
+ *******************************************************/
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <climits>
+#include <opencv2/core/core.hpp>
+
+// Points of a cell of min_dist side that are pairwise min_dist apart fit in its corners
+#define OCCUPANCY_CELL_CAP 4
+
+// Feature points bucketed in square cells of min_dist side, so whether a position is at least min_dist
+// away from every point only needs the 3x3 cells around it. Stands in for painting circles into a mask.
+class OccupancyGrid
+{
+  public:
+    void reset(cv::Size size, int min_dist);
+    bool isFree(const cv::Point2f & pt) const;
+    // Adds the point without checking, a full cell keeps its first points
+    void add(const cv::Point2f & pt);
+
+    int cellSize() const { return cell; }
+    int cols() const { return grid_cols; }
+    int rows() const { return grid_rows; }
+    bool cellEmpty(int cx, int cy) const { return cnt[cy * grid_cols + cx] == 0; }
+    // Copies the points of the 3x3 cells around (cx, cy), returns their number
+    int neighbors(int cx, int cy, cv::Point2f * out) const;
+
+    // Goes through the points longest track first, counting sorted, and adds the ones that are min_dist clear
+    // of those kept before, up to max_pts of them. keep receives the indices of the survivors in ascending order
+    void suppress(const std::vector<cv::Point2f> & pts, const std::vector<int> & track_cnt, std::vector<int> & keep,
+        int max_pts = INT_MAX);
+    // Raster mask for the detectors that need one, 0 within min_dist of the grid points
+    void drawMask(cv::Mat & mask) const;
+
+  private:
+    int cellX(float x) const { return std::min(std::max((int)(x / cell), 0), grid_cols - 1); }
+    int cellY(float y) const { return std::min(std::max((int)(y / cell), 0), grid_rows - 1); }
+
+    cv::Size size;
+    int cell = 1;
+    int grid_cols = 0, grid_rows = 0;
+    float min_dist2 = 0;
+    std::vector<int> cnt;
+    std::vector<cv::Point2f> pts;
+    // Counting sort scratch of suppress()
+    std::vector<int> track_bucket, order;
+    std::vector<unsigned char> kept;
+};
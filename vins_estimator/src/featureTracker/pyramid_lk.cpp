@@ -0,0 +1,236 @@
+/*******************************************************
+ * Copyright (C) 2019, Aerial Robotics Group, Hong Kong University of Science and Technology
+ *
+ * This file is part of VINS.
+ *
+ * Licensed under the GNU General Public License v3.0;
+ * you may not use this file except in compliance with the License.
+ *******************************************************/
+
+#include "pyramid_lk.h"
+#include <cfloat>
+
+namespace {
+
+// Bilinear weights in W_BITS fixed point; intensities are kept scaled by 32 (5 bits), derivatives as
+// they come from the Scharr filter, sums are scaled back by FLT_SCALE
+const int W_BITS = 14;
+const float FLT_SCALE = 1.f/(1 << 20);
+const float MIN_EIG_THRESHOLD = 1e-4f;
+
+inline int descale(int x, int n)
+{
+    return (x + (1 << (n - 1))) >> n;
+}
+
+// Weights and the values they scale fit in 16 bits, so the products are widening 16-bit multiplies
+// even on targets without a 32-bit vector multiply (SSE2)
+struct Bilinear
+{
+    short w00, w01, w10, w11;
+    Bilinear(float a, float b)
+    {
+        w00 = cvRound((1.f - a)*(1.f - b)*(1 << W_BITS));
+        w01 = cvRound(a*(1.f - b)*(1 << W_BITS));
+        w10 = cvRound((1.f - a)*b*(1 << W_BITS));
+        w11 = (1 << W_BITS) - w00 - w01 - w10;
+    }
+};
+
+struct LKParams
+{
+    int max_iter;
+    float eps;
+    bool use_initial_flow;
+};
+
+// Window of the previous image around the point: intensity and derivatives, row major
+template <int WIN>
+struct Patch
+{
+    short I[WIN*WIN];
+    short Ix[WIN*WIN];
+    short Iy[WIN*WIN];
+};
+
+// One point on one level, the same steps as OpenCV's LKTrackerInvoker.
+// Reads may reach WIN pixels beyond the image, which the pyramid border covers
+template <int WIN>
+void trackPointLevel(const cv::Mat & I, const cv::Mat & dI, const cv::Mat & J, int level, int max_level,
+    const cv::Point2f & prev, cv::Point2f & cur, uchar & status, const LKParams & params, Patch<WIN> & patch)
+{
+    const float half_win = (WIN - 1)*0.5f;
+    const size_t stepI = I.step, stepJ = J.step, stepD = dI.step/sizeof(short);
+
+    cv::Point2f prev_pt = prev*(1.f/(1 << level));
+    cv::Point2f next_pt;
+    if (level == max_level) {
+        next_pt = params.use_initial_flow ? cur*(1.f/(1 << level)) : prev_pt;
+    } else {
+        next_pt = cur*2.f;
+    }
+    cur = next_pt;
+
+    prev_pt -= cv::Point2f(half_win, half_win);
+    int ix = cvFloor(prev_pt.x), iy = cvFloor(prev_pt.y);
+    if (ix < -WIN || ix >= dI.cols || iy < -WIN || iy >= dI.rows) {
+        if (level == 0) {
+            status = 0;
+        }
+        return;
+    }
+
+    Bilinear w(prev_pt.x - ix, prev_pt.y - iy);
+    long long iA11 = 0, iA12 = 0, iA22 = 0;
+    for (int y = 0; y < WIN; y++) {
+        const uchar * src = I.data + (y + iy)*stepI + ix;
+        const short * dsrc = (const short *)(dI.data + (y + iy)*dI.step) + ix*2;
+        short * Ip = patch.I + y*WIN;
+        short * Ixp = patch.Ix + y*WIN;
+        short * Iyp = patch.Iy + y*WIN;
+        int a11 = 0, a12 = 0, a22 = 0;
+        #pragma omp simd reduction(+:a11,a12,a22)
+        for (int x = 0; x < WIN; x++) {
+            int ival = descale((short)src[x]*w.w00 + (short)src[x + 1]*w.w01 +
+                               (short)src[x + stepI]*w.w10 + (short)src[x + stepI + 1]*w.w11, W_BITS - 5);
+            int ixval = descale(dsrc[2*x]*w.w00 + dsrc[2*x + 2]*w.w01 +
+                                dsrc[2*x + stepD]*w.w10 + dsrc[2*x + stepD + 2]*w.w11, W_BITS);
+            int iyval = descale(dsrc[2*x + 1]*w.w00 + dsrc[2*x + 3]*w.w01 +
+                                dsrc[2*x + stepD + 1]*w.w10 + dsrc[2*x + stepD + 3]*w.w11, W_BITS);
+            short sx = (short)ixval, sy = (short)iyval;
+            Ip[x] = (short)ival;
+            Ixp[x] = sx;
+            Iyp[x] = sy;
+            a11 += sx*sx;
+            a12 += sx*sy;
+            a22 += sy*sy;
+        }
+        iA11 += a11;
+        iA12 += a12;
+        iA22 += a22;
+    }
+
+    float A11 = iA11*FLT_SCALE, A12 = iA12*FLT_SCALE, A22 = iA22*FLT_SCALE;
+    float D = A11*A22 - A12*A12;
+    float min_eig = (A22 + A11 - std::sqrt((A11 - A22)*(A11 - A22) + 4.f*A12*A12))/(2*WIN*WIN);
+    if (min_eig < MIN_EIG_THRESHOLD || D < FLT_EPSILON) {
+        if (level == 0) {
+            status = 0;
+        }
+        return;
+    }
+    D = 1.f/D;
+
+    next_pt -= cv::Point2f(half_win, half_win);
+    cv::Point2f prev_delta;
+    for (int j = 0; j < params.max_iter; j++) {
+        int jx = cvFloor(next_pt.x), jy = cvFloor(next_pt.y);
+        if (jx < -WIN || jx >= J.cols || jy < -WIN || jy >= J.rows) {
+            if (level == 0) {
+                status = 0;
+            }
+            break;
+        }
+
+        Bilinear v(next_pt.x - jx, next_pt.y - jy);
+        long long ib1 = 0, ib2 = 0;
+        for (int y = 0; y < WIN; y++) {
+            const uchar * Jp = J.data + (y + jy)*stepJ + jx;
+            const short * Ip = patch.I + y*WIN;
+            const short * Ixp = patch.Ix + y*WIN;
+            const short * Iyp = patch.Iy + y*WIN;
+            int b1 = 0, b2 = 0;
+            #pragma omp simd reduction(+:b1,b2)
+            for (int x = 0; x < WIN; x++) {
+                short diff = (short)(descale((short)Jp[x]*v.w00 + (short)Jp[x + 1]*v.w01 +
+                                             (short)Jp[x + stepJ]*v.w10 + (short)Jp[x + stepJ + 1]*v.w11, W_BITS - 5) - Ip[x]);
+                b1 += diff*Ixp[x];
+                b2 += diff*Iyp[x];
+            }
+            ib1 += b1;
+            ib2 += b2;
+        }
+
+        float b1 = ib1*FLT_SCALE, b2 = ib2*FLT_SCALE;
+        cv::Point2f delta((A12*b2 - A22*b1)*D, (A12*b1 - A11*b2)*D);
+        next_pt += delta;
+        cur = next_pt + cv::Point2f(half_win, half_win);
+
+        if (delta.ddot(delta) <= params.eps) {
+            break;
+        }
+        if (j > 0 && std::abs(delta.x + prev_delta.x) < 0.01 && std::abs(delta.y + prev_delta.y) < 0.01) {
+            cur -= delta*0.5f;
+            break;
+        }
+        prev_delta = delta;
+    }
+}
+
+// A point goes through all levels before the next one, points do not depend on each other
+template <int WIN, int LEVELS>
+void trackPoints(const std::vector<cv::Mat> & prev_pyr, const std::vector<cv::Mat> & cur_pyr,
+    const std::vector<cv::Point2f> & prev_pts, std::vector<cv::Point2f> & cur_pts, std::vector<uchar> & status,
+    const LKParams & params, int begin, int end)
+{
+    Patch<WIN> patch;
+    for (int k = begin; k < end; k++) {
+        for (int level = LEVELS; level >= 0; level--) {
+            trackPointLevel<WIN>(prev_pyr[level*2], prev_pyr[level*2 + 1], cur_pyr[level*2], level, LEVELS,
+                prev_pts[k], cur_pts[k], status[k], params, patch);
+        }
+    }
+}
+
+template <int WIN, int LEVELS>
+void trackAll(const std::vector<cv::Mat> & prev_pyr, const std::vector<cv::Mat> & cur_pyr,
+    const std::vector<cv::Point2f> & prev_pts, std::vector<cv::Point2f> & cur_pts, std::vector<uchar> & status,
+    const LKParams & params)
+{
+    int num = prev_pts.size();
+    int chunks = (num + PYRAMID_LK_GRAIN - 1)/PYRAMID_LK_GRAIN;
+    #pragma omp taskloop grainsize(1) shared(prev_pyr, cur_pyr, prev_pts, cur_pts, status, params)
+    for (int c = 0; c < chunks; c++) {
+        trackPoints<WIN, LEVELS>(prev_pyr, cur_pyr, prev_pts, cur_pts, status, params,
+            c*PYRAMID_LK_GRAIN, std::min(num, (c + 1)*PYRAMID_LK_GRAIN));
+    }
+}
+
+}
+
+void trackPyramidLK(const std::vector<cv::Mat> & prev_pyr, const std::vector<cv::Mat> & cur_pyr,
+    const std::vector<cv::Point2f> & prev_pts, std::vector<cv::Point2f> & cur_pts, std::vector<uchar> & status,
+    cv::Size win_size, int max_level, cv::TermCriteria criteria, int flags)
+{
+    bool has_deriv = prev_pyr.size() > 1 && prev_pyr[1].type() == CV_16SC2 && cur_pyr.size() > 1 && cur_pyr[1].type() == CV_16SC2;
+    if (has_deriv) {
+        max_level = std::min(max_level, (int)std::min(prev_pyr.size(), cur_pyr.size())/2 - 1);
+    }
+    if (!has_deriv || win_size != cv::Size(PYRAMID_LK_WIN, PYRAMID_LK_WIN) || max_level > PYRAMID_LK_MAX_LEVEL) {
+        std::vector<float> err;
+        cv::calcOpticalFlowPyrLK(prev_pyr, cur_pyr, prev_pts, cur_pts, status, err, win_size, max_level, criteria, flags);
+        return;
+    }
+
+    // Same defaults and clamping as OpenCV
+    LKParams params;
+    params.max_iter = (criteria.type & cv::TermCriteria::COUNT) ? std::min(std::max(criteria.maxCount, 0), 100) : 30;
+    float eps = (criteria.type & cv::TermCriteria::EPS) ? std::min(std::max(criteria.epsilon, 0.), 10.) : 0.01;
+    params.eps = eps*eps;
+    params.use_initial_flow = (flags & cv::OPTFLOW_USE_INITIAL_FLOW) && cur_pts.size() == prev_pts.size();
+
+    if (!params.use_initial_flow) {
+        cur_pts.resize(prev_pts.size());
+    }
+    status.assign(prev_pts.size(), 1);
+    if (prev_pts.empty()) {
+        return;
+    }
+
+    switch (max_level) {
+        case 0: trackAll<PYRAMID_LK_WIN, 0>(prev_pyr, cur_pyr, prev_pts, cur_pts, status, params); break;
+        case 1: trackAll<PYRAMID_LK_WIN, 1>(prev_pyr, cur_pyr, prev_pts, cur_pts, status, params); break;
+        case 2: trackAll<PYRAMID_LK_WIN, 2>(prev_pyr, cur_pyr, prev_pts, cur_pts, status, params); break;
+        default: trackAll<PYRAMID_LK_WIN, 3>(prev_pyr, cur_pyr, prev_pts, cur_pts, status, params); break;
+    }
+}
@@ -0,0 +1,32 @@
+/*******************************************************
+ * Copyright (C) 2019, Aerial Robotics Group, Hong Kong University of Science and Technology
+ *
+ * This file is part of VINS.
+ *
+ * Licensed under the GNU General Public License v3.0;
+ * you may not use this file except in compliance with the License.
+ *******************************************************/
+
+#pragma once
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+// Window size the kernel is specialized for, the WIN_SIZE of the tracker
+#define PYRAMID_LK_WIN 21
+#define PYRAMID_LK_MAX_LEVEL 3
+// Points per task of one call
+#define PYRAMID_LK_GRAIN 16
+
+// Pyramidal Lucas-Kanade with the contract and the fixed-point arithmetic of cv::calcOpticalFlowPyrLK, for
+// pyramids built with derivatives by cv::buildOpticalFlowPyramid (PyramidPool).
+// Window size and level count are template parameters, so every window row is a fixed-length integer
+// loop the compiler vectorizes for the target (SSE/AVX2 or NEON).
+// The Scharr derivatives are not recomputed: those stored in a frame's pyramid serve the backward check of
+// that frame and the forward pass of the next one.
+// Points are split into OpenMP tasks, so a call from a tracking task shares the threads of the task graph.
+// Other window sizes, deeper pyramids or pyramids without derivatives go to OpenCV.
+void trackPyramidLK(const std::vector<cv::Mat> & prev_pyr, const std::vector<cv::Mat> & cur_pyr,
+    const std::vector<cv::Point2f> & prev_pts, std::vector<cv::Point2f> & cur_pts, std::vector<uchar> & status,
+    cv::Size win_size, int max_level,
+    cv::TermCriteria criteria = cv::TermCriteria(cv::TermCriteria::COUNT+cv::TermCriteria::EPS, 30, 0.01), int flags = 0);
@@ -0,0 +1,37 @@
+/*******************************************************
+ * Copyright (C) 2019, Aerial Robotics Group, Hong Kong University of Science and Technology
+ *
+ * This file is part of VINS.
+ *
+ * Licensed under the GNU General Public License v3.0;
+ * you may not use this file except in compliance with the License.
+ *******************************************************/
+
+#include "pyramid_pool.h"
+
+void PyramidPool::build(const cv::Mat & img, cv::Size win_size, int max_level)
+{
+    std::vector<cv::Mat> & p = pyr[cur_idx];
+    level_data.resize(p.size());
+    for (size_t i = 0; i < p.size(); i++) {
+        level_data[i] = std::make_pair(p[i].datastart, p[i].dataend);
+    }
+
+    cv::buildOpticalFlowPyramid(img, p, win_size, max_level, true);
+
+    // A level whose buffer moved or changed extent was allocated by this build; the extent catches
+    // the allocator handing back the address it just freed
+    for (size_t i = 0; i < p.size(); i++) {
+        if (i >= level_data.size() || p[i].datastart != level_data[i].first || p[i].dataend != level_data[i].second) {
+            alloc_num++;
+            alloc_bytes += p[i].dataend - p[i].datastart;
+        }
+    }
+}
+
+void PyramidPool::clear()
+{
+    pyr[0].clear();
+    pyr[1].clear();
+    cur_idx = 0;
+}
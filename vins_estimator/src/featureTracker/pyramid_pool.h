@@ -0,0 +1,37 @@
+/*******************************************************
+ * Copyright (C) 2019, Aerial Robotics Group, Hong Kong University of Science and Technology
+ *
+ * This file is part of VINS.
+ *
+ * Licensed under the GNU General Public License v3.0;
+ * you may not use this file except in compliance with the License.
+ *******************************************************/
+
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <opencv2/opencv.hpp>
+
+// Optical flow pyramids of one camera direction, double buffered: the current frame is built into
+// one buffer while the previous frame's pyramid stays in the other, and swap() exchanges them.
+// cv::buildOpticalFlowPyramid keeps the level buffers of a pyramid it is handed again as long as the
+// image size does not change, so once both buffers are warm a frame allocates no pyramid memory.
+class PyramidPool
+{
+  public:
+    void build(const cv::Mat & img, cv::Size win_size, int max_level);
+    std::vector<cv::Mat> * cur() { return &pyr[cur_idx]; }
+    std::vector<cv::Mat> * prev() { return &pyr[cur_idx ^ 1]; }
+    void swap() { cur_idx ^= 1; }
+    void clear();
+
+    // Level buffers build() had to (re)allocate, for the allocation counters of the perf output
+    long alloc_num = 0;
+    long alloc_bytes = 0;
+
+  private:
+    std::vector<cv::Mat> pyr[2];
+    std::vector<std::pair<const uchar *, const uchar *>> level_data;
+    int cur_idx = 0;
+};
@@ -0,0 +1,45 @@
+/*******************************************************
+ * Copyright (C) 2019, Aerial Robotics Group, Hong Kong University of Science and Technology
+ *
+ * This file is part of VINS.
+ *
+ * Licensed under the GNU General Public License v3.0;
+ * you may not use this file except in compliance with the License.
+ *******************************************************/
+
+#include "stage_trace.h"
+#include <algorithm>
+#include <omp.h>
+#include <ros/console.h>
+
+void StageTrace::reset()
+{
+    num = 0;
+    frame_start = std::chrono::steady_clock::now();
+}
+
+double StageTrace::now() const
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frame_start).count();
+}
+
+void StageTrace::add(const char * name, double start_ms, double end_ms)
+{
+    int i = num.fetch_add(1);
+    if (i >= STAGE_TRACE_CAP) {
+        return;
+    }
+    stages[i].name = name;
+    stages[i].thread = omp_get_thread_num();
+    stages[i].start = start_ms;
+    stages[i].end = end_ms;
+}
+
+void StageTrace::print() const
+{
+    int n = std::min(num.load(), STAGE_TRACE_CAP);
+    for (int i = 0; i < n; i++) {
+        ROS_INFO("Stage %-18s thread %2d %8.3f -> %8.3f ms (%.3f ms)", stages[i].name, stages[i].thread,
+            stages[i].start, stages[i].end, stages[i].end - stages[i].start);
+    }
+}
@@ -0,0 +1,49 @@
+/*******************************************************
+ * Copyright (C) 2019, Aerial Robotics Group, Hong Kong University of Science and Technology
+ *
+ * This file is part of VINS.
+ *
+ * Licensed under the GNU General Public License v3.0;
+ * you may not use this file except in compliance with the License.
+ *******************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+#define STAGE_TRACE_CAP 32
+
+// Start and end of the stages of one frame, relative to reset(), and the thread that ran each of them.
+// Concurrent tasks record into their own slots, print() afterwards shows how the stages overlapped.
+class StageTrace
+{
+  public:
+    void reset();
+    double now() const;
+    void add(const char * name, double start_ms, double end_ms);
+    void print() const;
+
+    // Records the stage of the enclosing scope
+    class Scope
+    {
+      public:
+        Scope(StageTrace & _trace, const char * _name): trace(_trace), name(_name), start(_trace.now()) {}
+        ~Scope() { trace.add(name, start, trace.now()); }
+      private:
+        StageTrace & trace;
+        const char * name;
+        double start;
+    };
+
+  private:
+    struct Stage
+    {
+        const char * name;
+        int thread;
+        double start, end;
+    };
+    Stage stages[STAGE_TRACE_CAP];
+    std::atomic<int> num{0};
+    std::chrono::steady_clock::time_point frame_start;
+};
@@ -0,0 +1,214 @@
+/*******************************************************
+ * Copyright (C) 2019, Aerial Robotics Group, Hong Kong University of Science and Technology
+ *
+ * This file is part of VINS.
+ *
+ * Licensed under the GNU General Public License v3.0;
+ * you may not use this file except in compliance with the License.
+ *******************************************************/
+
+#include "track_drawer.h"
+#include <pthread.h>
+#include <sched.h>
+#include "../estimator/parameters.h"
+
+TrackDrawer::~TrackDrawer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    cond.notify_one();
+    if (thread.joinable())
+        thread.join();
+}
+
+void TrackDrawer::setSink(const Sink & _sink, const Gate & _gate)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    sink = _sink;
+    gate = _gate;
+}
+
+bool TrackDrawer::wanted() const
+{
+    // The gate is set once at startup, before any frame is tracked
+    return sink && (!gate || gate());
+}
+
+void TrackDrawer::submit(TrackDrawJob & job)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // The caller gets the buffers of the dropped job back to fill next time
+        std::swap(pending, job);
+        has_pending = true;
+        if (!thread.joinable())
+            thread = std::thread(&TrackDrawer::run, this);
+    }
+    cond.notify_one();
+}
+
+void TrackDrawer::run()
+{
+#ifdef __linux__
+    sched_param param = {0};
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#endif
+    TrackDrawJob job;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [this] { return has_pending || stop; });
+            if (stop)
+                return;
+            std::swap(pending, job);
+            has_pending = false;
+        }
+
+        cv::Mat img = job.fisheye ? drawFisheye(job) : drawPinhole(job);
+        if (!img.empty())
+            sink(img, job.t);
+    }
+}
+
+void TrackDrawer::drawView(cv::Mat & img, const TrackView & view)
+{
+    char idtext[10] = {0};
+    for (size_t j = 0; j < view.pts.size(); j++) {
+        //Not tri
+        //Not solving
+        //Just New point yellow
+        cv::Scalar color = cv::Scalar(0, 255, 255);
+        int status = view.status[j];
+        if (status < 0) {
+            //Removed points
+            color = cv::Scalar(0, 0, 0);
+        }
+
+        if (status == 1) {
+            //Good pt; But not used for solving; Blue
+            color = cv::Scalar(255, 0, 0);
+        }
+
+        if (status == 2) {
+            //Bad pt; Red
+            color = cv::Scalar(0, 0, 255);
+        }
+
+        if (status == 3) {
+            //Good pt for solving; Green
+            color = cv::Scalar(0, 255, 0);
+        }
+
+        cv::circle(img, view.pts[j], 1, color, 2);
+
+        sprintf(idtext, "%d", view.ids[j]);
+        cv::putText(img, idtext, view.pts[j] - cv::Point2f(5, 0), cv::FONT_HERSHEY_SIMPLEX, 1, color, 3);
+    }
+
+    for (size_t i = 0; i < view.pts.size(); i++) {
+        if (view.has_prev[i]) {
+            cv::arrowedLine(img, view.pts[i], view.prev_pts[i], cv::Scalar(0, 255, 0), 1, 8, 0, 0.2);
+        }
+    }
+}
+
+cv::Mat TrackDrawer::drawFisheye(TrackDrawJob & job)
+{
+    cv::Mat imUpTop, imDownTop, imUpSide, imDownSide;
+    cv::Mat * ims[4] = {&imUpTop, &imDownTop, &imUpSide, &imDownSide};
+    for (int k = 0; k < 4; k++) {
+        const cv::Mat & src = job.views[k].img;
+        if (src.empty())
+            continue;
+        // The frame image is shared with the tracker, so every view is drawn on a copy
+        if (src.channels() != 3)
+            cv::cvtColor(src, *ims[k], CV_GRAY2BGR);
+        else
+            *ims[k] = src.clone();
+        drawView(*ims[k], job.views[k]);
+    }
+    if (imUpTop.empty() || imDownTop.empty() || imUpSide.empty() || imDownSide.empty())
+        return cv::Mat();
+
+    cv::Mat imTrack;
+    cv::Mat fisheye_up;
+    cv::Mat fisheye_down;
+
+    int side_height = imUpSide.size().height;
+    int width = imUpTop.size().width;
+    //128
+    if (job.raw_up.size().width == 1024) {
+        fisheye_up = job.raw_up(cv::Rect(190, 62, 900, 900));
+        fisheye_down = job.raw_down(cv::Rect(190, 62, 900, 900));
+    } else {
+        fisheye_up = cv::Mat(cv::Size(900, 900), CV_8UC3, cv::Scalar(0, 0, 0));
+        fisheye_down = cv::Mat(cv::Size(900, 900), CV_8UC3, cv::Scalar(0, 0, 0));
+    }
+
+    cv::resize(fisheye_up, fisheye_up, cv::Size(width, width));
+    cv::resize(fisheye_down, fisheye_down, cv::Size(width, width));
+    if (fisheye_up.channels() != 3) {
+        cv::cvtColor(fisheye_up,   fisheye_up,   CV_GRAY2BGR);
+        cv::cvtColor(fisheye_down, fisheye_down, CV_GRAY2BGR);
+    }
+
+    //Show images
+    int side_count = 3;
+    if (enable_rear_side) {
+        side_count = 4;
+    }
+
+    for (int i = 1; i < side_count + 1; i ++) {
+        cv::line(imUpSide, cv::Point2d(i*width, 0), cv::Point2d(i*width, side_height), cv::Scalar(255, 0, 0), 1);
+        cv::line(imDownSide, cv::Point2d(i*width, 0), cv::Point2d(i*width, side_height), cv::Scalar(255, 0, 0), 1);
+    }
+
+    cv::vconcat(imUpSide, imDownSide, imTrack);
+
+    cv::Mat top_cam;
+
+    cv::hconcat(imUpTop, imDownTop, top_cam);
+    cv::hconcat(fisheye_up, top_cam, top_cam);
+    cv::hconcat(top_cam, fisheye_down, top_cam);
+    cv::resize(top_cam, top_cam, cv::Size(imUpSide.size().width, imUpSide.size().width/4));
+
+    cv::vconcat(top_cam, imTrack, imTrack);
+
+    double fx = ((double)SHOW_WIDTH) / ((double) imUpSide.size().width);
+    cv::resize(imTrack, imTrack, cv::Size(), fx, fx);
+    return imTrack;
+}
+
+cv::Mat TrackDrawer::drawPinhole(TrackDrawJob & job)
+{
+    const cv::Mat & imLeft = job.views[0].img;
+    const cv::Mat & imRight = job.views[1].img;
+    if (imLeft.empty())
+        return cv::Mat();
+
+    cv::Mat imTrack;
+    int cols = imLeft.cols;
+    if (!imRight.empty() && job.stereo)
+        cv::hconcat(imLeft, imRight, imTrack);
+    else
+        imTrack = imLeft.clone();
+
+    // Published as bgr8
+    if (imTrack.channels() != 3)
+        cv::cvtColor(imTrack, imTrack, CV_GRAY2BGR);
+
+    drawView(imTrack, job.views[0]);
+
+    if (!imRight.empty() && job.stereo)
+    {
+        for (size_t i = 0; i < job.right_pts.size(); i++)
+        {
+            cv::Point2f rightPt = ENABLE_DOWNSAMPLE ? job.right_pts[i]*2 : job.right_pts[i];
+            rightPt.x += cols;
+            cv::circle(imTrack, rightPt, 2, cv::Scalar(0, 255, 0), 2);
+        }
+    }
+    return imTrack;
+}
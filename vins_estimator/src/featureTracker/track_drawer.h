@@ -0,0 +1,76 @@
+/*******************************************************
+ * Copyright (C) 2019, Aerial Robotics Group, Hong Kong University of Science and Technology
+ *
+ * This file is part of VINS.
+ *
+ * Licensed under the GNU General Public License v3.0;
+ * you may not use this file except in compliance with the License.
+ *******************************************************/
+
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <opencv2/opencv.hpp>
+
+// Points of one image of the track image, copied out of the tracker
+struct TrackView
+{
+    // Shares the frame image with the tracker, which never writes into it
+    cv::Mat img;
+    std::vector<cv::Point2f> pts;
+    std::vector<int> ids;
+    // Backend status of each point, 0 when there is none
+    std::vector<int> status;
+    // Position in the previous frame, valid where has_prev is set
+    std::vector<cv::Point2f> prev_pts;
+    std::vector<uchar> has_prev;
+};
+
+// Everything a track image is drawn from
+struct TrackDrawJob
+{
+    double t = 0;
+    bool fisheye = false;
+    // Fisheye: up top, down top, up side, down side. Pinhole: left image, right image with right_pts
+    TrackView views[4];
+    std::vector<cv::Point2f> right_pts;
+    bool stereo = false;
+    // Raw fisheye images shown beside the top views, black when empty
+    cv::Mat raw_up, raw_down;
+};
+
+// Draws the track images on a low priority thread of its own, so show_track costs the tracker only the copy
+// of the point lists. Only the newest job is kept: frames that come while the previous image is still being
+// drawn replace each other. The sink publishes the image, wanted() tells whether anybody listens, and the
+// tracker skips the job altogether when nobody does.
+class TrackDrawer
+{
+  public:
+    typedef std::function<void(const cv::Mat &, double)> Sink;
+    typedef std::function<bool()> Gate;
+
+    ~TrackDrawer();
+    void setSink(const Sink & sink, const Gate & gate);
+    bool wanted() const;
+    void submit(TrackDrawJob & job);
+
+  private:
+    void run();
+    static void drawView(cv::Mat & img, const TrackView & view);
+    static cv::Mat drawFisheye(TrackDrawJob & job);
+    static cv::Mat drawPinhole(TrackDrawJob & job);
+
+    Sink sink;
+    Gate gate;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::thread thread;
+    TrackDrawJob pending;
+    bool has_pending = false;
+    bool stop = false;
+};
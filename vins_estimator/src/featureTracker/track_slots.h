@@ -0,0 +1,125 @@
+/*******************************************************
+ * Copyright (C) 2019, Aerial Robotics Group, Hong Kong University of Science and Technology
+ *
+ * This file is part of VINS.
+ *
+ * Licensed under the GNU General Public License v3.0;
+ * you may not use this file except in compliance with the License.
+ *******************************************************/
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+// Per-camera track values of the previous frame (undistorted points for the velocity, raw points for
+// drawing) kept as parallel id/value arrays, double buffered like PyramidPool.
+// The trackers only drop tracks and append new ids, which grow, so the ids of a frame are ascending
+// and match() lines them up with the previous frame in one merge pass; any other order falls back to
+// a binary search over a sorted index. All buffers keep their capacity, so a warm frame allocates nothing.
+template <typename T>
+class TrackSlots
+{
+  public:
+    // slot[i] is the index of ids[i] among the previous frame's values, -1 for new tracks
+    const std::vector<int> & match(const std::vector<int> & ids);
+    const T & prev(int slot) const { return vals[cur_idx ^ 1][slot]; }
+    bool empty() const { return track_ids[cur_idx ^ 1].empty(); }
+
+    // Values of the current frame; after swap() they are the previous ones and the current buffer is empty
+    void store(const std::vector<int> & ids, const std::vector<T> & pts);
+    void swap();
+    void clear();
+
+  private:
+    static bool ascending(const std::vector<int> & ids);
+
+    std::vector<int> track_ids[2];
+    std::vector<T> vals[2];
+    bool sorted[2] = {true, true};
+    int cur_idx = 0;
+
+    std::vector<int> slot;
+    std::vector<int> order;
+};
+
+template <typename T>
+bool TrackSlots<T>::ascending(const std::vector<int> & ids)
+{
+    for (size_t i = 1; i < ids.size(); i++) {
+        if (ids[i] <= ids[i - 1]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename T>
+const std::vector<int> & TrackSlots<T>::match(const std::vector<int> & ids)
+{
+    const std::vector<int> & prev_ids = track_ids[cur_idx ^ 1];
+    slot.assign(ids.size(), -1);
+    if (prev_ids.empty()) {
+        return slot;
+    }
+
+    if (sorted[cur_idx ^ 1] && ascending(ids)) {
+        size_t j = 0;
+        for (size_t i = 0; i < ids.size(); i++) {
+            while (j < prev_ids.size() && prev_ids[j] < ids[i]) {
+                j++;
+            }
+            if (j == prev_ids.size()) {
+                break;
+            }
+            if (prev_ids[j] == ids[i]) {
+                slot[i] = j;
+            }
+        }
+        return slot;
+    }
+
+    order.resize(prev_ids.size());
+    for (size_t j = 0; j < order.size(); j++) {
+        order[j] = j;
+    }
+    std::sort(order.begin(), order.end(), [&prev_ids](int a, int b) {
+        return prev_ids[a] < prev_ids[b];
+    });
+    for (size_t i = 0; i < ids.size(); i++) {
+        auto it = std::lower_bound(order.begin(), order.end(), ids[i], [&prev_ids](int a, int id) {
+            return prev_ids[a] < id;
+        });
+        if (it != order.end() && prev_ids[*it] == ids[i]) {
+            slot[i] = *it;
+        }
+    }
+    return slot;
+}
+
+template <typename T>
+void TrackSlots<T>::store(const std::vector<int> & ids, const std::vector<T> & pts)
+{
+    track_ids[cur_idx].assign(ids.begin(), ids.end());
+    vals[cur_idx].assign(pts.begin(), pts.end());
+    sorted[cur_idx] = ascending(ids);
+}
+
+template <typename T>
+void TrackSlots<T>::swap()
+{
+    cur_idx ^= 1;
+    track_ids[cur_idx].clear();
+    vals[cur_idx].clear();
+    sorted[cur_idx] = true;
+}
+
+template <typename T>
+void TrackSlots<T>::clear()
+{
+    for (int k = 0; k < 2; k++) {
+        track_ids[k].clear();
+        vals[k].clear();
+        sorted[k] = true;
+    }
+}
@@ -39,11 +39,18 @@ void solveGyroscopeBias(map<double, ImageFrame> &all_image_frame, Vector3d* Bgs)
     for (int i = 0; i <= WINDOW_SIZE; i++)
         Bgs[i] += delta_bg;
 
+    //Only repropagate the frames the first order correction is not good enough for
+    vector<IntegrationBase *> repropagate_frames;
     for (frame_i = all_image_frame.begin(); next(frame_i) != all_image_frame.end( ); frame_i++)
     {
         frame_j = next(frame_i);
-        frame_j->second.pre_integration->repropagate(Vector3d::Zero(), Bgs[0]);
+        if (!frame_j->second.pre_integration->correctBias(Vector3d::Zero(), Bgs[0]))
+            repropagate_frames.push_back(frame_j->second.pre_integration);
     }
+
+    #pragma omp parallel for
+    for (int i = 0; i < static_cast<int>(repropagate_frames.size()); i++)
+        repropagate_frames[i]->repropagate(Vector3d::Zero(), Bgs[0]);
 }
 
 
@@ -25,11 +25,11 @@ class ImageFrame
 {
     public:
         ImageFrame(){};
-        ImageFrame(const FeatureFrame& _points, double _t):t{_t},is_key_frame{false}
+        ImageFrame(const FeatureFramePtr& _points, double _t):t{_t},is_key_frame{false}
         {
             points = _points;
         };
-        FeatureFrame points;
+        FeatureFramePtr points;
         double t;
         Matrix3d R;
         Vector3d T;
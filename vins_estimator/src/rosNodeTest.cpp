@@ -166,7 +166,8 @@ void imu_callback(const sensor_msgs::ImuConstPtr &imu_msg)
 
 void feature_callback(const sensor_msgs::PointCloudConstPtr &feature_msg)
 {
-    FeatureFrame featureFrame;
+    auto featureFrame = std::make_shared<FeatureFrame>();
+    featureFrame->reserve(feature_msg->points.size());
     for (unsigned int i = 0; i < feature_msg->points.size(); i++)
     {
         int feature_id = feature_msg->channels[0].values[i];
@@ -187,10 +188,10 @@ void feature_callback(const sensor_msgs::PointCloudConstPtr &feature_msg)
             //printf("receive pts gt %d %f %f %f\n", feature_id, gx, gy, gz);
         }
         ROS_ASSERT(z == 1);
-        TrackFeatureNoId xyz_uv_velocity;
-        xyz_uv_velocity << x, y, z, p_u, p_v, velocity_x, velocity_y, 0;
-        featureFrame[feature_id].emplace_back(camera_id,  xyz_uv_velocity);
+        featureFrame->add(feature_id, camera_id, Eigen::Vector3d(x, y, z), Eigen::Vector2d(p_u, p_v),
+            Eigen::Vector3d(velocity_x, velocity_y, 0));
     }
+    featureFrame->sortById();
     double t = feature_msg->header.stamp.toSec();
     estimator.inputFeature(t, featureFrame);
     return;
@@ -26,6 +26,7 @@ ros::Publisher pub_rectify_pose_right;
 ros::Publisher pub_camera_pose_visual;
 nav_msgs::Path path;
 ros::Publisher pub_flatten_images;
+ros::Publisher pub_image_track;
 ros::Publisher pub_keyframe_pose;
 ros::Publisher pub_keyframe_point;
 ros::Publisher pub_extrinsic;
@@ -57,6 +58,7 @@ void registerPub(ros::NodeHandle &n)
     pub_viokeyframe = n.advertise<vins::VIOKeyframe>("viokeyframe", 1000);
     pub_viononkeyframe = n.advertise<vins::VIOKeyframe>("viononkeyframe", 1000);
     pub_flatten_images = n.advertise<vins::FlattenImages>("flatten_images", 1000);
+    pub_image_track = n.advertise<sensor_msgs::Image>("image_track", 1000);
 
     cameraposevisual.setScale(0.1);
     cameraposevisual.setLineWidth(0.01);
@@ -159,6 +161,15 @@ void pubFlattenImages(const Estimator &estimator, const std_msgs::Header &header
     pub_flatten_images.publish(images);
 }
 
+void pubTrackImage(const cv::Mat &imgTrack, const double t)
+{
+    std_msgs::Header header;
+    header.frame_id = "world";
+    header.stamp = ros::Time(t);
+    sensor_msgs::ImagePtr imgTrackMsg = cv_bridge::CvImage(header, "bgr8", imgTrack).toImageMsg();
+    pub_image_track.publish(imgTrackMsg);
+}
+
 void pubLatestOdometry(const Eigen::Vector3d &P, const Eigen::Quaterniond &Q, const Eigen::Vector3d &V, double t)
 {
     nav_msgs::Odometry odometry;
@@ -307,30 +318,30 @@ void pubOdometry(const Estimator &estimator, const std_msgs::Header &header)
         
         vkf.header.stamp = odometry.header.stamp;
 
-        for (auto &_it : estimator.f_manager.feature)
+        for (auto &it_per_id : estimator.f_manager.feature)
         {
-            auto & it_per_id = _it.second;
-            int frame_size = it_per_id.feature_per_frame.size();
+            int frame_size = it_per_id.obs_num;
             // ROS_INFO("START FRAME %d FRAME_SIZE %d WIN SIZE %d solve flag %d", it_per_id.start_frame, frame_size, WINDOW_SIZE, it_per_id.solve_flag);
             if(it_per_id.start_frame < WINDOW_SIZE && it_per_id.start_frame + frame_size >= WINDOW_SIZE&& it_per_id.solve_flag < 2)
             {
                 geometry_msgs::Point32 fp2d_uv;
                 geometry_msgs::Point32 fp2d_norm;
                 int imu_j = frame_size - 1;
+                int frame_j = it_per_id.endFrame();
 
-                fp2d_uv.x = it_per_id.feature_per_frame[imu_j].uv.x();
-                fp2d_uv.y = it_per_id.feature_per_frame[imu_j].uv.y();
+                fp2d_uv.x = it_per_id.uv(frame_j).x();
+                fp2d_uv.y = it_per_id.uv(frame_j).y();
                 fp2d_uv.z = 0;
 
-                fp2d_norm.x = it_per_id.feature_per_frame[imu_j].point.x();
-                fp2d_norm.y = it_per_id.feature_per_frame[imu_j].point.y();
+                fp2d_norm.x = it_per_id.point(frame_j).x();
+                fp2d_norm.y = it_per_id.point(frame_j).y();
                 fp2d_norm.z = 0;
 
                 vkf.feature_points_id.push_back(it_per_id.feature_id);
                 vkf.feature_points_2d_uv.push_back(fp2d_uv);
                 vkf.feature_points_2d_norm.push_back(fp2d_norm);
 
-                Vector3d pts_i = it_per_id.feature_per_frame[0].point * it_per_id.estimated_depth;
+                Vector3d pts_i = it_per_id.point(it_per_id.start_frame) * it_per_id.estimated_depth;
                 Vector3d w_pts_i = estimator.Rs[imu_j] * (estimator.ric[it_per_id.main_cam] * pts_i + estimator.tic[it_per_id.main_cam])
                                     + estimator.Ps[imu_j];
 
@@ -476,17 +487,16 @@ void pubPointCloud(const Estimator &estimator, const std_msgs::Header &header)
     loop_point_cloud.header = header;
 
 
-    for (auto _it : estimator.f_manager.feature)
+    for (auto &it_per_id : estimator.f_manager.feature)
     {
-        auto it_per_id = _it.second;
         int used_num;
-        used_num = it_per_id.feature_per_frame.size();
+        used_num = it_per_id.obs_num;
         if (!(used_num >= 2 && it_per_id.start_frame < WINDOW_SIZE - 2))
             continue;
         if (it_per_id.start_frame > WINDOW_SIZE * 3.0 / 4.0 || it_per_id.solve_flag != 1)
             continue;
         int imu_i = it_per_id.start_frame;
-        Vector3d pts_i = it_per_id.feature_per_frame[0].point * it_per_id.estimated_depth;
+        Vector3d pts_i = it_per_id.point(imu_i) * it_per_id.estimated_depth;
         Vector3d w_pts_i = estimator.Rs[imu_i] * (estimator.ric[it_per_id.main_cam] * pts_i + estimator.tic[it_per_id.main_cam]) + estimator.Ps[imu_i];
 
         geometry_msgs::Point32 p;
@@ -502,21 +512,20 @@ void pubPointCloud(const Estimator &estimator, const std_msgs::Header &header)
     sensor_msgs::PointCloud margin_cloud;
     margin_cloud.header = header;
 
-    for (auto &_it : estimator.f_manager.feature)
+    for (auto &it_per_id : estimator.f_manager.feature)
     {
-        auto & it_per_id = _it.second;
         int used_num;
-        used_num = it_per_id.feature_per_frame.size();
+        used_num = it_per_id.obs_num;
         if (!(used_num >= 2 && it_per_id.start_frame < WINDOW_SIZE - 2))
             continue;
         //if (it_per_id->start_frame > WINDOW_SIZE * 3.0 / 4.0 || it_per_id->solve_flag != 1)
         //        continue;
 
-        if (it_per_id.start_frame == 0 && it_per_id.feature_per_frame.size() <= 2 
+        if (it_per_id.start_frame == 0 && it_per_id.obs_num <= 2 
             && it_per_id.solve_flag == 1 )
         {
             int imu_i = it_per_id.start_frame;
-            Vector3d pts_i = it_per_id.feature_per_frame[0].point * it_per_id.estimated_depth;
+            Vector3d pts_i = it_per_id.point(imu_i) * it_per_id.estimated_depth;
             Vector3d w_pts_i = estimator.Rs[imu_i] * (estimator.ric[it_per_id.main_cam] * pts_i + estimator.tic[it_per_id.main_cam]) + estimator.Ps[imu_i];
 
             geometry_msgs::Point32 p;
@@ -639,15 +648,14 @@ void pubKeyframe(const Estimator &estimator)
         sensor_msgs::PointCloud point_cloud;
         point_cloud.header.stamp = ros::Time(estimator.Headers[WINDOW_SIZE - 2]);
         point_cloud.header.frame_id = "world";
-        for (auto &_it : estimator.f_manager.feature)
+        for (auto &it_per_id : estimator.f_manager.feature)
         {
-            auto & it_per_id = _it.second;
-            int frame_size = it_per_id.feature_per_frame.size();
+            int frame_size = it_per_id.obs_num;
             if(it_per_id.start_frame < WINDOW_SIZE - 2 && it_per_id.start_frame + frame_size - 1 >= WINDOW_SIZE - 2 && it_per_id.solve_flag < 2)
             {
 
                 int imu_i = it_per_id.start_frame;
-                Vector3d pts_i = it_per_id.feature_per_frame[0].point * it_per_id.estimated_depth;
+                Vector3d pts_i = it_per_id.point(imu_i) * it_per_id.estimated_depth;
                 Vector3d w_pts_i = estimator.Rs[imu_i] * (estimator.ric[it_per_id.main_cam] * pts_i + estimator.tic[it_per_id.main_cam])
                                       + estimator.Ps[imu_i];
                 geometry_msgs::Point32 p;
@@ -659,23 +667,23 @@ void pubKeyframe(const Estimator &estimator)
                 vkf.feature_points_3d.push_back(p);
 
                 // int imu_j = frame_size - 2;
-                int imu_j =  WINDOW_SIZE - 2 - it_per_id.start_frame;
+                int imu_j =  WINDOW_SIZE - 2;
                 sensor_msgs::ChannelFloat32 p_2d;
-                p_2d.values.push_back(it_per_id.feature_per_frame[imu_j].point.x());
-                p_2d.values.push_back(it_per_id.feature_per_frame[imu_j].point.y());
-                p_2d.values.push_back(it_per_id.feature_per_frame[imu_j].uv.x());
-                p_2d.values.push_back(it_per_id.feature_per_frame[imu_j].uv.y());
+                p_2d.values.push_back(it_per_id.point(imu_j).x());
+                p_2d.values.push_back(it_per_id.point(imu_j).y());
+                p_2d.values.push_back(it_per_id.uv(imu_j).x());
+                p_2d.values.push_back(it_per_id.uv(imu_j).y());
                 p_2d.values.push_back(it_per_id.feature_id);
                 point_cloud.channels.push_back(p_2d);
 
                 geometry_msgs::Point32 fp2d_uv;
                 geometry_msgs::Point32 fp2d_norm;
-                fp2d_uv.x = it_per_id.feature_per_frame[imu_j].uv.x();
-                fp2d_uv.y = it_per_id.feature_per_frame[imu_j].uv.y();
+                fp2d_uv.x = it_per_id.uv(imu_j).x();
+                fp2d_uv.y = it_per_id.uv(imu_j).y();
                 fp2d_uv.z = 0;
 
-                fp2d_norm.x = it_per_id.feature_per_frame[imu_j].point.x();
-                fp2d_norm.y = it_per_id.feature_per_frame[imu_j].point.y();
+                fp2d_norm.x = it_per_id.point(imu_j).x();
+                fp2d_norm.y = it_per_id.point(imu_j).y();
                 fp2d_norm.z = 0;
 
                 vkf.feature_points_id.push_back(it_per_id.feature_id);
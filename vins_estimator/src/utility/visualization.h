@@ -30,6 +30,7 @@
 
 extern ros::Publisher pub_odometry;
 extern ros::Publisher pub_flatten_images;
+extern ros::Publisher pub_image_track;
 extern ros::Publisher pub_path, pub_pose;
 extern ros::Publisher pub_cloud, pub_map;
 extern ros::Publisher pub_key_poses;
@@ -41,6 +42,8 @@ extern int IMAGE_ROW, IMAGE_COL;
 
 void registerPub(ros::NodeHandle &n);
 
+void pubTrackImage(const cv::Mat &imgTrack, const double t);
+
 void pubLatestOdometry(const Eigen::Vector3d &P, const Eigen::Quaterniond &Q, const Eigen::Vector3d &V, double t);
 
 void printStatistics(const Estimator &estimator, double t);